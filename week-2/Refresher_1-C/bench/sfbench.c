@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stringfun.h"
+
+// Micro-benchmark for the whitespace kernels in sfsimd.c.  Builds a corpus of
+// random words separated mostly by single spaces (with the odd run of blanks
+// and line break) and times every kernel set this CPU supports over it.
+//
+//   make bench                  256 MiB corpus
+//   ./bench/sfbench [MiB]       any other size
+
+#define BENCH_DEFAULT_MB    256
+#define BENCH_ROUNDS        5
+
+static const char *KERNEL_NAMES[] = { "scalar", "sse2", "avx2" };
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void make_corpus(char *buff, size_t len) {
+    unsigned int seed = 42;
+    size_t i = 0;
+
+    while (i < len) {
+        int wordLen = 1 + rand_r(&seed) % 12;
+        for (int j = 0; j < wordLen && i < len; j++) {
+            buff[i++] = 'a' + rand_r(&seed) % 26;
+        }
+
+        int r = rand_r(&seed) % 100;
+        const char *sep = (r < 85) ? " " : (r < 95) ? "  \t" : "\n";
+        for (; *sep && i < len; sep++) {
+            buff[i++] = *sep;
+        }
+    }
+}
+
+// best of BENCH_ROUNDS, in GB/s
+static double bench_count(const sf_kernels_t *k, const char *in, size_t len, long long *words) {
+    double best = 0;
+
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        sf_scan_state_t state = {0};
+        double start = now_sec();
+        *words = k->count_words(in, len, &state);
+        double gbps = len / (now_sec() - start) / 1e9;
+        best = (gbps > best) ? gbps : best;
+    }
+    return best;
+}
+
+static double bench_normalize(const sf_kernels_t *k, const char *in, size_t len, char *out, size_t *outLen) {
+    double best = 0;
+
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        sf_scan_state_t state = {0};
+        long long words = 0;
+        double start = now_sec();
+        *outLen = k->normalize_count(in, len, out, &state, &words);
+        double gbps = len / (now_sec() - start) / 1e9;
+        best = (gbps > best) ? gbps : best;
+    }
+    return best;
+}
+
+static double bench_reverse(const sf_kernels_t *k, const char *in, size_t len, char *out) {
+    double best = 0;
+
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        double start = now_sec();
+        k->reverse_bytes(in, len, out);
+        double gbps = len / (now_sec() - start) / 1e9;
+        best = (gbps > best) ? gbps : best;
+    }
+    return best;
+}
+
+int main(int argc, char *argv[]) {
+    size_t len = (size_t) ((argc > 1) ? atoi(argv[1]) : BENCH_DEFAULT_MB) << 20;
+    char *in = malloc(len);
+    char *out = malloc(len);
+    long long refWords = -1;
+    size_t refOutLen = 0;
+
+    if (in == NULL || out == NULL) {
+        fprintf(stderr, "cant allocate %zu byte corpus\n", len);
+        return 1;
+    }
+    make_corpus(in, len);
+
+    printf("%-8s %16s %16s %16s %12s\n", "KERNEL", "COUNT_GB/S", "NORMALIZE_GB/S", "REVERSE_GB/S", "WORDS");
+    for (size_t i = 0; i < sizeof(KERNEL_NAMES) / sizeof(KERNEL_NAMES[0]); i++) {
+        const sf_kernels_t *k = sf_kernels_by_name(KERNEL_NAMES[i]);
+        long long words;
+        size_t outLen;
+
+        if (k == NULL) {
+            printf("%-8s %16s\n", KERNEL_NAMES[i], "unsupported");
+            continue;
+        }
+
+        double countGbps = bench_count(k, in, len, &words);
+        double normGbps = bench_normalize(k, in, len, out, &outLen);
+        double revGbps = bench_reverse(k, in, len, out);
+        printf("%-8s %16.2f %16.2f %16.2f %12lld\n", k->name, countGbps, normGbps, revGbps, words);
+
+        // the reversed corpus read backwards is the corpus
+        for (size_t j = 0; j < len; j += 4093) {
+            if (out[j] != in[len - 1 - j]) {
+                fprintf(stderr, "%s reverse is wrong at %zu\n", k->name, j);
+                return 1;
+            }
+        }
+
+        // every kernel set has to agree with the first one
+        if (refWords < 0) {
+            refWords = words;
+            refOutLen = outLen;
+        } else if (words != refWords || outLen != refOutLen) {
+            fprintf(stderr, "%s disagrees: %lld words, %zu bytes\n", k->name, words, outLen);
+            return 1;
+        }
+    }
+
+    free(in);
+    free(out);
+    return 0;
+}
@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libstringfun.h"
+
+// Throughput of the libstringfun operations.  Every operation runs over
+// synthetic corpora of a few sizes and word length mixes, each repeated for
+// about BENCH_ROUND_SEC, and the best of BENCH_ROUNDS is reported in GB/s of
+// input.  One word in BENCH_NEEDLE_EVERY is the search target, so search and
+// replace has matches to build.
+//
+//   make bench                  corpora up to 64 MiB
+//   ./bench/sflibbench [MiB]    any other largest size
+
+#define BENCH_DEFAULT_MB    64
+#define BENCH_ROUNDS        3
+#define BENCH_ROUND_SEC     0.1
+#define BENCH_NEEDLE_EVERY  50
+
+#define NEEDLE      "needle"
+#define REPLACEMENT "haystack"
+#define SUBSTR      "ab"
+
+typedef struct corpus_kind {
+    const char *name;
+    int minWord;            // word lengths in characters
+    int maxWord;
+    int flags;              // SF_UTF8 for a corpus with multibyte characters
+} corpus_kind_t;
+
+static const corpus_kind_t KINDS[] = {
+    { "short", 1, 3, 0 },
+    { "mixed", 1, 12, 0 },
+    { "long", 8, 40, 0 },
+    { "utf8", 1, 12, SF_UTF8 },
+};
+
+// a letter of a UTF-8 corpus: ASCII, Latin-1 (2 bytes) or Greek (2) and CJK (3)
+static size_t utf8_letter(char *out, unsigned int *seed) {
+    int r = rand_r(seed) % 4;
+
+    if (r == 0) {
+        out[0] = 'a' + rand_r(seed) % 26;
+        return 1;
+    }
+    if (r < 3) {
+        unsigned cp = (r == 1) ? 0xe0 + rand_r(seed) % 31 : 0x3b1 + rand_r(seed) % 24;
+        out[0] = (char) (0xc0 | (cp >> 6));
+        out[1] = (char) (0x80 | (cp & 0x3f));
+        return 2;
+    }
+    unsigned cp = 0x4e00 + rand_r(seed) % 0x5000;
+    out[0] = (char) (0xe0 | (cp >> 12));
+    out[1] = (char) (0x80 | ((cp >> 6) & 0x3f));
+    out[2] = (char) (0x80 | (cp & 0x3f));
+    return 3;
+}
+
+// fills buff with words separated mostly by single spaces, returns the
+// length used, which stops short of len rather than cut a character
+static size_t make_corpus(const corpus_kind_t *kind, char *buff, size_t len) {
+    unsigned int seed = 42;
+    size_t i = 0;
+    long long words = 0;
+
+    while (i + 64 < len) {
+        if (++words % BENCH_NEEDLE_EVERY == 0) {
+            memcpy(buff + i, NEEDLE, strlen(NEEDLE));
+            i += strlen(NEEDLE);
+        } else {
+            int wordLen = kind->minWord + rand_r(&seed) % (kind->maxWord - kind->minWord + 1);
+            for (int j = 0; j < wordLen; j++) {
+                if (kind->flags & SF_UTF8) {
+                    i += utf8_letter(buff + i, &seed);
+                } else {
+                    buff[i++] = 'a' + rand_r(&seed) % 26;
+                }
+            }
+        }
+
+        int r = rand_r(&seed) % 100;
+        const char *sep = (r < 85) ? " " : (r < 95) ? "  \t" : "\n";
+        size_t sepLen = strlen(sep);
+        memcpy(buff + i, sep, sepLen);
+        i += sepLen;
+    }
+    return i;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+enum { OP_COUNT, OP_REVERSE, OP_WORD_PRINT, OP_REPLACE, OP_REPLACE_SUBSTR, NUM_OPS };
+
+static const char *OP_NAMES[] = { "COUNT", "REVERSE", "WORD_PRINT", "REPLACE", "REPLACE_SUB" };
+
+// one call of op, returns its result so the work can not be optimized away
+static long long run_op(int op, const char *in, size_t len, char *out, size_t outCap, int flags) {
+    switch (op) {
+        case OP_COUNT:
+            return sf_count_words(in, len, flags);
+        case OP_REVERSE:
+            return sf_reverse(in, len, out, flags);
+        case OP_WORD_PRINT:
+            return sf_word_print(in, len, out, outCap, flags);
+        case OP_REPLACE:
+            return sf_search_and_replace(in, len, NEEDLE, strlen(NEEDLE), REPLACEMENT, strlen(REPLACEMENT), -1,
+                                         out, outCap, 0, NULL);
+        default:
+            return sf_search_and_replace(in, len, SUBSTR, strlen(SUBSTR), "", 0, -1, out, outCap, SF_SUBSTR, NULL);
+    }
+}
+
+// best of BENCH_ROUNDS, in GB/s.  The first call sizes the rounds
+static double bench_op(int op, const char *in, size_t len, char *out, size_t outCap, int flags) {
+    double start = now_sec();
+    long long sink = run_op(op, in, len, out, outCap, flags);
+    double once = now_sec() - start;
+    size_t reps = (once >= BENCH_ROUND_SEC) ? 1 : (size_t) (BENCH_ROUND_SEC / (once + 1e-9)) + 1;
+    double best = len / once / 1e9;
+
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        start = now_sec();
+        for (size_t r = 0; r < reps; r++) {
+            sink += run_op(op, in, len, out, outCap, flags);
+        }
+        double gbps = (double) len * reps / (now_sec() - start) / 1e9;
+        best = (gbps > best) ? gbps : best;
+    }
+    return (sink < 0) ? -1 : best;
+}
+
+int main(int argc, char *argv[]) {
+    size_t maxLen = (size_t) ((argc > 1) ? atoi(argv[1]) : BENCH_DEFAULT_MB) << 20;
+    size_t sizes[] = { 64 << 10, 4 << 20, maxLen };
+    char *in = malloc(maxLen);
+
+    if (in == NULL) {
+        fprintf(stderr, "cant allocate %zu byte corpus\n", maxLen);
+        return 1;
+    }
+
+    printf("%-6s %10s", "CORPUS", "BYTES");
+    for (int op = 0; op < NUM_OPS; op++) {
+        printf(" %12s", OP_NAMES[op]);
+    }
+    printf("   (GB/s)\n");
+
+    for (size_t k = 0; k < sizeof(KINDS) / sizeof(KINDS[0]); k++) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            if (s > 0 && sizes[s] <= sizes[s - 1]) {
+                continue;
+            }
+
+            size_t len = make_corpus(&KINDS[k], in, sizes[s]);
+
+            // the word listing is the biggest output, size the buffer for it
+            long long listLen = sf_word_print(in, len, NULL, 0, KINDS[k].flags);
+            size_t outCap = ((size_t) listLen > 2 * len) ? (size_t) listLen : 2 * len;
+            char *out = malloc(outCap);
+            if (listLen < 0 || out == NULL) {
+                fprintf(stderr, "cant set up the %s corpus\n", KINDS[k].name);
+                return 1;
+            }
+
+            printf("%-6s %10zu", KINDS[k].name, len);
+            for (int op = 0; op < NUM_OPS; op++) {
+                printf(" %12.2f", bench_op(op, in, len, out, outCap, KINDS[k].flags));
+            }
+            printf("\n");
+            fflush(stdout);
+            free(out);
+        }
+    }
+
+    free(in);
+    return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef __LIBSTRINGFUN_H__
+    #define __LIBSTRINGFUN_H__
+
+#include <stddef.h>
+
+//libstringfun, the stringfun operations for other programs, see sflib.c.
+//Every function works on caller owned buffers with explicit lengths (in
+//never has to be NUL terminated and has no size limit), prints nothing and
+//keeps no state between calls.  Build with "make lib" and link
+//libstringfun.a with -pthread.  The library's internal functions are
+//global only where stringfun needs them, and those names start with sf_
+//as well, so it does not clash with the program it is linked into
+
+//flags
+#define SF_UTF8     0x1     //in is UTF-8: any Unicode white space separates
+                            //words, lengths are in characters and reversing
+                            //keeps each character's bytes in order
+#define SF_SUBSTR   0x2     //search and replace matches inside words too
+
+//number of words in in[0..len), or -1 if SF_UTF8 is set and in is not valid
+//UTF-8
+long long sf_count_words(const char *in, size_t len, int flags);
+
+//writes in[0..len) reversed to out, which has room for len bytes and must
+//not overlap in.  Returns len, or -1 if SF_UTF8 is set and in is not valid
+//UTF-8
+long long sf_reverse(const char *in, size_t len, char *out, int flags);
+
+//writes a "N. word (length)\n" line per word of in[0..len) to out.  Returns
+//the length of the whole listing, only the first outCap bytes of which are
+//written, or -1 if SF_UTF8 is set and in is not valid UTF-8
+long long sf_word_print(const char *in, size_t len, char *out, size_t outCap, int flags);
+
+//writes in[0..len) to out with up to maxMatches (-1 for all) whole word
+//occurrences of target, or any with SF_SUBSTR, replaced.  Sets *matches (if
+//not NULL) to how many were.  Returns the length of the whole result, only
+//the first outCap bytes of which are written, or -1 if target is empty
+long long sf_search_and_replace(const char *in, size_t len, const char *target, size_t targetLen,
+                                const char *replacement, size_t replacementLen, long long maxMatches,
+                                char *out, size_t outCap, int flags, long long *matches);
+
+#endif
@@ -0,0 +1,340 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "stringfun.h"
+
+// -f counts how often each word appears and prints the most frequent ones.
+// The words go into an open addressing hash table (linear probing, kept at
+// most 3/4 full) whose entries are small fixed size records: the word's hash,
+// where its bytes are and its count.  The bytes themselves are interned once
+// in an arena, a single growing block, so the table is one array with no
+// pointers to chase and a probe only looks at a word's bytes when the hashes
+// already agree.  The top K come out of a min-heap of K entries, which is
+// one pass over the table instead of a sort of all of it.
+
+#define FREQ_MIN_CAPACITY   1024
+#define FREQ_ARENA_MIN      (64 * 1024)
+
+// 64 bit hash of a word, a multiply and shift per 8 bytes
+static uint64_t hash_word(const char *word, size_t len) {
+    const uint64_t mul = 0x9e3779b97f4a7c15ull;
+    uint64_t h = len * mul;
+    size_t i = 0;
+
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        memcpy(&v, word + i, 8);
+        h = (h ^ v) * mul;
+        h ^= h >> 29;
+    }
+    if (i < len) {
+        uint64_t v = 0;
+        memcpy(&v, word + i, len - i);
+        h = (h ^ v) * mul;
+        h ^= h >> 29;
+    }
+    return h ^ (h >> 32);
+}
+
+int sf_freq_init(sf_freq_table_t *t) {
+    memset(t, 0, sizeof(*t));
+    t->capacity = FREQ_MIN_CAPACITY;
+    t->entry = calloc(t->capacity, sizeof(sf_freq_entry_t));
+    return (t->entry == NULL) ? -1 : 0;
+}
+
+void sf_freq_free(sf_freq_table_t *t) {
+    free(t->entry);
+    free(t->arena);
+    memset(t, 0, sizeof(*t));
+}
+
+// doubles the table, the entries keep their hashes so nothing is rehashed
+static int freq_grow(sf_freq_table_t *t) {
+    size_t capacity = t->capacity * 2;
+    sf_freq_entry_t *entry = calloc(capacity, sizeof(sf_freq_entry_t));
+
+    if (entry == NULL) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < t->capacity; i++) {
+        if (t->entry[i].count == 0) {
+            continue;
+        }
+        size_t idx = t->entry[i].hash & (capacity - 1);
+        while (entry[idx].count != 0) {
+            idx = (idx + 1) & (capacity - 1);
+        }
+        entry[idx] = t->entry[i];
+    }
+
+    free(t->entry);
+    t->entry = entry;
+    t->capacity = capacity;
+    return 0;
+}
+
+// copies a word into the arena, returns its offset or -1 if out of memory
+static long long arena_intern(sf_freq_table_t *t, const char *word, size_t len) {
+    if (t->arenaLen + len > t->arenaCap) {
+        size_t cap = (t->arenaCap == 0) ? FREQ_ARENA_MIN : t->arenaCap;
+        while (t->arenaLen + len > cap) {
+            cap *= 2;
+        }
+        char *arena = realloc(t->arena, cap);
+        if (arena == NULL) {
+            return -1;
+        }
+        t->arena = arena;
+        t->arenaCap = cap;
+    }
+
+    memcpy(t->arena + t->arenaLen, word, len);
+    t->arenaLen += len;
+    return (long long) (t->arenaLen - len);
+}
+
+// adds count to a word, returns 0 or -1 if out of memory
+static int freq_add(sf_freq_table_t *t, const char *word, size_t len, uint64_t hash, long long count) {
+    if ((t->used + 1) * 4 > t->capacity * 3 && freq_grow(t) < 0) {
+        return -1;
+    }
+
+    size_t mask = t->capacity - 1;
+    size_t idx = hash & mask;
+
+    while (t->entry[idx].count != 0) {
+        sf_freq_entry_t *e = &t->entry[idx];
+        if (e->hash == hash && e->len == len && memcmp(t->arena + e->off, word, len) == 0) {
+            e->count += count;
+            return 0;
+        }
+        idx = (idx + 1) & mask;
+    }
+
+    long long off = arena_intern(t, word, len);
+    if (off < 0) {
+        return -1;
+    }
+
+    t->entry[idx].hash = hash;
+    t->entry[idx].off = (size_t) off;
+    t->entry[idx].len = len;
+    t->entry[idx].count = count;
+    t->used++;
+    return 0;
+}
+
+/*
+ *  sf_freq_add_words
+ *      t:        table to count into
+ *      in, len:  text, both of its edges are taken to be word boundaries
+ *
+ *  returns:  0, or -1 if out of memory
+ */
+int sf_freq_add_words(sf_freq_table_t *t, const char *in, size_t len) {
+    size_t i = 0;
+
+    while (i < len) {
+        while (i < len && is_word_sep(in[i])) {
+            i++;
+        }
+        size_t wordStart = i;
+        while (i < len && !is_word_sep(in[i])) {
+            i++;
+        }
+        if (i > wordStart) {
+            size_t wordLen = i - wordStart;
+            if (freq_add(t, in + wordStart, wordLen, hash_word(in + wordStart, wordLen), 1) < 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// adds every count in src to dst, returns 0 or -1 if out of memory
+int sf_freq_merge(sf_freq_table_t *dst, const sf_freq_table_t *src) {
+    for (size_t i = 0; i < src->capacity; i++) {
+        const sf_freq_entry_t *e = &src->entry[i];
+        if (e->count != 0 && freq_add(dst, src->arena + e->off, e->len, e->hash, e->count) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// does a come before b in the output: more frequent first, then by bytes
+static int freq_before(const sf_freq_table_t *t, const sf_freq_entry_t *a, const sf_freq_entry_t *b) {
+    if (a->count != b->count) {
+        return a->count > b->count;
+    }
+
+    size_t n = (a->len < b->len) ? a->len : b->len;
+    int cmp = memcmp(t->arena + a->off, t->arena + b->off, n);
+    return (cmp != 0) ? cmp < 0 : a->len < b->len;
+}
+
+// restores the heap below i, heap[0] is the entry that comes last
+static void heap_sift_down(const sf_freq_table_t *t, const sf_freq_entry_t **heap, size_t n, size_t i) {
+    for (;;) {
+        size_t last = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+
+        if (left < n && freq_before(t, heap[last], heap[left])) {
+            last = left;
+        }
+        if (right < n && freq_before(t, heap[last], heap[right])) {
+            last = right;
+        }
+        if (last == i) {
+            return;
+        }
+
+        const sf_freq_entry_t *tmp = heap[i];
+        heap[i] = heap[last];
+        heap[last] = tmp;
+        i = last;
+    }
+}
+
+/*
+ *  freq_top
+ *      t:    counted table
+ *      k:    how many to pick
+ *      top:  receives up to k entries, most frequent first, must have room
+ *            for k
+ *
+ *  returns:  the number of entries in top
+ */
+static size_t freq_top(const sf_freq_table_t *t, size_t k, const sf_freq_entry_t **top) {
+    size_t n = 0;
+
+    if (k == 0) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < t->capacity; i++) {
+        const sf_freq_entry_t *e = &t->entry[i];
+        if (e->count == 0) {
+            continue;
+        }
+
+        if (n < k) {
+            // sift the new entry up
+            size_t j = n++;
+            top[j] = e;
+            while (j > 0 && freq_before(t, top[(j - 1) / 2], top[j])) {
+                const sf_freq_entry_t *tmp = top[j];
+                top[j] = top[(j - 1) / 2];
+                top[(j - 1) / 2] = tmp;
+                j = (j - 1) / 2;
+            }
+        } else if (freq_before(t, e, top[0])) {
+            top[0] = e;
+            heap_sift_down(t, top, n, 0);
+        }
+    }
+
+    // heap sort in place, taking the last entry off the heap each time
+    for (size_t end = n; end > 1; end--) {
+        const sf_freq_entry_t *tmp = top[0];
+        top[0] = top[end - 1];
+        top[end - 1] = tmp;
+        heap_sift_down(t, top, end - 1, 0);
+    }
+    return n;
+}
+
+// prints the k most frequent words of t, returns 0 or -1 if out of memory or
+// the output could not be written
+int sf_freq_print_top(const sf_freq_table_t *t, long long k) {
+    size_t want = ((size_t) k < t->used) ? (size_t) k : t->used;
+    const sf_freq_entry_t **top = malloc((want + 1) * sizeof(*top));
+
+    if (top == NULL) {
+        return -1;
+    }
+
+    size_t n = freq_top(t, want, top);
+
+    sf_out_t *out = sf_out_stdout();
+    sf_out_str(out, "Word Frequency\n--------------\n");
+    for (size_t i = 0; i < n; i++) {
+        sf_out_ll(out, (long long) i + 1);
+        sf_out_write(out, ". ", 2);
+        sf_out_write(out, t->arena + top[i]->off, top[i]->len);
+        sf_out_write(out, " (", 2);
+        sf_out_ll(out, top[i]->count);
+        sf_out_write(out, ")\n", 2);
+    }
+
+    free(top);
+    return sf_out_flush(out);
+}
+
+// counts the words of a file or stdin a chunk at a time.  The word still open
+// at the end of a chunk is moved to the front of the buffer for the next
+// read, and the buffer grows if a single word fills it
+int sf_stream_word_freq(int fd, long long k) {
+    sf_freq_table_t table;
+    size_t cap = STREAM_CHUNK_SZ;
+    char *buff = malloc(cap);
+    size_t carry = 0;
+    ssize_t got = 0;
+    int rc = 0;
+
+    if (buff == NULL || sf_freq_init(&table) < 0) {
+        free(buff);
+        return -1;
+    }
+
+    do {
+        if (carry == cap) {
+            char *grown = realloc(buff, cap * 2);
+            if (grown == NULL) {
+                rc = -1;
+                break;
+            }
+            buff = grown;
+            cap *= 2;
+        }
+
+        got = sf_read_chunk(fd, buff + carry, cap - carry);
+        if (got < 0) {
+            perror("read");
+            rc = -1;
+            break;
+        }
+
+        size_t len = carry + got;
+        size_t done = len;
+
+        // hold back the last word unless the input ended
+        if (got > 0) {
+            while (done > 0 && !is_word_sep(buff[done - 1])) {
+                done--;
+            }
+        }
+
+        if (sf_freq_add_words(&table, buff, done) < 0) {
+            rc = -1;
+            break;
+        }
+
+        carry = len - done;
+        memmove(buff, buff + done, carry);
+    } while (got > 0);
+
+    if (rc == 0) {
+        rc = sf_freq_print_top(&table, k);
+    }
+
+    free(buff);
+    sf_freq_free(&table);
+    return rc;
+}
@@ -0,0 +1,496 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "stringfun.h"
+
+// --in-place runs -x over many files at once.  The files to do are listed
+// up front (walking any -R directories) and cut into tasks, runs of files
+// next to each other in the list that add up to a batch, so a tree of small
+// files costs one hand-off per batch instead of one per file.
+//
+// The tasks are shared out with work stealing.  Every worker starts with an
+// even, contiguous share of them, which it works through from the front.  A
+// worker that runs out takes the back half of the first other worker's
+// share that still has any, so whoever drew the big files does not hold up
+// the rest.  A share is just a [head, tail) range of the task array under
+// its own lock, and no worker ever holds two locks at once.
+//
+// A file with no match is left alone.  One with a match is written to a
+// temp file next to it, which is synced and then renamed over it, so a
+// reader sees either the old file or the new one, never part of it.  The
+// rename gives the path a new inode: hard links to the old one keep the old
+// text.
+
+#define FILE_LIST_MIN   256
+#define NAMES_MIN       (16 * 1024)
+
+// adds a path to the list with what stat() said about it, returns 0 or -1
+// if out of memory
+static int list_push(sf_file_list_t *list, const char *path, const struct stat *st) {
+    size_t pathLen = strlen(path) + 1;
+
+    if (list->count == list->capacity) {
+        size_t capacity = (list->capacity == 0) ? FILE_LIST_MIN : list->capacity * 2;
+        sf_file_t *grown = realloc(list->file, capacity * sizeof(sf_file_t));
+        if (grown == NULL) {
+            return -1;
+        }
+        list->file = grown;
+        list->capacity = capacity;
+    }
+
+    if (list->namesLen + pathLen > list->namesCap) {
+        size_t cap = (list->namesCap == 0) ? NAMES_MIN : list->namesCap;
+        while (list->namesLen + pathLen > cap) {
+            cap *= 2;
+        }
+        char *names = realloc(list->names, cap);
+        if (names == NULL) {
+            return -1;
+        }
+        list->names = names;
+        list->namesCap = cap;
+    }
+
+    sf_file_t *f = &list->file[list->count++];
+    f->off = list->namesLen;
+    f->size = (size_t) st->st_size;
+    f->dev = st->st_dev;
+    f->ino = st->st_ino;
+    f->skip = false;
+
+    memcpy(list->names + list->namesLen, path, pathLen);
+    list->namesLen += pathLen;
+    return 0;
+}
+
+// adds a file named on the command line.  A symlink is replaced through, so
+// its target is what gets listed.  Returns 0 or -1 (after printing why)
+int sf_file_list_add(sf_file_list_t *list, const char *path) {
+    struct stat st;
+    char *target = NULL;
+    int rc = 0;
+
+    // a dangling link leaves target NULL, and stat() below says why
+    if (lstat(path, &st) == 0 && S_ISLNK(st.st_mode)) {
+        target = realpath(path, NULL);
+    }
+
+    if (stat((target != NULL) ? target : path, &st) < 0) {
+        perror(path);
+        rc = -1;
+    } else if (!S_ISREG(st.st_mode)) {
+        fprintf(stderr, "%s: not a regular file\n", path);
+        rc = -1;
+    } else if (list_push(list, (target != NULL) ? target : path, &st) < 0) {
+        perror(path);
+        rc = -1;
+    }
+
+    free(target);
+    return rc;
+}
+
+// adds every regular file under dir, symlinks are not followed.  Returns 0,
+// or -1 if anything could not be read (the rest is still listed)
+int sf_file_list_add_dir(sf_file_list_t *list, const char *dir) {
+    DIR *d = opendir(dir);
+    struct dirent *entry;
+    int rc = 0;
+
+    if (d == NULL) {
+        perror(dir);
+        return -1;
+    }
+
+    while ((entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        char path[PATH_MAX];
+        struct stat st;
+        if (snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name) >= (int) sizeof(path)) {
+            fprintf(stderr, "%s/%s: path too long\n", dir, entry->d_name);
+            rc = -1;
+            continue;
+        }
+        if (fstatat(dirfd(d), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+            perror(path);
+            rc = -1;
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode)) {
+            if (sf_file_list_add_dir(list, path) < 0) {
+                rc = -1;
+            }
+        } else if (S_ISREG(st.st_mode) && list_push(list, path, &st) < 0) {
+            perror(path);
+            rc = -1;
+        }
+    }
+
+    closedir(d);
+    return rc;
+}
+
+void sf_file_list_free(sf_file_list_t *list) {
+    free(list->file);
+    free(list->names);
+    memset(list, 0, sizeof(*list));
+}
+
+static int by_inode(const void *a, const void *b) {
+    const sf_file_t *fa = *(const sf_file_t * const *) a;
+    const sf_file_t *fb = *(const sf_file_t * const *) b;
+
+    if (fa->dev != fb->dev) {
+        return (fa->dev < fb->dev) ? -1 : 1;
+    }
+    if (fa->ino != fb->ino) {
+        return (fa->ino < fb->ino) ? -1 : 1;
+    }
+    return (fa < fb) ? -1 : (fa > fb);
+}
+
+// marks every listing of a file after its first to be skipped, two workers
+// rewriting the same file would replace its matches twice.  Returns 0 or -1
+// if out of memory
+static int skip_duplicates(sf_file_list_t *list) {
+    sf_file_t **order = malloc(list->count * sizeof(*order));
+
+    if (order == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < list->count; i++) {
+        order[i] = &list->file[i];
+    }
+
+    qsort(order, list->count, sizeof(*order), by_inode);
+    for (size_t i = 1; i < list->count; i++) {
+        order[i]->skip = order[i]->dev == order[i - 1]->dev && order[i]->ino == order[i - 1]->ino;
+    }
+
+    free(order);
+    return 0;
+}
+
+// a run of files done by one worker in one go
+typedef struct inplace_task {
+    size_t first;
+    size_t end;
+} inplace_task_t;
+
+typedef struct inplace_pool inplace_pool_t;
+
+typedef struct inplace_worker {
+    pthread_mutex_t lock;   // guards head and tail
+    size_t head;            // the worker's share of the tasks, [head, tail)
+    size_t tail;
+    inplace_pool_t *pool;
+    int id;
+    char *readBuff;         // INPLACE_MMAP_MIN bytes for small files
+    char *outBuff;          // SF_OUT_SZ bytes for the output sink
+    sf_inplace_stats_t stats;
+} inplace_worker_t;
+
+struct inplace_pool {
+    const sf_file_list_t *list;
+    const inplace_task_t *task;
+    const sf_searcher_t *searcher;
+    const char *replacement;
+    size_t replacementLen;
+    inplace_worker_t *worker;
+    int numWorkers;
+};
+
+// cuts the list into tasks of whole files, returns how many
+static size_t make_tasks(const sf_file_list_t *list, inplace_task_t *task) {
+    size_t numTasks = 0;
+    size_t i = 0;
+
+    while (i < list->count) {
+        size_t first = i;
+        size_t bytes = 0;
+
+        while (i < list->count && i - first < INPLACE_BATCH_FILES && bytes < INPLACE_BATCH_SZ) {
+            bytes += list->file[i++].size;
+        }
+        task[numTasks].first = first;
+        task[numTasks].end = i;
+        numTasks++;
+    }
+    return numTasks;
+}
+
+// next task from the front of the worker's own share
+static bool take_own(inplace_worker_t *w, size_t *task) {
+    bool found = false;
+
+    pthread_mutex_lock(&w->lock);
+    if (w->head < w->tail) {
+        *task = w->head++;
+        found = true;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return found;
+}
+
+// takes the back half of another worker's share, keeping its first task to
+// run now and the rest as the new share of its own
+static bool steal(inplace_worker_t *w, size_t *task) {
+    inplace_pool_t *pool = w->pool;
+
+    for (int n = 1; n < pool->numWorkers; n++) {
+        inplace_worker_t *victim = &pool->worker[(w->id + n) % pool->numWorkers];
+        size_t first = 0;
+        size_t end = 0;
+
+        pthread_mutex_lock(&victim->lock);
+        if (victim->head < victim->tail) {
+            size_t take = (victim->tail - victim->head + 1) / 2;
+            first = victim->tail - take;
+            end = victim->tail;
+            victim->tail = first;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (first < end) {
+            pthread_mutex_lock(&w->lock);
+            w->head = first + 1;
+            w->tail = end;
+            pthread_mutex_unlock(&w->lock);
+            *task = first;
+            return true;
+        }
+    }
+    return false;
+}
+
+// reads all of a small file into buff, returns its length or -1
+static ssize_t read_small(int fd, char *buff, size_t size) {
+    size_t len = 0;
+
+    while (len < size) {
+        ssize_t got = sf_read_chunk(fd, buff + len, size - len);
+        if (got < 0) {
+            return -1;
+        }
+        if (got == 0) {
+            break;
+        }
+        len += got;
+    }
+    return (ssize_t) len;
+}
+
+// writes in[0..len) with its matches replaced to a temp file next to path and
+// renames it over path.  Returns the matches replaced, or -1 (after printing
+// why, with nothing changed) on error
+static long long rewrite_file(inplace_worker_t *w, const char *path, const struct stat *st, const char *in,
+                              size_t len) {
+    const inplace_pool_t *pool = w->pool;
+    char tmpPath[PATH_MAX];
+    const char *slash = strrchr(path, '/');
+    int dirLen = (slash == NULL) ? 0 : (int) (slash - path + 1);
+
+    if (snprintf(tmpPath, sizeof(tmpPath), "%.*s.%s.sfXXXXXX", dirLen, path, path + dirLen) >=
+        (int) sizeof(tmpPath)) {
+        fprintf(stderr, "%s: path too long\n", path);
+        return -1;
+    }
+
+    int tmpFd = mkstemp(tmpPath);
+    if (tmpFd < 0) {
+        perror(path);
+        return -1;
+    }
+
+    // the new file gets the old one's owner when we are allowed to give it
+    // away, then its permissions.  A chown can clear setuid and setgid, so
+    // the mode has to come second
+    if (fchown(tmpFd, st->st_uid, st->st_gid) < 0 && errno != EPERM) {
+        perror(path);
+    }
+    fchmod(tmpFd, st->st_mode & 07777);
+
+    sf_out_t out;
+    sf_out_init(&out, tmpFd, w->outBuff, SF_OUT_SZ);
+    long long matches = sf_replace_out(pool->searcher, in, len, pool->replacement, pool->replacementLen, &out);
+
+    int ok = sf_out_flush(&out) == 0 && fsync(tmpFd) == 0;
+    if (close(tmpFd) < 0) {
+        ok = 0;
+    }
+    if (!ok || rename(tmpPath, path) < 0) {
+        perror(path);
+        unlink(tmpPath);
+        return -1;
+    }
+    return matches;
+}
+
+// -x on one file, adding what happened to the worker's stats
+static void replace_file(inplace_worker_t *w, const char *path) {
+    const inplace_pool_t *pool = w->pool;
+    struct stat st;
+    const char *in = NULL;
+    bool mapped = false;
+    ssize_t len = 0;
+    int fd = open(path, O_RDONLY);
+
+    w->stats.files++;
+
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        w->stats.failed++;
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+
+    if (st.st_size >= INPLACE_MMAP_MIN) {
+        len = st.st_size;
+        in = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (in == MAP_FAILED) {
+            in = NULL;
+            len = -1;
+        } else {
+            madvise((void *) in, len, MADV_SEQUENTIAL);
+            mapped = true;
+        }
+    } else if (st.st_size > 0) {
+        in = w->readBuff;
+        len = read_small(fd, w->readBuff, st.st_size);
+    }
+    close(fd);
+
+    if (len < 0) {
+        perror(path);
+        w->stats.failed++;
+        return;
+    }
+
+    // most files in a tree have nothing to replace and are not touched
+    if (len > 0 && sf_search(pool->searcher, in, len, 0, true, true) != NULL) {
+        long long matches = rewrite_file(w, path, &st, in, len);
+        if (matches < 0) {
+            w->stats.failed++;
+        } else {
+            w->stats.changed++;
+            w->stats.matches += matches;
+        }
+    }
+
+    if (mapped) {
+        munmap((void *) in, len);
+    }
+}
+
+static void *inplace_worker(void *arg) {
+    inplace_worker_t *w = (inplace_worker_t *) arg;
+    const inplace_pool_t *pool = w->pool;
+    size_t task;
+
+    while (take_own(w, &task) || steal(w, &task)) {
+        for (size_t i = pool->task[task].first; i < pool->task[task].end; i++) {
+            const sf_file_t *f = &pool->list->file[i];
+            if (!f->skip) {
+                replace_file(w, pool->list->names + f->off);
+            }
+        }
+    }
+    return NULL;
+}
+
+/*
+ *  sf_inplace_replace
+ *      list:         files to rewrite, a file listed twice is done once
+ *      jobs:         number of threads to use, 1 to MAX_JOBS
+ *      s:            searcher for the target
+ *      replacement:  what each match becomes
+ *      stats:        receives what was done
+ *
+ *  returns:  0, or -1 if any file could not be rewritten (stats->failed says
+ *            how many, each was reported and left as it was) or the workers
+ *            could not be set up
+ */
+int sf_inplace_replace(sf_file_list_t *list, int jobs, const sf_searcher_t *s, const char *replacement,
+                       size_t replacementLen, sf_inplace_stats_t *stats) {
+    inplace_task_t *task = malloc((list->count + 1) * sizeof(inplace_task_t));
+    inplace_worker_t worker[MAX_JOBS];
+    pthread_t tid[MAX_JOBS];
+    int started = 0;
+    int rc = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    if (task == NULL || skip_duplicates(list) < 0) {
+        free(task);
+        return -1;
+    }
+
+    size_t numTasks = make_tasks(list, task);
+    if ((size_t) jobs > numTasks) {
+        jobs = (numTasks == 0) ? 1 : (int) numTasks;
+    }
+
+    inplace_pool_t pool = { list, task, s, replacement, replacementLen, worker, jobs };
+
+    // pick the kernels before any thread asks for them
+    sf_kernels();
+
+    for (int i = 0; i < jobs; i++) {
+        inplace_worker_t *w = &worker[i];
+        pthread_mutex_init(&w->lock, NULL);
+        w->head = numTasks * i / jobs;
+        w->tail = numTasks * (i + 1) / jobs;
+        w->pool = &pool;
+        w->id = i;
+        w->readBuff = malloc(INPLACE_MMAP_MIN);
+        w->outBuff = malloc(SF_OUT_SZ);
+        memset(&w->stats, 0, sizeof(w->stats));
+        if (w->readBuff == NULL || w->outBuff == NULL) {
+            rc = -1;
+        }
+    }
+
+    // the first worker runs on this thread, once the others are going.  If a
+    // thread can not be started the ones that are steal its share
+    for (int i = 1; rc == 0 && i < jobs; i++) {
+        if (pthread_create(&tid[i], NULL, inplace_worker, &worker[i]) != 0) {
+            perror("pthread_create");
+            break;
+        }
+        started++;
+    }
+    if (rc == 0) {
+        inplace_worker(&worker[0]);
+    }
+    for (int i = 1; i <= started; i++) {
+        pthread_join(tid[i], NULL);
+    }
+
+    for (int i = 0; i < jobs; i++) {
+        stats->files += worker[i].stats.files;
+        stats->changed += worker[i].stats.changed;
+        stats->matches += worker[i].stats.matches;
+        stats->failed += worker[i].stats.failed;
+        free(worker[i].readBuff);
+        free(worker[i].outBuff);
+        pthread_mutex_destroy(&worker[i].lock);
+    }
+
+    free(task);
+    return (rc < 0 || stats->failed > 0) ? -1 : 0;
+}
@@ -0,0 +1,71 @@
+#include "stringfun.h"
+
+// The library entry points, see libstringfun.h.  Each one is a thin wrapper
+// over the same kernels and helpers the command line uses, with the input
+// checked up front and output going into the caller's buffer rather than
+// stdout: word printing writes to a memory sink, which drops what does not
+// fit but keeps counting it.
+
+// with SF_UTF8 set in has to be valid UTF-8
+static int check_input(const char *in, size_t len, int flags) {
+    if ((flags & SF_UTF8) && !sf_kernels()->utf8_valid(in, len)) {
+        return -1;
+    }
+    return 0;
+}
+
+long long sf_count_words(const char *in, size_t len, int flags) {
+    sf_scan_state_t state = {0};
+
+    if (check_input(in, len, flags) < 0) {
+        return -1;
+    }
+    if (flags & SF_UTF8) {
+        return sf_utf8_count_words(in, len, &state);
+    }
+    return sf_kernels()->count_words(in, len, &state);
+}
+
+long long sf_reverse(const char *in, size_t len, char *out, int flags) {
+    if (check_input(in, len, flags) < 0) {
+        return -1;
+    }
+    if (flags & SF_UTF8) {
+        sf_utf8_reverse(in, len, out);
+    } else {
+        sf_kernels()->reverse_bytes(in, len, out);
+    }
+    return (long long) len;
+}
+
+long long sf_word_print(const char *in, size_t len, char *out, size_t outCap, int flags) {
+    sf_out_t sink;
+    sf_word_print_t st = {0};
+
+    if (check_input(in, len, flags) < 0) {
+        return -1;
+    }
+
+    sf_out_init_mem(&sink, out, outCap);
+    if (flags & SF_UTF8) {
+        sf_utf8_print_words(&sink, in, len, &st);
+    } else {
+        sf_byte_print_words(&sink, in, len, &st);
+    }
+    sf_utf8_print_words_end(&sink, &st);
+    return (long long) sf_out_mem_len(&sink);
+}
+
+long long sf_search_and_replace(const char *in, size_t len, const char *target, size_t targetLen,
+                                const char *replacement, size_t replacementLen, long long maxMatches,
+                                char *out, size_t outCap, int flags, long long *matches) {
+    sf_searcher_t searcher;
+
+    if (targetLen == 0) {
+        return -1;
+    }
+
+    sf_searcher_init(&searcher, target, targetLen, (flags & SF_SUBSTR) ? SF_MATCH_SUBSTR : SF_MATCH_WORD);
+    return (long long) sf_replace(&searcher, in, len, replacement, replacementLen, maxMatches, out, outCap,
+                                  matches);
+}
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "stringfun.h"
+
+// Output sink.  Bytes are gathered in a buffer and handed to write() when it
+// fills up or is flushed, so printing a word costs a memcpy rather than a
+// stdio call per character.  A span at least as big as the buffer skips it
+// and is written straight from the caller's memory, and a sink set up
+// without a buffer writes everything directly.  A sink on stdout shares the
+// fd with stdio, so stdout is flushed before the sink writes anything: output
+// printed with printf() before a sink call still comes out first.
+//
+// A sink made by sf_out_init_mem() has no fd and fills a caller's buffer
+// instead.  What does not fit is dropped but still counted, so sf_out_mem_len()
+// says how big the buffer would have had to be.
+
+// write() all of it, retrying partial and interrupted writes
+static int write_all(int fd, const char *buff, size_t len) {
+    while (len > 0) {
+        ssize_t put = write(fd, buff, len);
+        if (put < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buff += put;
+        len -= put;
+    }
+    return 0;
+}
+
+// gets what printf() has buffered out ahead of the sink's bytes
+static void flush_stdio(const sf_out_t *out) {
+    if (out->fd == STDOUT_FILENO) {
+        fflush(stdout);
+    }
+}
+
+// sets up a sink on fd, cap 0 (or a NULL buffer) writes everything directly
+void sf_out_init(sf_out_t *out, int fd, char *buff, size_t cap) {
+    out->fd = fd;
+    out->buff = buff;
+    out->len = 0;
+    out->cap = (buff == NULL) ? 0 : cap;
+    out->err = 0;
+    out->over = 0;
+}
+
+// sets up a sink that writes into buff[0..cap) and never flushes
+void sf_out_init_mem(sf_out_t *out, char *buff, size_t cap) {
+    sf_out_init(out, -1, buff, cap);
+}
+
+// everything written to a memory sink, including what did not fit
+size_t sf_out_mem_len(const sf_out_t *out) {
+    return out->len + out->over;
+}
+
+// the shared sink for stdout
+sf_out_t *sf_out_stdout(void) {
+    static char buff[SF_OUT_SZ];
+    static sf_out_t out;
+
+    if (out.buff == NULL) {
+        sf_out_init(&out, STDOUT_FILENO, buff, sizeof(buff));
+    }
+    return &out;
+}
+
+// writes out what is buffered, returns 0 or -1 if a write has failed
+int sf_out_flush(sf_out_t *out) {
+    if (out->fd < 0) {
+        return 0;
+    }
+    if (out->len > 0 && !out->err) {
+        flush_stdio(out);
+        if (write_all(out->fd, out->buff, out->len) < 0) {
+            perror("write");
+            out->err = 1;
+        }
+    }
+    out->len = 0;
+    return out->err ? -1 : 0;
+}
+
+// sf_out_write() when the buffer has no room for len more bytes
+void sf_out_write_slow(sf_out_t *out, const char *src, size_t len) {
+    if (out->fd < 0) {
+        size_t room = out->cap - out->len;
+        if (room > 0) {
+            memcpy(out->buff + out->len, src, room);
+        }
+        out->len = out->cap;
+        out->over += len - room;
+        return;
+    }
+    sf_out_flush(out);
+    if (len < out->cap) {
+        memcpy(out->buff, src, len);
+        out->len = len;
+    } else if (!out->err) {
+        flush_stdio(out);
+        if (write_all(out->fd, src, len) < 0) {
+            perror("write");
+            out->err = 1;
+        }
+    }
+}
+
+void sf_out_str(sf_out_t *out, const char *s) {
+    sf_out_write(out, s, strlen(s));
+}
+
+// writes n in decimal, filling a small buffer from its last digits back two
+// at a time
+void sf_out_ll(sf_out_t *out, long long n) {
+    static const char pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char digits[24];
+    char *p = digits + sizeof(digits);
+    unsigned long long v = (n < 0) ? 0ull - (unsigned long long) n : (unsigned long long) n;
+
+    while (v >= 100) {
+        p -= 2;
+        memcpy(p, pairs + (v % 100) * 2, 2);
+        v /= 100;
+    }
+    if (v >= 10) {
+        p -= 2;
+        memcpy(p, pairs + v * 2, 2);
+    } else {
+        *--p = (char) ('0' + v);
+    }
+
+    if (n < 0) {
+        *--p = '-';
+    }
+    sf_out_write(out, p, digits + sizeof(digits) - p);
+}
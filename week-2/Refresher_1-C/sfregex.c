@@ -0,0 +1,804 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stringfun.h"
+
+// -e finds the lines that match a regular expression.  The pattern is parsed
+// into a tree, compiled to a Thompson NFA (a small program of byte set,
+// split and assertion instructions) and run as a DFA that is built lazily:
+// a DFA state is the set of NFA instructions alive at a point in the line,
+// and a transition is worked out the first time some line needs it and
+// cached in a table after that.  Every byte then costs one table lookup
+// however complicated the pattern, and the time to scan a line is linear in
+// its length, with no backtracking.
+//
+// The cache has a fixed size.  When it fills up it is thrown away and built
+// again from the state the scan is in, so memory stays bounded however many
+// states the input visits.
+//
+// Before the DFA runs, a byte every match has to contain (picked to be a rare
+// one) is looked for with memchr(), and lines without it are skipped without
+// being scanned.
+//
+// Syntax: literals, ".", classes ("[a-z_]", "[^0-9]"), the escapes \d \w \s
+// (and \D \W \S), "|", "( )", "*", "+", "?", and the anchors "^" and "$"
+// for the start and end of the line.  Patterns work on bytes, a multibyte
+// UTF-8 character is a sequence of literals.
+
+#define RE_MAX_STATES   2048
+#define RE_ARENA_MIN    (64 * 1024)     // ints for the cached states' sets
+
+typedef enum { NODE_EMPTY, NODE_SET, NODE_CAT, NODE_ALT, NODE_STAR, NODE_PLUS, NODE_QUEST, NODE_BOL,
+               NODE_EOL } re_node_kind_t;
+
+typedef struct re_node {
+    re_node_kind_t kind;
+    int left;               // child, or the byte set of a NODE_SET
+    int right;
+} re_node_t;
+
+typedef struct re_parser {
+    const char *pattern;
+    size_t pos;
+    re_node_t *node;
+    int numNodes;
+    int capacity;
+    sf_regex_t *re;         // gets the byte sets
+    const char *error;
+} re_parser_t;
+
+static int new_node(re_parser_t *p, re_node_kind_t kind, int left, int right) {
+    if (p->numNodes == p->capacity) {
+        int capacity = (p->capacity == 0) ? 64 : p->capacity * 2;
+        re_node_t *grown = realloc(p->node, capacity * sizeof(re_node_t));
+        if (grown == NULL) {
+            p->error = "out of memory";
+            return -1;
+        }
+        p->node = grown;
+        p->capacity = capacity;
+    }
+    p->node[p->numNodes] = (re_node_t) { kind, left, right };
+    return p->numNodes++;
+}
+
+// adds an empty byte set, returns its index or -1
+static int new_set(re_parser_t *p) {
+    sf_regex_t *re = p->re;
+
+    if (re->numSets % 64 == 0) {
+        uint64_t (*grown)[4] = realloc(re->set, (re->numSets + 64) * sizeof(*re->set));
+        if (grown == NULL) {
+            p->error = "out of memory";
+            return -1;
+        }
+        re->set = grown;
+    }
+    memset(re->set[re->numSets], 0, sizeof(*re->set));
+    return re->numSets++;
+}
+
+static inline void set_add(uint64_t *set, unsigned char c) {
+    set[c >> 6] |= 1ull << (c & 63);
+}
+
+static inline bool set_has(const uint64_t *set, unsigned char c) {
+    return (set[c >> 6] >> (c & 63)) & 1;
+}
+
+static void set_add_range(uint64_t *set, int lo, int hi) {
+    for (int c = lo; c <= hi; c++) {
+        set_add(set, (unsigned char) c);
+    }
+}
+
+// \d \w \s into set, negated by their capitals.  Returns false if c is not
+// one of them
+static bool add_escape_class(uint64_t *set, char c) {
+    uint64_t class[4] = {0};
+
+    switch (c | 0x20) {
+        case 'd':
+            set_add_range(class, '0', '9');
+            break;
+        case 'w':
+            set_add_range(class, '0', '9');
+            set_add_range(class, 'A', 'Z');
+            set_add_range(class, 'a', 'z');
+            set_add(class, '_');
+            break;
+        case 's':
+            for (int b = 0; b < 256; b++) {
+                if (is_word_sep((char) b)) {
+                    set_add(class, (unsigned char) b);
+                }
+            }
+            break;
+        default:
+            return false;
+    }
+
+    bool negate = (c >= 'A' && c <= 'Z');
+    for (int i = 0; i < 4; i++) {
+        set[i] |= negate ? ~class[i] : class[i];
+    }
+    return true;
+}
+
+// the byte an escape other than a class stands for
+static unsigned char escape_byte(char c) {
+    switch (c) {
+        case 't':
+            return '\t';
+        case 'n':
+            return '\n';
+        case 'r':
+            return '\r';
+        default:
+            return (unsigned char) c;
+    }
+}
+
+static int parse_alt(re_parser_t *p);
+
+// "[...]", p->pos is just past the '['
+static int parse_class(re_parser_t *p) {
+    const char *s = p->pattern;
+    int setIdx = new_set(p);
+    bool negate = false;
+    bool first = true;
+
+    if (setIdx < 0) {
+        return -1;
+    }
+    uint64_t *set = p->re->set[setIdx];
+
+    if (s[p->pos] == '^') {
+        negate = true;
+        p->pos++;
+    }
+
+    // a ']' right at the start is a literal
+    while (s[p->pos] != '\0' && (s[p->pos] != ']' || first)) {
+        unsigned char lo = (unsigned char) s[p->pos++];
+        first = false;
+
+        if (lo == '\\') {
+            if (s[p->pos] == '\0') {
+                break;
+            }
+            if (add_escape_class(set, s[p->pos])) {
+                p->pos++;
+                continue;
+            }
+            lo = escape_byte(s[p->pos++]);
+        }
+
+        if (s[p->pos] == '-' && s[p->pos + 1] != ']' && s[p->pos + 1] != '\0') {
+            p->pos++;
+            unsigned char hi = (unsigned char) s[p->pos++];
+            if (hi == '\\' && s[p->pos] != '\0') {
+                hi = escape_byte(s[p->pos++]);
+            }
+            if (hi < lo) {
+                p->error = "range out of order";
+                return -1;
+            }
+            set_add_range(set, lo, hi);
+        } else {
+            set_add(set, lo);
+        }
+    }
+
+    if (s[p->pos] != ']') {
+        p->error = "missing ]";
+        return -1;
+    }
+    p->pos++;
+
+    if (negate) {
+        for (int i = 0; i < 4; i++) {
+            set[i] = ~set[i];
+        }
+    }
+    return new_node(p, NODE_SET, setIdx, -1);
+}
+
+static int parse_atom(re_parser_t *p) {
+    const char *s = p->pattern;
+    char c = s[p->pos++];
+    int setIdx;
+
+    switch (c) {
+        case '(': {
+            int inner = parse_alt(p);
+            if (inner < 0) {
+                return -1;
+            }
+            if (s[p->pos] != ')') {
+                p->error = "missing )";
+                return -1;
+            }
+            p->pos++;
+            return inner;
+        }
+
+        case '[':
+            return parse_class(p);
+
+        case '^':
+            return new_node(p, NODE_BOL, -1, -1);
+
+        case '$':
+            return new_node(p, NODE_EOL, -1, -1);
+
+        case '*':
+        case '+':
+        case '?':
+            p->error = "nothing to repeat";
+            return -1;
+
+        default:
+            break;
+    }
+
+    if ((setIdx = new_set(p)) < 0) {
+        return -1;
+    }
+    uint64_t *set = p->re->set[setIdx];
+
+    if (c == '.') {
+        memset(set, 0xff, sizeof(*p->re->set));
+    } else if (c == '\\') {
+        if (s[p->pos] == '\0') {
+            p->error = "trailing \\";
+            return -1;
+        }
+        c = s[p->pos++];
+        if (!add_escape_class(set, c)) {
+            set_add(set, escape_byte(c));
+        }
+    } else {
+        set_add(set, (unsigned char) c);
+    }
+    return new_node(p, NODE_SET, setIdx, -1);
+}
+
+static int parse_repeat(re_parser_t *p) {
+    int node = parse_atom(p);
+
+    while (node >= 0) {
+        char c = p->pattern[p->pos];
+        re_node_kind_t kind = (c == '*') ? NODE_STAR : (c == '+') ? NODE_PLUS : (c == '?') ? NODE_QUEST : NODE_EMPTY;
+        if (kind == NODE_EMPTY) {
+            break;
+        }
+        p->pos++;
+        node = new_node(p, kind, node, -1);
+    }
+    return node;
+}
+
+static int parse_cat(re_parser_t *p) {
+    int node = new_node(p, NODE_EMPTY, -1, -1);
+
+    while (node >= 0 && p->pattern[p->pos] != '\0' && p->pattern[p->pos] != '|' && p->pattern[p->pos] != ')') {
+        int next = parse_repeat(p);
+        node = (next < 0) ? -1 : new_node(p, NODE_CAT, node, next);
+    }
+    return node;
+}
+
+static int parse_alt(re_parser_t *p) {
+    int node = parse_cat(p);
+
+    while (node >= 0 && p->pattern[p->pos] == '|') {
+        p->pos++;
+        int next = parse_cat(p);
+        node = (next < 0) ? -1 : new_node(p, NODE_ALT, node, next);
+    }
+    return node;
+}
+
+static int emit(sf_regex_t *re, sf_re_op_t op, int x, int y) {
+    re->inst[re->numInsts] = (sf_re_inst_t) { op, x, y };
+    return re->numInsts++;
+}
+
+// compiles the tree under node to run into next, returns the instruction it
+// starts at.  Built back to front, so nothing has to be patched later other
+// than the loops of * and +
+static int compile_node(sf_regex_t *re, const re_node_t *nodes, int node, int next) {
+    const re_node_t *n = &nodes[node];
+    int split;
+
+    switch (n->kind) {
+        case NODE_SET:
+            return emit(re, RE_BYTE_SET, n->left, next);
+
+        case NODE_CAT:
+            return compile_node(re, nodes, n->left, compile_node(re, nodes, n->right, next));
+
+        case NODE_ALT: {
+            int left = compile_node(re, nodes, n->left, next);
+            return emit(re, RE_SPLIT, left, compile_node(re, nodes, n->right, next));
+        }
+
+        case NODE_QUEST:
+            return emit(re, RE_SPLIT, compile_node(re, nodes, n->left, next), next);
+
+        case NODE_STAR:
+            split = emit(re, RE_SPLIT, -1, next);
+            re->inst[split].x = compile_node(re, nodes, n->left, split);
+            return split;
+
+        case NODE_PLUS:
+            split = emit(re, RE_SPLIT, -1, next);
+            re->inst[split].x = compile_node(re, nodes, n->left, split);
+            return re->inst[split].x;
+
+        case NODE_BOL:
+            return emit(re, RE_BOL, next, -1);
+
+        case NODE_EOL:
+            return emit(re, RE_EOL, next, -1);
+
+        default:
+            return next;
+    }
+}
+
+// the bytes every match of the tree under node contains
+static void required_bytes(const sf_regex_t *re, const re_node_t *nodes, int node, uint64_t *req) {
+    const re_node_t *n = &nodes[node];
+    uint64_t left[4] = {0};
+    uint64_t right[4] = {0};
+    int count = 0;
+    int only = 0;
+
+    memset(req, 0, 4 * sizeof(uint64_t));
+
+    switch (n->kind) {
+        case NODE_SET:
+            for (int c = 0; c < 256 && count < 2; c++) {
+                if (set_has(re->set[n->left], (unsigned char) c)) {
+                    only = c;
+                    count++;
+                }
+            }
+            if (count == 1) {
+                set_add(req, (unsigned char) only);
+            }
+            break;
+
+        case NODE_CAT:
+        case NODE_ALT:
+            required_bytes(re, nodes, n->left, left);
+            required_bytes(re, nodes, n->right, right);
+            for (int i = 0; i < 4; i++) {
+                req[i] = (n->kind == NODE_CAT) ? left[i] | right[i] : left[i] & right[i];
+            }
+            break;
+
+        case NODE_PLUS:
+            required_bytes(re, nodes, n->left, req);
+            break;
+
+        default:
+            break;
+    }
+}
+
+// how rare a byte is in text, higher is rarer.  Space and the common letters
+// come first, then the other letters, digits, capitals and punctuation
+static int byte_rarity(unsigned char c) {
+    static const char common[] = " etaoinshrdlcumwfgypbvkjxqz";
+    const char *p = (c == '\0') ? NULL : strchr(common, c);
+
+    if (p != NULL) {
+        return (int) (p - common);
+    }
+    if (c >= '0' && c <= '9') {
+        return 30;
+    }
+    if (c >= 'A' && c <= 'Z') {
+        return 40;
+    }
+    return (c < 0x80) ? 50 : 60;
+}
+
+// splits the bytes into classes no byte set tells apart
+static void build_byte_classes(sf_regex_t *re) {
+    unsigned char remap[256][2];
+
+    memset(re->byteClass, 0, sizeof(re->byteClass));
+    re->numClasses = 1;
+
+    for (int s = 0; s < re->numSets; s++) {
+        int numClasses = 0;
+        memset(remap, 0xff, sizeof(remap));
+
+        for (int c = 0; c < 256; c++) {
+            int in = set_has(re->set[s], (unsigned char) c);
+            unsigned char *slot = &remap[re->byteClass[c]][in];
+            if (*slot == 0xff) {
+                *slot = (unsigned char) numClasses++;
+            }
+            re->byteClass[c] = *slot;
+        }
+        re->numClasses = numClasses;
+    }
+
+    for (int c = 255; c >= 0; c--) {
+        re->classByte[re->byteClass[c]] = (unsigned char) c;
+    }
+}
+
+/*
+ *  sf_regex_compile
+ *      pattern:  regular expression, see the top of sfregex.c
+ *
+ *  returns:  the compiled pattern, NULL (after printing why) if it is not
+ *            valid or memory ran out
+ */
+sf_regex_t *sf_regex_compile(const char *pattern) {
+    sf_regex_t *re = calloc(1, sizeof(sf_regex_t));
+    re_parser_t p = { pattern, 0, NULL, 0, 0, re, NULL };
+
+    if (re == NULL) {
+        perror("regex");
+        return NULL;
+    }
+
+    int root = parse_alt(&p);
+    if (root >= 0 && pattern[p.pos] != '\0') {
+        p.error = "unmatched )";
+        root = -1;
+    }
+
+    // one instruction per node at most, plus the match.  A split pushes two
+    // pcs on the closure stack, so it can hold twice as many
+    if (root >= 0) {
+        re->inst = malloc((p.numNodes + 1) * sizeof(sf_re_inst_t));
+        re->mark = calloc(p.numNodes + 1, sizeof(unsigned));
+        re->stack = malloc((2 * p.numNodes + 3) * sizeof(int));
+        re->scratch = malloc((p.numNodes + 1) * sizeof(int));
+        re->held = malloc((p.numNodes + 1) * sizeof(int));
+        if (re->inst == NULL || re->mark == NULL || re->stack == NULL || re->scratch == NULL || re->held == NULL) {
+            p.error = "out of memory";
+            root = -1;
+        }
+    }
+
+    if (root >= 0) {
+        int matchPc = emit(re, RE_MATCH, -1, -1);
+        re->start = compile_node(re, p.node, root, matchPc);
+        build_byte_classes(re);
+
+        // the rarest byte every match needs, if there is one
+        uint64_t req[4];
+        required_bytes(re, p.node, root, req);
+        re->required = -1;
+        for (int c = 0; c < 256; c++) {
+            if (set_has(req, (unsigned char) c) && (re->required < 0 || byte_rarity(c) > byte_rarity(re->required))) {
+                re->required = c;
+            }
+        }
+
+        re->arenaCap = (RE_ARENA_MIN > 4 * (size_t) re->numInsts) ? RE_ARENA_MIN : 4 * (size_t) re->numInsts;
+        re->arena = malloc(re->arenaCap * sizeof(int));
+        re->next = malloc((size_t) RE_MAX_STATES * re->numClasses * sizeof(int));
+        re->stateOff = malloc(RE_MAX_STATES * sizeof(size_t));
+        re->stateLen = malloc(RE_MAX_STATES * sizeof(int));
+        re->stateBol = malloc(RE_MAX_STATES * sizeof(bool));
+        re->match = malloc(RE_MAX_STATES * sizeof(bool));
+        re->matchAtEol = malloc(RE_MAX_STATES * sizeof(bool));
+        re->table = malloc(2 * RE_MAX_STATES * sizeof(int));
+        if (re->arena == NULL || re->next == NULL || re->stateOff == NULL || re->stateLen == NULL ||
+            re->stateBol == NULL || re->match == NULL || re->matchAtEol == NULL || re->table == NULL) {
+            p.error = "out of memory";
+            root = -1;
+        }
+    }
+
+    free(p.node);
+    if (root < 0) {
+        fprintf(stderr, "bad pattern \"%s\": %s at offset %zu\n", pattern, p.error, p.pos);
+        sf_regex_free(re);
+        return NULL;
+    }
+
+    sf_regex_reset(re);
+    return re;
+}
+
+void sf_regex_free(sf_regex_t *re) {
+    if (re == NULL) {
+        return;
+    }
+    free(re->set);
+    free(re->inst);
+    free(re->mark);
+    free(re->stack);
+    free(re->scratch);
+    free(re->held);
+    free(re->next);
+    free(re->stateOff);
+    free(re->stateLen);
+    free(re->stateBol);
+    free(re->match);
+    free(re->matchAtEol);
+    free(re->table);
+    free(re->arena);
+    free(re);
+}
+
+// adds pc and everything it reaches without reading a byte to re->scratch.
+// Byte sets, the match and end of line assertions are kept, the end of line
+// ones are only decided at the end of the line.  Returns the new length
+static int closure(sf_regex_t *re, int pc, bool bol, int len) {
+    int top = 0;
+
+    re->stack[top++] = pc;
+    while (top > 0) {
+        pc = re->stack[--top];
+        if (re->mark[pc] == re->markGen) {
+            continue;
+        }
+        re->mark[pc] = re->markGen;
+
+        const sf_re_inst_t *inst = &re->inst[pc];
+        switch (inst->op) {
+            case RE_SPLIT:
+                re->stack[top++] = inst->y;
+                re->stack[top++] = inst->x;
+                break;
+
+            case RE_BOL:
+                if (bol) {
+                    re->stack[top++] = inst->x;
+                }
+                break;
+
+            default:
+                re->scratch[len++] = pc;
+                break;
+        }
+    }
+    return len;
+}
+
+static void next_gen(sf_regex_t *re) {
+    if (++re->markGen == 0) {
+        memset(re->mark, 0, re->numInsts * sizeof(unsigned));
+        re->markGen = 1;
+    }
+}
+
+static int by_pc(const void *a, const void *b) {
+    return *(const int *) a - *(const int *) b;
+}
+
+static uint64_t hash_state(const int *pcs, int len, bool bol) {
+    uint64_t h = 0x9e3779b97f4a7c15ull * (uint64_t) (len * 2 + bol);
+
+    for (int i = 0; i < len; i++) {
+        h = (h ^ (uint64_t) pcs[i]) * 0x9e3779b97f4a7c15ull;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+// does the state matching at the end of the line, with its end of line
+// assertions now true
+static bool match_at_eol(sf_regex_t *re, const int *pcs, int len, bool bol) {
+    next_gen(re);
+    for (int i = 0; i < len; i++) {
+        const sf_re_inst_t *inst = &re->inst[pcs[i]];
+        if (inst->op == RE_MATCH) {
+            return true;
+        }
+        if (inst->op != RE_EOL) {
+            continue;
+        }
+
+        // follow it, finding another end of line or the match
+        int found = closure(re, inst->x, bol, 0);
+        for (int j = 0; j < found; j++) {
+            sf_re_op_t op = re->inst[re->scratch[j]].op;
+            if (op == RE_MATCH) {
+                return true;
+            }
+            if (op == RE_EOL) {
+                found = closure(re, re->inst[re->scratch[j]].x, bol, found);
+            }
+        }
+    }
+    return false;
+}
+
+// the state for the set in re->scratch[0..len), sorted, added if it is new.
+// Returns -1 if the cache is full
+static int find_state(sf_regex_t *re, int len, bool bol) {
+    const int *pcs = re->scratch;
+    size_t mask = 2 * RE_MAX_STATES - 1;
+    size_t idx = hash_state(pcs, len, bol) & mask;
+
+    while (re->table[idx] >= 0) {
+        int s = re->table[idx];
+        if (re->stateLen[s] == len && re->stateBol[s] == bol &&
+            memcmp(re->arena + re->stateOff[s], pcs, len * sizeof(int)) == 0) {
+            return s;
+        }
+        idx = (idx + 1) & mask;
+    }
+
+    if (re->numStates == RE_MAX_STATES || re->arenaLen + len > re->arenaCap) {
+        return -1;
+    }
+
+    int s = re->numStates++;
+    re->stateOff[s] = re->arenaLen;
+    re->stateLen[s] = len;
+    re->stateBol[s] = bol;
+    memcpy(re->arena + re->arenaLen, pcs, len * sizeof(int));
+    re->arenaLen += len;
+    memset(&re->next[(size_t) s * re->numClasses], -1, re->numClasses * sizeof(int));
+    re->table[idx] = s;
+
+    re->match[s] = false;
+    for (int i = 0; i < len; i++) {
+        re->match[s] |= (re->inst[pcs[i]].op == RE_MATCH);
+    }
+    // match_at_eol() reuses scratch, the set is safe in the arena by now
+    re->matchAtEol[s] = match_at_eol(re, re->arena + re->stateOff[s], len, bol);
+    return s;
+}
+
+// empties the cache, leaving only the state every line starts in
+void sf_regex_reset(sf_regex_t *re) {
+    re->numStates = 0;
+    re->arenaLen = 0;
+    memset(re->table, -1, 2 * RE_MAX_STATES * sizeof(int));
+
+    next_gen(re);
+    int len = closure(re, re->start, true, 0);
+    qsort(re->scratch, len, sizeof(int), by_pc);
+    re->initial = find_state(re, len, true);
+}
+
+// works out and caches where state s goes on a byte of class cls.  Returns
+// the new state, which after a cache reset is the only valid id left
+// besides re->initial
+static int transition(sf_regex_t *re, int s, int cls) {
+    unsigned char c = re->classByte[cls];
+    const int *pcs = re->arena + re->stateOff[s];
+    int len = 0;
+
+    next_gen(re);
+    for (int i = 0; i < re->stateLen[s]; i++) {
+        const sf_re_inst_t *inst = &re->inst[pcs[i]];
+        if (inst->op == RE_BYTE_SET && set_has(re->set[inst->x], c)) {
+            len = closure(re, inst->y, false, len);
+        }
+    }
+    // a match may start at any byte of the line
+    len = closure(re, re->start, false, len);
+    qsort(re->scratch, len, sizeof(int), by_pc);
+
+    int t = find_state(re, len, false);
+    if (t >= 0) {
+        re->next[(size_t) s * re->numClasses + cls] = t;
+        return t;
+    }
+
+    // full, start over from the new state.  Resetting needs scratch, so the
+    // set waits in held
+    memcpy(re->held, re->scratch, len * sizeof(int));
+    sf_regex_reset(re);
+    memcpy(re->scratch, re->held, len * sizeof(int));
+    return find_state(re, len, false);
+}
+
+// does line[0..len), without its '\n', contain a match
+bool sf_regex_line_matches(sf_regex_t *re, const char *line, size_t len) {
+    int s = re->initial;
+
+    for (size_t i = 0; i < len && !re->match[s]; i++) {
+        int cls = re->byteClass[(unsigned char) line[i]];
+        int t = re->next[(size_t) s * re->numClasses + cls];
+        s = (t >= 0) ? t : transition(re, s, cls);
+    }
+    return re->match[s] || re->matchAtEol[s];
+}
+
+// prints each whole line of in[0..len) that matches, in ends with a '\n'
+// unless it is the end of the input
+static void print_matching_lines(sf_regex_t *re, sf_out_t *out, const char *in, size_t len) {
+    size_t pos = 0;
+
+    while (pos < len) {
+        size_t lineStart = pos;
+
+        // only a line holding the required byte can match, skip to it
+        if (re->required >= 0) {
+            const char *hit = memchr(in + pos, re->required, len - pos);
+            if (hit == NULL) {
+                return;
+            }
+            const char *nl = memrchr(in + pos, '\n', hit - (in + pos));
+            lineStart = (nl == NULL) ? pos : (size_t) (nl - in) + 1;
+        }
+
+        const char *nl = memchr(in + lineStart, '\n', len - lineStart);
+        size_t lineEnd = (nl == NULL) ? len : (size_t) (nl - in);
+
+        if (sf_regex_line_matches(re, in + lineStart, lineEnd - lineStart)) {
+            sf_out_write(out, in + lineStart, lineEnd - lineStart);
+            sf_out_byte(out, '\n');
+        }
+        pos = lineEnd + 1;
+    }
+}
+
+/*
+ *  sf_stream_regex_search
+ *      fd:  input
+ *      re:  from sf_regex_compile()
+ *
+ *  Prints every line of the input that matches, like grep.  Lines are only
+ *  looked at once they are complete, a line longer than the buffer grows it.
+ *
+ *  returns:  0, or -1 if the input could not be read or memory ran out
+ */
+int sf_stream_regex_search(int fd, sf_regex_t *re) {
+    sf_out_t *out = sf_out_stdout();
+    size_t cap = STREAM_CHUNK_SZ;
+    char *buff = malloc(cap);
+    size_t carry = 0;
+    ssize_t got;
+    int rc = 0;
+
+    if (buff == NULL) {
+        return -1;
+    }
+
+    do {
+        if (carry == cap) {
+            char *grown = realloc(buff, cap * 2);
+            if (grown == NULL) {
+                rc = -1;
+                break;
+            }
+            buff = grown;
+            cap *= 2;
+        }
+
+        got = sf_read_chunk(fd, buff + carry, cap - carry);
+        if (got < 0) {
+            perror("read");
+            rc = -1;
+            break;
+        }
+
+        // the complete lines, only the new bytes can finish one
+        size_t len = carry + got;
+        size_t done = len;
+        if (got > 0) {
+            const char *nl = memrchr(buff + carry, '\n', got);
+            done = (nl == NULL) ? 0 : (size_t) (nl - buff) + 1;
+        }
+
+        print_matching_lines(re, out, buff, done);
+        carry = len - done;
+        memmove(buff, buff + done, carry);
+    } while (got > 0);
+
+    free(buff);
+    if (sf_out_flush(out) < 0) {
+        rc = -1;
+    }
+    return rc;
+}
@@ -0,0 +1,337 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stringfun.h"
+
+// -X applies a whole file of target -> replacement rules in one pass with an
+// Aho-Corasick automaton.  The targets go into a trie, and a breadth first
+// walk over it gives every state its failure state (the longest suffix of its
+// text that is also in the trie) and fills in the missing transitions from
+// it, so each input byte costs exactly one table lookup.
+//
+// The table has a column per byte class rather than per byte.  Every byte
+// that appears in some target gets a class of its own and all the others
+// share class 0, which always leads back to the root, so a rule file of plain
+// words needs a few dozen columns instead of 256.
+//
+// Matches are picked leftmost-longest.  The depth of the current state says
+// how far back the earliest match still in progress could start (the
+// frontier).  Everything before the frontier is settled: the longest match
+// starting at the first undecided byte is written as its replacement and
+// bytes with no match there are copied through.  Settled matches are kept in
+// a ring with one slot per start position; an undecided match never starts
+// more than the longest target back, so that is all the ring needs.
+
+// adds one rule, returns 0 or -1 if out of memory
+static int add_rule(sf_rules_t *rules, const char *target, size_t targetLen, const char *replacement,
+                    size_t replacementLen) {
+    if (rules->count == rules->capacity) {
+        int capacity = (rules->capacity == 0) ? 16 : rules->capacity * 2;
+        sf_rule_t *grown = realloc(rules->rule, capacity * sizeof(sf_rule_t));
+        if (grown == NULL) {
+            return -1;
+        }
+        rules->rule = grown;
+        rules->capacity = capacity;
+    }
+
+    sf_rule_t *rule = &rules->rule[rules->count];
+    rule->target = malloc(targetLen + replacementLen + 1);
+    if (rule->target == NULL) {
+        return -1;
+    }
+    memcpy(rule->target, target, targetLen);
+    memcpy(rule->target + targetLen, replacement, replacementLen);
+    rule->targetLen = targetLen;
+    rule->replacement = rule->target + targetLen;
+    rule->replacementLen = replacementLen;
+
+    rules->count++;
+    return 0;
+}
+
+// builds the automaton for the rules loaded so far, returns 0 or -1 if out
+// of memory
+static int build_automaton(sf_rules_t *rules) {
+    size_t maxStates = 1;
+
+    // a class for every byte used by a target
+    memset(rules->byteClass, 0, sizeof(rules->byteClass));
+    rules->numClasses = 1;
+    for (int r = 0; r < rules->count; r++) {
+        for (size_t i = 0; i < rules->rule[r].targetLen; i++) {
+            unsigned char b = (unsigned char) rules->rule[r].target[i];
+            if (rules->byteClass[b] == 0) {
+                rules->byteClass[b] = rules->numClasses++;
+            }
+        }
+        maxStates += rules->rule[r].targetLen;
+        if (rules->rule[r].targetLen > rules->maxLen) {
+            rules->maxLen = rules->rule[r].targetLen;
+        }
+    }
+
+    int numClasses = rules->numClasses;
+    rules->next = malloc(maxStates * numClasses * sizeof(int));
+    rules->depth = malloc(maxStates * sizeof(int));
+    rules->match = malloc(maxStates * sizeof(int));
+    rules->outLink = malloc(maxStates * sizeof(int));
+    int *fail = malloc(maxStates * sizeof(int));
+    int *queue = malloc(maxStates * sizeof(int));
+
+    if (rules->next == NULL || rules->depth == NULL || rules->match == NULL || rules->outLink == NULL ||
+        fail == NULL || queue == NULL) {
+        free(fail);
+        free(queue);
+        return -1;
+    }
+
+    // the trie, -1 marks a transition still to be filled in
+    int numStates = 1;
+    memset(rules->next, -1, numClasses * sizeof(int));
+    rules->depth[0] = 0;
+    rules->match[0] = -1;
+
+    for (int r = 0; r < rules->count; r++) {
+        int state = 0;
+        for (size_t i = 0; i < rules->rule[r].targetLen; i++) {
+            int *slot = &rules->next[state * numClasses + rules->byteClass[(unsigned char) rules->rule[r].target[i]]];
+            if (*slot < 0) {
+                *slot = numStates;
+                memset(&rules->next[numStates * numClasses], -1, numClasses * sizeof(int));
+                rules->depth[numStates] = rules->depth[state] + 1;
+                rules->match[numStates] = -1;
+                numStates++;
+            }
+            state = *slot;
+        }
+        // the first rule for a target wins
+        if (rules->match[state] < 0) {
+            rules->match[state] = r;
+        }
+    }
+
+    // failure states breadth first, every state's failure state is shallower
+    // so its row is complete by the time it is needed
+    int head = 0;
+    int tail = 0;
+    fail[0] = 0;
+    rules->outLink[0] = -1;
+    queue[tail++] = 0;
+
+    while (head < tail) {
+        int state = queue[head++];
+        int *row = &rules->next[state * numClasses];
+        int *failRow = &rules->next[fail[state] * numClasses];
+
+        for (int c = 0; c < numClasses; c++) {
+            int child = row[c];
+            if (child < 0) {
+                row[c] = (state == 0) ? 0 : failRow[c];
+                continue;
+            }
+
+            fail[child] = (state == 0) ? 0 : failRow[c];
+            rules->outLink[child] = (rules->match[fail[child]] >= 0) ? fail[child] : rules->outLink[fail[child]];
+            queue[tail++] = child;
+        }
+    }
+
+    rules->numStates = numStates;
+    free(fail);
+    free(queue);
+    return 0;
+}
+
+/*
+ *  sf_rules_load
+ *      path:  rules file, one "target<TAB>replacement" per line.  A line
+ *             without a tab deletes its target, blank lines and lines
+ *             starting with '#' are skipped
+ *
+ *  returns:  the rules ready for sf_stream_rules_replace(), NULL (after printing
+ *            why) if the file can not be read or has no rules
+ */
+sf_rules_t *sf_rules_load(char *path) {
+    FILE *fp = fopen(path, "r");
+    sf_rules_t *rules = calloc(1, sizeof(sf_rules_t));
+    char line[RULE_LINE_SZ];
+    int lineNo = 0;
+    int ok = (fp != NULL && rules != NULL);
+
+    if (fp == NULL) {
+        perror(path);
+    }
+
+    while (ok && fgets(line, sizeof(line), fp) != NULL) {
+        size_t len = strlen(line);
+        lineNo++;
+
+        if (len == sizeof(line) - 1 && line[len - 1] != '\n') {
+            fprintf(stderr, "%s:%d: rule longer than %d bytes\n", path, lineNo, RULE_LINE_SZ - 2);
+            ok = 0;
+            break;
+        }
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        if (len == 0 || line[0] == '#') {
+            continue;
+        }
+
+        char *tab = memchr(line, '\t', len);
+        size_t targetLen = (tab == NULL) ? len : (size_t) (tab - line);
+        char *replacement = (tab == NULL) ? line + len : tab + 1;
+
+        if (targetLen == 0) {
+            fprintf(stderr, "%s:%d: empty target\n", path, lineNo);
+            ok = 0;
+        } else if (add_rule(rules, line, targetLen, replacement, len - (replacement - line)) < 0) {
+            perror("rules");
+            ok = 0;
+        }
+    }
+
+    if (ok && rules->count == 0) {
+        fprintf(stderr, "%s: no rules\n", path);
+        ok = 0;
+    }
+    if (ok && build_automaton(rules) < 0) {
+        perror("rules");
+        ok = 0;
+    }
+
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    if (!ok) {
+        sf_rules_free(rules);
+        return NULL;
+    }
+    return rules;
+}
+
+void sf_rules_free(sf_rules_t *rules) {
+    if (rules == NULL) {
+        return;
+    }
+    for (int r = 0; r < rules->count; r++) {
+        free(rules->rule[r].target);
+    }
+    free(rules->rule);
+    free(rules->next);
+    free(rules->depth);
+    free(rules->match);
+    free(rules->outLink);
+    free(rules);
+}
+
+// where sf_stream_rules_replace() is in the input, positions count from the
+// start of the input and buff holds the bytes from base on
+typedef struct rules_pass {
+    const sf_rules_t *rules;
+    sf_out_t *out;          // where the output goes, the shared stdout sink
+    char *buff;
+    long long base;         // input position of buff[0]
+    long long written;      // bytes before this are written
+    long long undecided;    // first byte not yet settled
+    long long *slotStart;   // ring of settled matches, by start position
+    int *slotRule;
+} rules_pass_t;
+
+// settles every byte before frontier, writing replacements as it goes
+static void settle_until(rules_pass_t *pass, long long frontier) {
+    size_t ringLen = pass->rules->maxLen + 1;
+
+    while (pass->undecided < frontier) {
+        size_t slot = pass->undecided % ringLen;
+        if (pass->slotStart[slot] != pass->undecided) {
+            pass->undecided++;
+            continue;
+        }
+
+        const sf_rule_t *rule = &pass->rules->rule[pass->slotRule[slot]];
+        sf_out_write(pass->out, pass->buff + (pass->written - pass->base), pass->undecided - pass->written);
+        sf_out_write(pass->out, rule->replacement, rule->replacementLen);
+        pass->undecided += rule->targetLen;
+        pass->written = pass->undecided;
+    }
+}
+
+/*
+ *  sf_stream_rules_replace
+ *      fd:     input
+ *      rules:  from sf_rules_load()
+ *
+ *  returns:  0, or -1 if the input could not be read
+ */
+int sf_stream_rules_replace(int fd, const sf_rules_t *rules) {
+    rules_pass_t pass = { rules, sf_out_stdout(), NULL, 0, 0, 0, NULL, NULL };
+    int rc = 0;
+    int numClasses = rules->numClasses;
+    size_t ringLen = rules->maxLen + 1;
+    int state = 0;
+    size_t carry = 0;
+    ssize_t got;
+
+    pass.buff = malloc(STREAM_CHUNK_SZ + rules->maxLen);
+    pass.slotStart = malloc(ringLen * sizeof(long long));
+    pass.slotRule = malloc(ringLen * sizeof(int));
+    if (pass.buff == NULL || pass.slotStart == NULL || pass.slotRule == NULL) {
+        free(pass.buff);
+        free(pass.slotStart);
+        free(pass.slotRule);
+        return -1;
+    }
+    for (size_t i = 0; i < ringLen; i++) {
+        pass.slotStart[i] = -1;
+    }
+
+    while ((got = sf_read_chunk(fd, pass.buff + carry, STREAM_CHUNK_SZ)) > 0) {
+        const unsigned char *in = (const unsigned char *) pass.buff;
+        size_t len = carry + got;
+        long long pos = pass.base + carry;
+
+        for (size_t i = carry; i < len; i++, pos++) {
+            state = rules->next[state * numClasses + rules->byteClass[in[i]]];
+
+            // every target ending here, longest (so earliest start) first
+            int found = (rules->match[state] >= 0) ? state : rules->outLink[state];
+            for (; found >= 0; found = rules->outLink[found]) {
+                int r = rules->match[found];
+                long long start = pos + 1 - (long long) rules->rule[r].targetLen;
+                if (start >= pass.undecided) {
+                    pass.slotStart[start % ringLen] = start;
+                    pass.slotRule[start % ringLen] = r;
+                }
+            }
+
+            settle_until(&pass, pos + 1 - rules->depth[state]);
+        }
+
+        // write what is settled and keep the rest for the next chunk
+        size_t keepFrom = pass.undecided - pass.base;
+        sf_out_write(pass.out, pass.buff + (pass.written - pass.base), pass.undecided - pass.written);
+        pass.written = pass.undecided;
+        carry = len - keepFrom;
+        memmove(pass.buff, pass.buff + keepFrom, carry);
+        pass.base = pass.undecided;
+    }
+
+    // the end of the input settles everything left
+    if (got == 0) {
+        settle_until(&pass, pass.base + carry);
+        sf_out_write(pass.out, pass.buff + (pass.written - pass.base), pass.base + carry - pass.written);
+    } else {
+        perror("read");
+    }
+
+    if (sf_out_flush(pass.out) < 0 || got < 0) {
+        rc = -1;
+    }
+    free(pass.buff);
+    free(pass.slotStart);
+    free(pass.slotRule);
+    return rc;
+}
@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stringfun.h"
+
+// Literal search engine used by -x.  The needle is looked at once, when the
+// searcher is set up, to pick an algorithm:
+//
+//   short needles   memchr() for the first byte, which the C library does
+//                   with vector instructions, then memcmp() for the rest
+//   long needles    Boyer-Moore-Horspool, comparing from the last byte of
+//                   the needle and skipping ahead by the precomputed shift
+//                   for the haystack byte under it
+//
+// Whole word mode runs the same search and then checks the bytes on either
+// side of each candidate.  The caller says whether the edges of the haystack
+// are word boundaries, which is how stream mode searches a chunk at a time.
+
+static const char *find_short(const sf_searcher_t *s, const char *hay, size_t len, size_t from) {
+    const char *p = hay + from;
+    const char *last = hay + len - s->len;     // last possible match start
+
+    while (p <= last) {
+        p = memchr(p, s->needle[0], last - p + 1);
+        if (p == NULL) {
+            return NULL;
+        }
+        if (memcmp(p + 1, s->needle + 1, s->len - 1) == 0) {
+            return p;
+        }
+        p++;
+    }
+    return NULL;
+}
+
+static const char *find_horspool(const sf_searcher_t *s, const char *hay, size_t len, size_t from) {
+    size_t lastIdx = s->len - 1;
+    unsigned char lastByte = (unsigned char) s->needle[lastIdx];
+    size_t pos = from;
+
+    while (pos + s->len <= len) {
+        unsigned char c = (unsigned char) hay[pos + lastIdx];
+        if (c == lastByte && memcmp(hay + pos, s->needle, lastIdx) == 0) {
+            return hay + pos;
+        }
+        pos += s->shift[c];
+    }
+    return NULL;
+}
+
+/*
+ *  sf_searcher_init
+ *      s:       searcher to set up
+ *      needle:  what to look for, must stay valid while s is used
+ *      len:     length of needle
+ *      mode:    SF_MATCH_WORD or SF_MATCH_SUBSTR
+ */
+void sf_searcher_init(sf_searcher_t *s, const char *needle, size_t len, sf_match_mode_t mode) {
+    s->needle = needle;
+    s->len = len;
+    s->mode = mode;
+    s->useHorspool = len >= SF_HORSPOOL_MIN_LEN;
+
+    if (s->useHorspool) {
+        // bytes not in the needle (other than its last) let us skip it all
+        for (int c = 0; c < 256; c++) {
+            s->shift[c] = len;
+        }
+        for (size_t i = 0; i + 1 < len; i++) {
+            s->shift[(unsigned char) needle[i]] = len - 1 - i;
+        }
+    }
+}
+
+/*
+ *  sf_search
+ *      s:              searcher from sf_searcher_init()
+ *      hay, len:       text to search
+ *      from:           first position a match may start at
+ *      startBoundary:  hay[0] is at the start of a word, otherwise hay[0]
+ *                      is only there as context and a match can not use it
+ *      endBoundary:    the text ends at hay[len], otherwise a whole word
+ *                      match touching the end can not be confirmed and is
+ *                      not reported
+ *
+ *  returns:  the first match at or after from, NULL if there is none
+ */
+const char *sf_search(const sf_searcher_t *s, const char *hay, size_t len, size_t from,
+                      bool startBoundary, bool endBoundary) {
+    if (s->len == 0) {
+        return NULL;
+    }
+
+    while (from + s->len <= len) {
+        const char *match = s->useHorspool ? find_horspool(s, hay, len, from) : find_short(s, hay, len, from);
+        if (match == NULL || s->mode == SF_MATCH_SUBSTR) {
+            return match;
+        }
+
+        size_t pos = match - hay;
+        size_t end = pos + s->len;
+        bool leftOk = (pos == 0) ? startBoundary : is_word_sep(hay[pos - 1]);
+        bool rightOk = (end == len) ? endBoundary : is_word_sep(hay[end]);
+
+        if (leftOk && rightOk) {
+            return match;
+        }
+        from = pos + 1;
+    }
+    return NULL;
+}
+
+// copies what fits of src to out[outLen..outCap), returns the new length
+// counting all of src
+static size_t append(char *out, size_t outCap, size_t outLen, const char *src, size_t n) {
+    size_t fits = (outLen < outCap) ? outCap - outLen : 0;
+
+    memcpy(out + outLen, src, (n < fits) ? n : fits);
+    return outLen + n;
+}
+
+/*
+ *  sf_replace
+ *      s:            searcher for the target
+ *      in, len:      text to replace in, its edges are word boundaries
+ *      replacement:  what each match becomes
+ *      maxMatches:   stop after this many, -1 for all of them
+ *      out, outCap:  where the result goes.  Unmatched spans and replacement
+ *                    bytes are copied straight in, in one pass over in
+ *      matches:      receives how many were replaced, may be NULL
+ *
+ *  returns:  the length of the whole result, only the first outCap bytes of
+ *            which are written, so a result that does not fit can be found
+ *            by comparing the two
+ */
+size_t sf_replace(const sf_searcher_t *s, const char *in, size_t len, const char *replacement,
+                  size_t replacementLen, long long maxMatches, char *out, size_t outCap, long long *matches) {
+    size_t outLen = 0;
+    size_t spanStart = 0;
+    long long found = 0;
+    const char *match;
+
+    while (found != maxMatches && (match = sf_search(s, in, len, spanStart, true, true)) != NULL) {
+        size_t pos = match - in;
+        outLen = append(out, outCap, outLen, in + spanStart, pos - spanStart);
+        outLen = append(out, outCap, outLen, replacement, replacementLen);
+        spanStart = pos + s->len;
+        found++;
+    }
+    outLen = append(out, outCap, outLen, in + spanStart, len - spanStart);
+
+    if (matches != NULL) {
+        *matches = found;
+    }
+    return outLen;
+}
+
+// sf_replace() of every match into an output sink instead of a buffer, so
+// the unmatched spans of a large input go out without being copied.  Returns
+// the number of matches replaced
+long long sf_replace_out(const sf_searcher_t *s, const char *in, size_t len, const char *replacement,
+                         size_t replacementLen, sf_out_t *out) {
+    size_t spanStart = 0;
+    long long found = 0;
+    const char *match;
+
+    while ((match = sf_search(s, in, len, spanStart, true, true)) != NULL) {
+        size_t pos = match - in;
+        sf_out_write(out, in + spanStart, pos - spanStart);
+        sf_out_write(out, replacement, replacementLen);
+        spanStart = pos + s->len;
+        found++;
+    }
+    sf_out_write(out, in + spanStart, len - spanStart);
+    return found;
+}
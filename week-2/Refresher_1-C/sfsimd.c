@@ -0,0 +1,578 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "stringfun.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SF_HAVE_X86 1
+#endif
+
+// Whitespace kernels.  Each one classifies a block of bytes at a time into two
+// bitmasks, one bit per byte:
+//
+//   blank  space or tab, the bytes setup_buff() collapses runs of
+//   sep    any word separator, see is_word_sep()
+//
+// and then works on the masks instead of the bytes.  With prev holding the
+// mask shifted by one byte (plus the last bit of the previous block):
+//
+//   word starts     = ~sep & prevSep         popcount gives the word count
+//   bytes to drop   = blank & prevBlank      second and later blank of a run
+//
+// A block with nothing to drop, the common case, is stored as-is.  Only
+// blocks with a run of blanks in them are compacted byte by byte.  The
+// scalar versions do the same thing a byte at a time and are used for the
+// tail of the input and on CPUs without the vector instructions.
+//
+// The reverse kernels load a block from the end of the input, reverse the
+// bytes inside the register and store it at the front of the output.
+//
+// The UTF-8 kernels look for bytes with the high bit set with one movemask
+// per block, so ASCII text costs next to nothing.  The avx2 validator checks
+// the blocks that are not ASCII with the lookup table method of Keiser and
+// Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte": three
+// nibble lookups classify every pair of neighbouring bytes and the error bits
+// they agree on are the errors.  The other kernels check those blocks a
+// character at a time.
+
+static long long count_words_scalar(const char *in, size_t len, sf_scan_state_t *state) {
+    long long words = 0;
+    int inWord = state->inWord;
+
+    for (size_t i = 0; i < len; i++) {
+        int sep = is_word_sep(in[i]);
+        words += !sep & !inWord;
+        inWord = !sep;
+    }
+
+    state->inWord = inWord;
+    return words;
+}
+
+static size_t normalize_count_scalar(const char *in, size_t len, char *out, sf_scan_state_t *state,
+                                     long long *words) {
+    size_t outLen = 0;
+    int inWord = state->inWord;
+    int prevBlank = state->prevBlank;
+
+    for (size_t i = 0; i < len; i++) {
+        char c = in[i];
+        int blank = (c == ' ' || c == '\t');
+        int sep = is_word_sep(c);
+
+        // always store, only advance past bytes that are kept
+        out[outLen] = c;
+        outLen += !(blank & prevBlank);
+        *words += !sep & !inWord;
+
+        prevBlank = blank;
+        inWord = !sep;
+    }
+
+    state->inWord = inWord;
+    state->prevBlank = prevBlank;
+    return outLen;
+}
+
+static void reverse_bytes_scalar(const char *in, size_t len, char *out) {
+    for (size_t i = 0; i < len; i++) {
+        out[i] = in[len - 1 - i];
+    }
+}
+
+static size_t ascii_prefix_scalar(const char *in, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if ((unsigned char) in[i] >= 0x80) {
+            return i;
+        }
+    }
+    return len;
+}
+
+// length of the valid UTF-8 character at in[0] (RFC 3629, so no overlong
+// forms, surrogates or code points past U+10FFFF), 0 if it is not valid or
+// runs past len
+static size_t utf8_char_len(const char *in, size_t len) {
+    unsigned char c = (unsigned char) in[0];
+    unsigned char lo = 0x80;
+    unsigned char hi = 0xbf;
+    size_t n;
+
+    if (c < 0x80) {
+        return 1;
+    } else if (c >= 0xc2 && c <= 0xdf) {
+        n = 2;
+    } else if (c == 0xe0) {
+        n = 3, lo = 0xa0;
+    } else if (c == 0xed) {
+        n = 3, hi = 0x9f;
+    } else if (c >= 0xe1 && c <= 0xef) {
+        n = 3;
+    } else if (c == 0xf0) {
+        n = 4, lo = 0x90;
+    } else if (c >= 0xf1 && c <= 0xf3) {
+        n = 4;
+    } else if (c == 0xf4) {
+        n = 4, hi = 0x8f;
+    } else {
+        return 0;
+    }
+
+    if (n > len || (unsigned char) in[1] < lo || (unsigned char) in[1] > hi) {
+        return 0;
+    }
+    for (size_t i = 2; i < n; i++) {
+        if (((unsigned char) in[i] & 0xc0) != 0x80) {
+            return 0;
+        }
+    }
+    return n;
+}
+
+static int utf8_valid_scalar(const char *in, size_t len) {
+    size_t i = 0;
+
+    while (i < len) {
+        size_t n = utf8_char_len(in + i, len - i);
+        if (n == 0) {
+            return 0;
+        }
+        i += n;
+    }
+    return 1;
+}
+
+#ifdef SF_HAVE_X86
+
+// copies the bytes of block whose bit in keep is set, returns how many.  The
+// dropped bytes come in runs, so this copies the runs of kept bytes between
+// them rather than going a byte at a time
+static inline size_t compact_block(const char *block, int blockLen, uint32_t keep, char *out) {
+    uint64_t bits = keep & (uint32_t) ((1ull << blockLen) - 1);
+    size_t outLen = 0;
+
+    while (bits != 0) {
+        int start = __builtin_ctzll(bits);
+        int runLen = __builtin_ctzll(~(bits >> start));
+        memcpy(out + outLen, block + start, runLen);
+        outLen += runLen;
+        bits &= ~(((1ull << runLen) - 1) << start);
+    }
+    return outLen;
+}
+
+// 0xff where v is a word separator: ' ' or '\t'..'\r' (9 to 13)
+static inline __m128i sep_mask_sse2(__m128i v) {
+    __m128i low = _mm_sub_epi8(v, _mm_set1_epi8(9));
+    __m128i ctrl = _mm_cmpeq_epi8(_mm_min_epu8(low, _mm_set1_epi8(4)), low);
+    return _mm_or_si128(ctrl, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+}
+
+static inline __m128i blank_mask_sse2(__m128i v) {
+    return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+}
+
+static long long count_words_sse2(const char *in, size_t len, sf_scan_state_t *state) {
+    long long words = 0;
+    uint32_t prevSep = !state->inWord;
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (in + i));
+        uint32_t sep = (uint32_t) _mm_movemask_epi8(sep_mask_sse2(v));
+        uint32_t starts = ~sep & ((sep << 1) | prevSep) & 0xffff;
+
+        words += __builtin_popcount(starts);
+        prevSep = sep >> 15;
+    }
+
+    state->inWord = !prevSep;
+    return words + count_words_scalar(in + i, len - i, state);
+}
+
+static size_t normalize_count_sse2(const char *in, size_t len, char *out, sf_scan_state_t *state,
+                                   long long *words) {
+    uint32_t prevSep = !state->inWord;
+    uint32_t prevBlank = state->prevBlank;
+    size_t outLen = 0;
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (in + i));
+        uint32_t sep = (uint32_t) _mm_movemask_epi8(sep_mask_sse2(v));
+        uint32_t blank = (uint32_t) _mm_movemask_epi8(blank_mask_sse2(v));
+        uint32_t drop = blank & ((blank << 1) | prevBlank) & 0xffff;
+
+        *words += __builtin_popcount(~sep & ((sep << 1) | prevSep) & 0xffff);
+
+        if (drop == 0) {
+            _mm_storeu_si128((__m128i *) (out + outLen), v);
+            outLen += 16;
+        } else {
+            outLen += compact_block(in + i, 16, ~drop, out + outLen);
+        }
+
+        prevSep = sep >> 15;
+        prevBlank = blank >> 15;
+    }
+
+    state->inWord = !prevSep;
+    state->prevBlank = prevBlank;
+    return outLen + normalize_count_scalar(in + i, len - i, out + outLen, state, words);
+}
+
+// sse2 has no byte shuffle: reverse the dwords, then the words in each dword,
+// then the bytes in each word
+static void reverse_bytes_sse2(const char *in, size_t len, char *out) {
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (in + len - i - 16));
+        v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+        v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        _mm_storeu_si128((__m128i *) (out + i), v);
+    }
+    reverse_bytes_scalar(in, len - i, out + i);
+}
+
+static size_t ascii_prefix_sse2(const char *in, size_t len) {
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        uint32_t high = (uint32_t) _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) (in + i)));
+        if (high != 0) {
+            return i + __builtin_ctz(high);
+        }
+    }
+    return i + ascii_prefix_scalar(in + i, len - i);
+}
+
+// skips ASCII a block at a time and checks the rest a character at a time
+static int utf8_valid_sse2(const char *in, size_t len) {
+    size_t i = 0;
+
+    for (;;) {
+        i += ascii_prefix_sse2(in + i, len - i);
+        if (i == len) {
+            return 1;
+        }
+        size_t n = utf8_char_len(in + i, len - i);
+        if (n == 0) {
+            return 0;
+        }
+        i += n;
+    }
+}
+
+#define AVX2_TARGET __attribute__((target("avx2,popcnt")))
+
+// for every 8 bit keep mask, the pshufb control that moves the kept bytes of
+// an 8 byte group to its front.  Filled in by sf_kernels() before use
+static uint8_t compactShuffle[256][8];
+
+static void init_compact_shuffle(void) {
+    for (int mask = 0; mask < 256; mask++) {
+        int j = 0;
+        for (int i = 0; i < 8; i++) {
+            if (mask & (1 << i)) {
+                compactShuffle[mask][j++] = (uint8_t) i;
+            }
+        }
+        for (; j < 8; j++) {
+            compactShuffle[mask][j] = 0x80;
+        }
+    }
+}
+
+// compact_block() for a 32 byte block, one shuffle per 8 bytes
+AVX2_TARGET static inline size_t compact_block_avx2(const char *block, uint32_t keep, char *out) {
+    size_t outLen = 0;
+
+    for (int group = 0; group < 4; group++) {
+        uint32_t groupKeep = (keep >> (group * 8)) & 0xff;
+        __m128i bytes = _mm_loadl_epi64((const __m128i *) (block + group * 8));
+        __m128i ctrl = _mm_loadl_epi64((const __m128i *) compactShuffle[groupKeep]);
+        _mm_storel_epi64((__m128i *) (out + outLen), _mm_shuffle_epi8(bytes, ctrl));
+        outLen += __builtin_popcount(groupKeep);
+    }
+    return outLen;
+}
+
+AVX2_TARGET static inline __m256i sep_mask_avx2(__m256i v) {
+    __m256i low = _mm256_sub_epi8(v, _mm256_set1_epi8(9));
+    __m256i ctrl = _mm256_cmpeq_epi8(_mm256_min_epu8(low, _mm256_set1_epi8(4)), low);
+    return _mm256_or_si256(ctrl, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+}
+
+AVX2_TARGET static inline __m256i blank_mask_avx2(__m256i v) {
+    return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                           _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+}
+
+AVX2_TARGET static long long count_words_avx2(const char *in, size_t len, sf_scan_state_t *state) {
+    long long words = 0;
+    uint64_t prevSep = !state->inWord;
+    size_t i = 0;
+
+    // two blocks per iteration so the masks fill a 64 bit word
+    for (; i + 64 <= len; i += 64) {
+        __m256i lo = _mm256_loadu_si256((const __m256i *) (in + i));
+        __m256i hi = _mm256_loadu_si256((const __m256i *) (in + i + 32));
+        uint64_t sep = (uint32_t) _mm256_movemask_epi8(sep_mask_avx2(lo)) |
+                       ((uint64_t) (uint32_t) _mm256_movemask_epi8(sep_mask_avx2(hi)) << 32);
+
+        words += __builtin_popcountll(~sep & ((sep << 1) | prevSep));
+        prevSep = sep >> 63;
+    }
+
+    state->inWord = !prevSep;
+    return words + count_words_sse2(in + i, len - i, state);
+}
+
+AVX2_TARGET static size_t normalize_count_avx2(const char *in, size_t len, char *out, sf_scan_state_t *state,
+                                               long long *words) {
+    uint64_t prevSep = !state->inWord;
+    uint64_t prevBlank = state->prevBlank;
+    size_t outLen = 0;
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (in + i));
+        uint64_t sep = (uint32_t) _mm256_movemask_epi8(sep_mask_avx2(v));
+        uint64_t blank = (uint32_t) _mm256_movemask_epi8(blank_mask_avx2(v));
+        uint32_t drop = (uint32_t) (blank & ((blank << 1) | prevBlank));
+
+        *words += __builtin_popcountll(~sep & ((sep << 1) | prevSep) & 0xffffffffull);
+
+        if (drop == 0) {
+            _mm256_storeu_si256((__m256i *) (out + outLen), v);
+            outLen += 32;
+        } else {
+            outLen += compact_block_avx2(in + i, ~drop, out + outLen);
+        }
+
+        prevSep = sep >> 31;
+        prevBlank = blank >> 31;
+    }
+
+    state->inWord = !prevSep;
+    state->prevBlank = (int) prevBlank;
+    return outLen + normalize_count_sse2(in + i, len - i, out + outLen, state, words);
+}
+
+// pshufb reverses each 16 byte lane, then the two lanes swap places
+AVX2_TARGET static void reverse_bytes_avx2(const char *in, size_t len, char *out) {
+    const __m256i lanes = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                           15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    size_t i = 0;
+
+    for (; i + 64 <= len; i += 64) {
+        __m256i hi = _mm256_loadu_si256((const __m256i *) (in + len - i - 32));
+        __m256i lo = _mm256_loadu_si256((const __m256i *) (in + len - i - 64));
+        hi = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(hi, lanes), _MM_SHUFFLE(1, 0, 3, 2));
+        lo = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(lo, lanes), _MM_SHUFFLE(1, 0, 3, 2));
+        _mm256_storeu_si256((__m256i *) (out + i), hi);
+        _mm256_storeu_si256((__m256i *) (out + i + 32), lo);
+    }
+    reverse_bytes_sse2(in, len - i, out + i);
+}
+
+AVX2_TARGET static size_t ascii_prefix_avx2(const char *in, size_t len) {
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        uint32_t high = (uint32_t) _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *) (in + i)));
+        if (high != 0) {
+            return i + __builtin_ctz(high);
+        }
+    }
+    return i + ascii_prefix_sse2(in + i, len - i);
+}
+
+// error bits of the UTF-8 lookup tables, a pair of bytes is wrong when all
+// three lookups for it have one of these in common
+#define U8_TOO_SHORT    (1 << 0)    // lead byte not followed by a continuation
+#define U8_TOO_LONG     (1 << 1)    // continuation after an ASCII byte
+#define U8_OVERLONG_3   (1 << 2)
+#define U8_TOO_LARGE    (1 << 3)
+#define U8_SURROGATE    (1 << 4)
+#define U8_OVERLONG_2   (1 << 5)
+#define U8_TOO_LARGE_1000 (1 << 6)
+#define U8_OVERLONG_4   (1 << 6)
+#define U8_TWO_CONTS    (1 << 7)    // two continuations, fine only inside 3 and 4 byte forms
+#define U8_CARRY        (U8_TOO_SHORT | U8_TOO_LONG | U8_TWO_CONTS)
+
+// the bytes before each byte of input, the previous block filling the gap
+#define U8_PREV(input, prevInput, n) \
+    _mm256_alignr_epi8((input), _mm256_permute2x128_si256((prevInput), (input), 0x21), 16 - (n))
+
+AVX2_TARGET static int utf8_valid_avx2(const char *in, size_t len) {
+    const __m256i byte1High = _mm256_setr_epi8(
+        U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG,
+        U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS,
+        U8_TOO_SHORT | U8_OVERLONG_2,
+        U8_TOO_SHORT,
+        U8_TOO_SHORT | U8_OVERLONG_3 | U8_SURROGATE,
+        U8_TOO_SHORT | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_OVERLONG_4,
+        U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG,
+        U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS,
+        U8_TOO_SHORT | U8_OVERLONG_2,
+        U8_TOO_SHORT,
+        U8_TOO_SHORT | U8_OVERLONG_3 | U8_SURROGATE,
+        U8_TOO_SHORT | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_OVERLONG_4);
+    const __m256i byte1Low = _mm256_setr_epi8(
+        U8_CARRY | U8_OVERLONG_3 | U8_OVERLONG_2 | U8_OVERLONG_4,
+        U8_CARRY | U8_OVERLONG_2,
+        U8_CARRY, U8_CARRY,
+        U8_CARRY | U8_TOO_LARGE,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000, U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000, U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000, U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_SURROGATE,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000, U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_OVERLONG_3 | U8_OVERLONG_2 | U8_OVERLONG_4,
+        U8_CARRY | U8_OVERLONG_2,
+        U8_CARRY, U8_CARRY,
+        U8_CARRY | U8_TOO_LARGE,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000, U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000, U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000, U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_SURROGATE,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000, U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000);
+    const __m256i byte2High = _mm256_setr_epi8(
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 | U8_TOO_LARGE_1000 | U8_OVERLONG_4,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 | U8_TOO_LARGE,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE | U8_TOO_LARGE,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE | U8_TOO_LARGE,
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 | U8_TOO_LARGE_1000 | U8_OVERLONG_4,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 | U8_TOO_LARGE,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE | U8_TOO_LARGE,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE | U8_TOO_LARGE,
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT);
+    // a block ending in one of these still owes continuation bytes
+    const __m256i incompleteMax = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        (char) (0xf0 - 1), (char) (0xe0 - 1), (char) (0xc0 - 1));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    __m256i prevInput = _mm256_setzero_si256();
+    __m256i prevIncomplete = _mm256_setzero_si256();
+    __m256i error = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i input = _mm256_loadu_si256((const __m256i *) (in + i));
+
+        if (_mm256_movemask_epi8(input) == 0) {
+            // ASCII, only wrong if the block before left a character open
+            error = _mm256_or_si256(error, prevIncomplete);
+        } else {
+            __m256i prev1 = U8_PREV(input, prevInput, 1);
+            __m256i prev2 = U8_PREV(input, prevInput, 2);
+            __m256i prev3 = U8_PREV(input, prevInput, 3);
+
+            __m256i special = _mm256_and_si256(
+                _mm256_and_si256(_mm256_shuffle_epi8(byte1High, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+                                 _mm256_shuffle_epi8(byte1Low, _mm256_and_si256(prev1, nibble))),
+                _mm256_shuffle_epi8(byte2High, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+
+            // the third and fourth bytes of a character have to be continuations
+            __m256i thirdByte = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char) (0xe0 - 0x80)));
+            __m256i fourthByte = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char) (0xf0 - 0x80)));
+            __m256i must23 = _mm256_and_si256(_mm256_or_si256(thirdByte, fourthByte), _mm256_set1_epi8((char) 0x80));
+
+            error = _mm256_or_si256(error, _mm256_xor_si256(must23, special));
+            prevIncomplete = _mm256_subs_epu8(input, incompleteMax);
+        }
+        prevInput = input;
+    }
+
+    if (!_mm256_testz_si256(error, error)) {
+        return 0;
+    }
+
+    // the tail, starting over at the last character that began in the
+    // blocks since it may run on past them
+    size_t start = i;
+    while (start > 0 && i - start < 4) {
+        start--;
+        if (((unsigned char) in[start] & 0xc0) != 0x80) {
+            break;
+        }
+    }
+    return utf8_valid_scalar(in + start, len - start);
+}
+
+#endif
+
+static const sf_kernels_t KERNELS[] = {
+#ifdef SF_HAVE_X86
+    { "avx2", count_words_avx2, normalize_count_avx2, reverse_bytes_avx2, ascii_prefix_avx2, utf8_valid_avx2 },
+    { "sse2", count_words_sse2, normalize_count_sse2, reverse_bytes_sse2, ascii_prefix_sse2, utf8_valid_sse2 },
+#endif
+    { "scalar", count_words_scalar, normalize_count_scalar, reverse_bytes_scalar, ascii_prefix_scalar,
+      utf8_valid_scalar },
+};
+
+#define NUM_KERNELS ((int) (sizeof(KERNELS) / sizeof(KERNELS[0])))
+
+// can this CPU run the kernels called name
+static int kernel_supported(const char *name) {
+#ifdef SF_HAVE_X86
+    if (strcmp(name, "avx2") == 0) {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+    }
+    if (strcmp(name, "sse2") == 0) {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2");
+    }
+#endif
+    return strcmp(name, "scalar") == 0;
+}
+
+// the kernels called name, NULL if there are none or the CPU can not run them
+const sf_kernels_t *sf_kernels_by_name(const char *name) {
+    for (int i = 0; i < NUM_KERNELS; i++) {
+        if (strcmp(KERNELS[i].name, name) == 0) {
+            if (!kernel_supported(name)) {
+                return NULL;
+            }
+#ifdef SF_HAVE_X86
+            if (compactShuffle[0][0] == 0) {
+                init_compact_shuffle();
+            }
+#endif
+            return &KERNELS[i];
+        }
+    }
+    return NULL;
+}
+
+// the fastest kernels this CPU supports, picked once.  SF_KERNEL_ENV can name
+// a slower set, which is handy for checking they all agree
+const sf_kernels_t *sf_kernels(void) {
+    static const sf_kernels_t *best = NULL;
+
+    if (best == NULL) {
+        char *forced = getenv(SF_KERNEL_ENV);
+        if (forced != NULL) {
+            best = sf_kernels_by_name(forced);
+        }
+        for (int i = 0; best == NULL && i < NUM_KERNELS; i++) {
+            best = sf_kernels_by_name(KERNELS[i].name);
+        }
+    }
+    return best;
+}
@@ -0,0 +1,321 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "stringfun.h"
+
+// Stream mode runs the same operations as the 50 byte buffer mode, but over
+// a file or stdin of any size.  Input is read STREAM_CHUNK_SZ bytes at a time
+// and whatever an operation needs to know about the previous chunk (are we in
+// the middle of a word, how long is it so far) is carried over in a few
+// variables, so memory use does not depend on the input size.  The text is
+// processed as-is: whitespace is not collapsed the way setup_buff() does it,
+// and -r / -x write just the resulting text so the output can be used as a
+// file again.
+
+// read() that retries when interrupted, returns 0 at end of input
+ssize_t sf_read_chunk(int fd, char *buff, size_t len) {
+    ssize_t got;
+
+    do {
+        got = read(fd, buff, len);
+    } while (got < 0 && errno == EINTR);
+
+    return got;
+}
+
+// opens path for reading, "-" is stdin
+int sf_stream_open(char *path) {
+    if (strcmp(path, STDIN_NAME) == 0) {
+        return STDIN_FILENO;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+    }
+    return fd;
+}
+
+// counts words, a word starts at every non separator that follows a separator
+// (or the start of the input) so only that one bit of state crosses chunks.
+// the counting is done by the whitespace kernel, see sfsimd.c
+int sf_stream_count_words(int fd, long long *words) {
+    const sf_kernels_t *kernels = sf_kernels();
+    char *buff = malloc(STREAM_CHUNK_SZ);
+    sf_scan_state_t state = {0};
+    long long count = 0;
+    ssize_t got;
+
+    if (buff == NULL) {
+        return -1;
+    }
+
+    while ((got = sf_read_chunk(fd, buff, STREAM_CHUNK_SZ)) > 0) {
+        count += kernels->count_words(buff, got, &state);
+    }
+
+    free(buff);
+    if (got < 0) {
+        perror("read");
+        return -1;
+    }
+
+    *words = count;
+    return 0;
+}
+
+// prints words and their lengths like word_print(), a word that straddles two
+// chunks is printed in pieces and its length is added up as it goes.  All of
+// it goes through the output sink
+int sf_stream_word_print(int fd) {
+    sf_out_t *out = sf_out_stdout();
+    char *buff = malloc(STREAM_CHUNK_SZ);
+    long long words = 0;
+    long long wordLen = 0;
+    int inWord = 0;
+    ssize_t got;
+
+    if (buff == NULL) {
+        return -1;
+    }
+
+    sf_out_str(out, "Word Print\n----------\n");
+
+    while ((got = sf_read_chunk(fd, buff, STREAM_CHUNK_SZ)) > 0) {
+        ssize_t i = 0;
+
+        while (i < got) {
+            if (!inWord) {
+                while (i < got && is_word_sep(buff[i])) {
+                    i++;
+                }
+                if (i == got) {
+                    break;
+                }
+                words++;
+                sf_out_ll(out, words);
+                sf_out_write(out, ". ", 2);
+                wordLen = 0;
+                inWord = 1;
+            }
+
+            // the word, or as much of it as this chunk has
+            ssize_t wordStart = i;
+            while (i < got && !is_word_sep(buff[i])) {
+                i++;
+            }
+            sf_out_write(out, buff + wordStart, i - wordStart);
+            wordLen += i - wordStart;
+
+            if (i < got) {
+                sf_out_write(out, " (", 2);
+                sf_out_ll(out, wordLen);
+                sf_out_write(out, ")\n", 2);
+                inWord = 0;
+            }
+        }
+    }
+
+    if (inWord) {
+        sf_out_write(out, " (", 2);
+        sf_out_ll(out, wordLen);
+        sf_out_write(out, ")\n", 2);
+    }
+
+    free(buff);
+    if (got < 0) {
+        perror("read");
+        sf_out_flush(out);
+        return -1;
+    }
+    return sf_out_flush(out);
+}
+
+// copies a pipe or terminal into an unnamed temp file so it can be read
+// backwards, returns the new fd or -1
+static int spool_to_tmpfile(int fd) {
+    FILE *tmp = tmpfile();
+    char *buff = malloc(STREAM_CHUNK_SZ);
+    ssize_t got = -1;
+
+    if (tmp == NULL || buff == NULL) {
+        perror("tmpfile");
+        free(buff);
+        return -1;
+    }
+
+    int tmpFd = dup(fileno(tmp));
+    fclose(tmp);
+
+    while (tmpFd >= 0 && (got = sf_read_chunk(fd, buff, STREAM_CHUNK_SZ)) > 0) {
+        if (write(tmpFd, buff, got) != got) {
+            got = -1;
+            break;
+        }
+    }
+
+    free(buff);
+    if (got < 0) {
+        perror("spool");
+        if (tmpFd >= 0) {
+            close(tmpFd);
+        }
+        return -1;
+    }
+    return tmpFd;
+}
+
+// writes the input reversed, or with lines set its lines in reverse order
+// like tac.  The input is mapped rather than read, so nothing but one output
+// block is ever copied onto the heap: bytes are reversed from the end of the
+// mapping by the reverse kernel into that block, and lines go to the output
+// sink straight out of the mapping.  With utf8 set characters are reversed
+// rather than bytes, see sfutf8.c.  Lines need no decoding either way
+int sf_stream_reverse(int fd, bool lines, bool utf8) {
+    sf_out_t *sink = sf_out_stdout();
+    struct stat st;
+    int srcFd = fd;
+    int rc = 0;
+
+    // only a regular file can be mapped
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        srcFd = spool_to_tmpfile(fd);
+        if (srcFd < 0) {
+            return -1;
+        }
+        if (fstat(srcFd, &st) < 0) {
+            perror("reverse");
+            close(srcFd);
+            return -1;
+        }
+    }
+
+    size_t len = (size_t) st.st_size;
+    const char *map = (len == 0) ? NULL : mmap(NULL, len, PROT_READ, MAP_PRIVATE, srcFd, 0);
+    // room for a block to grow to the start of a character
+    char *out = lines ? NULL : malloc(STREAM_CHUNK_SZ + 4);
+
+    if (map == MAP_FAILED || (!lines && out == NULL)) {
+        perror("reverse");
+        rc = -1;
+    } else if (utf8 && !lines && !sf_kernels()->utf8_valid(map, len)) {
+        fprintf(stderr, "input is not valid UTF-8\n");
+        rc = -1;
+    } else if (lines) {
+        // every line ends at a '\n', except maybe the last one which is
+        // then written first with nothing after it, as tac does
+        size_t end = len;
+        while (end > 0) {
+            const char *nl = (end > 1) ? memrchr(map, '\n', end - 1) : NULL;
+            size_t start = (nl == NULL) ? 0 : (size_t) (nl - map) + 1;
+            sf_out_write(sink, map + start, end - start);
+            end = start;
+        }
+    } else {
+        const sf_kernels_t *kernels = sf_kernels();
+        size_t pos = len;
+        while (pos > 0) {
+            size_t blockLen = (pos > STREAM_CHUNK_SZ) ? STREAM_CHUNK_SZ : pos;
+            pos -= blockLen;
+            if (utf8) {
+                // never split a character between two blocks
+                while (pos > 0 && ((unsigned char) map[pos] & 0xc0) == 0x80) {
+                    pos--;
+                    blockLen++;
+                }
+                sf_utf8_reverse(map + pos, blockLen, out);
+            } else {
+                kernels->reverse_bytes(map + pos, blockLen, out);
+            }
+            sf_out_write(sink, out, blockLen);
+        }
+    }
+
+    if (sf_out_flush(sink) < 0) {
+        rc = -1;
+    }
+    if (map != NULL && map != MAP_FAILED) {
+        munmap((void *) map, len);
+    }
+    free(out);
+    if (srcFd != fd) {
+        close(srcFd);
+    }
+    return rc;
+}
+
+// replaces every match of target, whole words only unless substr is set, and
+// copies everything else through untouched.  The matching is done by the
+// search engine in sfsearch.c.  A match may run past the end of a chunk, so
+// its last targetLen bytes are held back (moved to the front of the buffer
+// ahead of the next read) along with the byte before them, which has already
+// been written and is only there for the whole word check.
+int sf_stream_search_and_replace(int fd, char *target, char *replacement, bool substr) {
+    sf_searcher_t searcher;
+    size_t targetLen = strlen(target);
+    size_t replacementLen = strlen(replacement);
+    char *buff = malloc(STREAM_CHUNK_SZ + targetLen + 1);
+    sf_out_t *out = sf_out_stdout();
+    int rc = 0;
+    size_t carry = 0;       // held back bytes at the front of buff
+    int haveContext = 0;    // buff[0] is the already written context byte
+    ssize_t got;
+
+    if (buff == NULL) {
+        return -1;
+    }
+
+    sf_searcher_init(&searcher, target, targetLen, substr ? SF_MATCH_SUBSTR : SF_MATCH_WORD);
+
+    do {
+        got = sf_read_chunk(fd, buff + carry, STREAM_CHUNK_SZ);
+        if (got < 0) {
+            perror("read");
+            break;
+        }
+
+        size_t len = carry + got;
+        int atEnd = (got == 0);
+        size_t pos = haveContext;   // where the next match may start
+        size_t spanStart = pos;     // start of bytes not yet written
+        const char *match;
+
+        // without the byte after it a whole word match at the end of the
+        // chunk is not reported, it is found again once that byte is read
+        while ((match = sf_search(&searcher, buff, len, pos, !haveContext, atEnd)) != NULL) {
+            size_t matchPos = match - buff;
+            sf_out_write(out, buff + spanStart, matchPos - spanStart);
+            sf_out_write(out, replacement, replacementLen);
+            pos = spanStart = matchPos + targetLen;
+        }
+
+        // everything a later match could still start in is held back
+        size_t holdFrom = atEnd ? len : len - ((len < targetLen) ? len : targetLen);
+        if (holdFrom < pos) {
+            holdFrom = pos;
+        }
+
+        sf_out_write(out, buff + spanStart, holdFrom - spanStart);
+
+        if (holdFrom > 0 && !atEnd) {
+            carry = len - holdFrom + 1;
+            memmove(buff, buff + holdFrom - 1, carry);
+            haveContext = 1;
+        } else {
+            carry = len;
+        }
+    } while (got > 0);
+
+    if (sf_out_flush(out) < 0 || got < 0) {
+        rc = -1;
+    }
+    free(buff);
+    return rc;
+}
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "stringfun.h"
+
+// -j mode maps the whole file and splits it into one range per thread.  Each
+// thread runs the whitespace kernel over its range as if it were the start of
+// the input, so a word that straddles the edge between two ranges is counted
+// by both.  Once the threads are done a reconciliation pass looks at the two
+// bytes on either side of every edge and takes one off the total for each
+// edge that falls inside a word, which makes the result exactly what a single
+// pass over the file reports.
+
+typedef struct count_job {
+    const char *start;
+    size_t len;
+    long long words;
+} count_job_t;
+
+static void *count_range(void *arg) {
+    count_job_t *job = (count_job_t *) arg;
+    sf_scan_state_t state = {0};
+
+    job->words = sf_kernels()->count_words(job->start, job->len, &state);
+    return NULL;
+}
+
+/*
+ *  map_input
+ *      path:  file to map
+ *      len:   receives its size
+ *
+ *  returns:  the read only mapping, NULL for an empty file, MAP_FAILED
+ *            (after printing why) on error
+ */
+static const char *map_input(char *path, size_t *len) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return MAP_FAILED;
+    }
+
+    *len = (size_t) st.st_size;
+    if (*len == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    const char *map = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(path);
+    } else {
+        madvise((void *) map, *len, MADV_SEQUENTIAL);
+    }
+    return map;
+}
+
+// how many of the jobs a file of len bytes is worth splitting into
+static int jobs_for_size(int jobs, size_t len) {
+    size_t useful = len / JOBS_MIN_RANGE_SZ;
+
+    if (useful < (size_t) jobs) {
+        jobs = (useful == 0) ? 1 : (int) useful;
+    }
+    return jobs;
+}
+
+/*
+ *  sf_parallel_count_words
+ *      path:   file to count the words of
+ *      jobs:   number of threads to use, 1 to MAX_JOBS
+ *      words:  receives the count
+ *
+ *  returns:  0 on success, -1 if the file could not be read or the threads
+ *            could not be started
+ */
+int sf_parallel_count_words(char *path, int jobs, long long *words) {
+    size_t len = 0;
+    const char *map = map_input(path, &len);
+
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    if (map == NULL) {
+        *words = 0;
+        return 0;
+    }
+
+    // pick the kernels before any thread asks for them
+    sf_kernels();
+
+    jobs = jobs_for_size(jobs, len);
+    count_job_t job[MAX_JOBS];
+    pthread_t tid[MAX_JOBS];
+    size_t rangeLen = len / jobs;
+    int started = 0;
+    int rc = 0;
+
+    for (int i = 0; i < jobs; i++) {
+        job[i].start = map + i * rangeLen;
+        job[i].len = (i == jobs - 1) ? len - i * rangeLen : rangeLen;
+        job[i].words = 0;
+
+        // the last range is counted on this thread
+        if (i == jobs - 1) {
+            count_range(&job[i]);
+        } else if (pthread_create(&tid[i], NULL, count_range, &job[i]) != 0) {
+            perror("pthread_create");
+            rc = -1;
+            break;
+        } else {
+            started++;
+        }
+    }
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(tid[i], NULL);
+    }
+
+    // reconcile, a word running across an edge was counted on both sides
+    long long total = 0;
+    for (int i = 0; rc == 0 && i < jobs; i++) {
+        total += job[i].words;
+        if (i > 0 && !is_word_sep(job[i].start[-1]) && !is_word_sep(job[i].start[0])) {
+            total--;
+        }
+    }
+
+    munmap((void *) map, len);
+    *words = total;
+    return rc;
+}
+
+// -f with -j, each thread counts its range into a table of its own and the
+// tables are merged once they are done.  The ranges are cut at separators so
+// a word is never split between two threads
+typedef struct freq_job {
+    const char *start;
+    size_t len;
+    sf_freq_table_t table;
+    int rc;
+} freq_job_t;
+
+static void *freq_range(void *arg) {
+    freq_job_t *job = (freq_job_t *) arg;
+
+    job->rc = sf_freq_add_words(&job->table, job->start, job->len);
+    return NULL;
+}
+
+/*
+ *  sf_parallel_word_freq
+ *      path:  file to count the words of
+ *      jobs:  number of threads to use, 1 to MAX_JOBS
+ *      k:     how many of the most frequent words to print
+ *
+ *  returns:  0 on success, -1 if the file could not be read, memory ran out
+ *            or the threads could not be started
+ */
+int sf_parallel_word_freq(char *path, int jobs, long long k) {
+    size_t len = 0;
+    const char *map = map_input(path, &len);
+
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    jobs = jobs_for_size(jobs, len);
+    freq_job_t job[MAX_JOBS];
+    pthread_t tid[MAX_JOBS];
+    size_t rangeLen = len / jobs;
+    size_t cut = 0;
+    int started = 0;
+    int rc = 0;
+
+    for (int i = 0; i < jobs; i++) {
+        // move the end of the range forward to the next separator
+        size_t end = (i == jobs - 1) ? len : (i + 1) * rangeLen;
+        if (end < cut) {
+            end = cut;
+        }
+        while (end < len && !is_word_sep(map[end])) {
+            end++;
+        }
+
+        job[i].start = map + cut;
+        job[i].len = end - cut;
+        job[i].rc = sf_freq_init(&job[i].table);
+        cut = end;
+
+        if (job[i].rc < 0) {
+            rc = -1;
+            jobs = i + 1;
+            break;
+        }
+
+        // the last range is counted on this thread
+        if (i == jobs - 1) {
+            freq_range(&job[i]);
+        } else if (pthread_create(&tid[i], NULL, freq_range, &job[i]) != 0) {
+            perror("pthread_create");
+            rc = -1;
+            jobs = i + 1;
+            break;
+        } else {
+            started++;
+        }
+    }
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(tid[i], NULL);
+    }
+
+    // merge everything into the first table
+    for (int i = 0; i < jobs; i++) {
+        if (rc == 0 && job[i].rc < 0) {
+            rc = -1;
+        }
+        if (rc == 0 && i > 0) {
+            rc = sf_freq_merge(&job[0].table, &job[i].table);
+        }
+    }
+
+    if (rc == 0) {
+        rc = sf_freq_print_top(&job[0].table, k);
+    }
+
+    for (int i = 0; i < jobs; i++) {
+        sf_freq_free(&job[i].table);
+    }
+    if (map != NULL) {
+        munmap((void *) map, len);
+    }
+    return rc;
+}
@@ -0,0 +1,386 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stringfun.h"
+
+// UTF-8 mode (-u).  Words are separated by any Unicode white space, word
+// lengths count characters instead of bytes and -r reverses characters, not
+// bytes.  Input is checked with the utf8_valid kernel before it is used.
+//
+// Every operation here runs the plain byte code over the ASCII stretches of
+// the input, which the ascii_prefix kernel finds a vector at a time, and only
+// decodes the stretches in between.  Counting and reversing take ASCII runs
+// shorter than 8 bytes with the rest, mixed script text would otherwise cost
+// a kernel call every few bytes.  ASCII text goes through the same kernels
+// as without -u.
+
+// decodes the (valid) character at in, returns its length
+static size_t utf8_decode(const char *in, uint32_t *cp) {
+    const unsigned char *s = (const unsigned char *) in;
+
+    if (s[0] < 0x80) {
+        *cp = s[0];
+        return 1;
+    }
+    if (s[0] < 0xe0) {
+        *cp = ((uint32_t) (s[0] & 0x1f) << 6) | (s[1] & 0x3f);
+        return 2;
+    }
+    if (s[0] < 0xf0) {
+        *cp = ((uint32_t) (s[0] & 0x0f) << 12) | ((uint32_t) (s[1] & 0x3f) << 6) | (s[2] & 0x3f);
+        return 3;
+    }
+    *cp = ((uint32_t) (s[0] & 0x07) << 18) | ((uint32_t) (s[1] & 0x3f) << 12) | ((uint32_t) (s[2] & 0x3f) << 6) |
+          (s[3] & 0x3f);
+    return 4;
+}
+
+// are in[i..i+8) all ASCII, which makes handing them to a kernel worth it
+static inline bool ascii8(const char *in, size_t len, size_t i) {
+    uint64_t v;
+
+    if (len - i < 8) {
+        return false;
+    }
+    memcpy(&v, in + i, 8);
+    return (v & 0x8080808080808080ull) == 0;
+}
+
+// the White_Space characters of the Unicode character database
+static bool utf8_is_space(uint32_t cp) {
+    if (cp < 0x80) {
+        return is_word_sep((char) cp);
+    }
+    return cp == 0x85 || cp == 0xa0 || cp == 0x1680 || (cp >= 0x2000 && cp <= 0x200a) || cp == 0x2028 ||
+           cp == 0x2029 || cp == 0x202f || cp == 0x205f || cp == 0x3000;
+}
+
+// bytes of the separator at in[0], 0 if it is not one.  in holds whole
+// characters only
+static size_t utf8_sep_len(const char *in) {
+    uint32_t cp;
+
+    if ((unsigned char) in[0] < 0x80) {
+        return is_word_sep(in[0]);
+    }
+    size_t n = utf8_decode(in, &cp);
+    return utf8_is_space(cp) ? n : 0;
+}
+
+// characters in in[0..len), every byte that is not a continuation starts one
+static long long utf8_char_count(const char *in, size_t len) {
+    long long chars = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        chars += ((unsigned char) in[i] & 0xc0) != 0x80;
+    }
+    return chars;
+}
+
+// how much of in[0..len) is whole characters, a character cut off by the end
+// of a chunk is left for the next one
+static size_t utf8_complete_len(const char *in, size_t len) {
+    size_t start = len;
+
+    // back up to the start of the last character
+    while (start > 0 && len - start < 4) {
+        start--;
+        unsigned char c = (unsigned char) in[start];
+        if ((c & 0xc0) != 0x80) {
+            size_t need = (c < 0x80) ? 1 : (c < 0xe0) ? 2 : (c < 0xf0) ? 3 : 4;
+            return (len - start >= need) ? len : start;
+        }
+    }
+    return len;
+}
+
+// what a byte can be as far as finding words goes, every character but the
+// separators listed here is part of a word
+enum { CLS_WORD, CLS_SEP, CLS_CONT, CLS_MAYBE_SEP };
+
+static const unsigned char BYTE_CLASS[256] = {
+    ['\t'] = CLS_SEP, ['\n'] = CLS_SEP, ['\v'] = CLS_SEP, ['\f'] = CLS_SEP, ['\r'] = CLS_SEP, [' '] = CLS_SEP,
+    [0x80 ... 0xbf] = CLS_CONT,
+    // leads of the multibyte white space characters
+    [0xc2] = CLS_MAYBE_SEP, [0xe1] = CLS_MAYBE_SEP, [0xe2] = CLS_MAYBE_SEP, [0xe3] = CLS_MAYBE_SEP,
+};
+
+/*
+ *  sf_utf8_count_words
+ *      in, len:  whole characters of valid UTF-8
+ *      state:    carries whether the text before in ended inside a word
+ *
+ *  Continuation bytes leave the state alone, so outside the ASCII stretches
+ *  this is a byte at a time table lookup with no branch on the character's
+ *  length.  Only the few lead bytes a white space character can start with
+ *  are decoded.
+ *
+ *  returns:  the number of words that start in in
+ */
+long long sf_utf8_count_words(const char *in, size_t len, sf_scan_state_t *state) {
+    const sf_kernels_t *kernels = sf_kernels();
+    long long words = 0;
+    int inWord = state->inWord;
+    size_t i = 0;
+
+    while (i < len) {
+        // a stretch of at least 8 ASCII bytes goes to the kernels, anything
+        // shorter is cheaper to take a byte at a time
+        if (ascii8(in, len, i)) {
+            size_t ascii = kernels->ascii_prefix(in + i, len - i);
+            state->inWord = inWord;
+            words += kernels->count_words(in + i, ascii, state);
+            inWord = state->inWord;
+            i += ascii;
+            continue;
+        }
+
+        size_t end = (len - i > 64) ? i + 64 : len;
+        for (; i < end; i++) {
+            int cls = BYTE_CLASS[(unsigned char) in[i]];
+            int sep = (cls == CLS_SEP);
+            if (cls == CLS_MAYBE_SEP) {
+                sep = utf8_sep_len(in + i) != 0;
+            }
+            int start = (cls != CLS_CONT) & !sep;
+            words += start & !inWord;
+            inWord = (cls == CLS_CONT) ? inWord : start;
+        }
+    }
+
+    state->inWord = inWord;
+    return words;
+}
+
+// bytes in the character a lead byte starts, by its top four bits
+static const unsigned char CHAR_LEN[16] = { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 3, 4 };
+
+/*
+ *  sf_utf8_reverse
+ *      in, len:  whole characters of valid UTF-8
+ *      out:      receives them in reverse order, must not overlap in
+ *
+ *  ASCII stretches go through the reverse kernel.  Other characters are
+ *  moved with a fixed 4 byte copy that ends on the character's last byte,
+ *  the bytes in front of it land where later characters are about to go,
+ *  so nothing branches on a character's length.  The first and last few
+ *  bytes, where that copy would reach outside in or out, are copied exactly.
+ */
+void sf_utf8_reverse(const char *in, size_t len, char *out) {
+    const sf_kernels_t *kernels = sf_kernels();
+    size_t i = 0;
+
+    while (i < len) {
+        if (ascii8(in, len, i)) {
+            size_t ascii = kernels->ascii_prefix(in + i, len - i);
+            kernels->reverse_bytes(in + i, ascii, out + len - i - ascii);
+            i += ascii;
+            continue;
+        }
+
+        size_t n = CHAR_LEN[(unsigned char) in[i] >> 4];
+        if (i < 3 || len - i <= 4) {
+            memcpy(out + len - i - n, in + i, n);
+            i += n;
+            continue;
+        }
+
+        size_t end = (len - i > 68) ? i + 64 : len - 4;
+        while (i < end) {
+            uint32_t v;
+            n = CHAR_LEN[(unsigned char) in[i] >> 4];
+            memcpy(&v, in + i + n - 4, 4);
+            memcpy(out + len - i - 4, &v, 4);
+            i += n;
+        }
+    }
+}
+
+// sf_utf8_print_words() for a stretch of text, with the separator test and the
+// length of a word's bytes picked by ascii so ASCII can skip the decoding.
+// The state is kept in locals as the output writes could alias it
+static inline void print_words(sf_out_t *out, const char *in, size_t len, sf_word_print_t *st, bool ascii) {
+    long long words = st->words;
+    long long wordLen = st->wordLen;
+    int inWord = st->inWord;
+    size_t i = 0;
+    size_t n;
+
+    while (i < len) {
+        if (!inWord) {
+            while (i < len && (n = ascii ? is_word_sep(in[i]) : utf8_sep_len(in + i)) > 0) {
+                i += n;
+            }
+            if (i == len) {
+                break;
+            }
+            words++;
+            sf_out_ll(out, words);
+            sf_out_write(out, ". ", 2);
+            wordLen = 0;
+            inWord = 1;
+        }
+
+        size_t wordStart = i;
+        if (ascii) {
+            while (i < len && !is_word_sep(in[i])) {
+                i++;
+            }
+            wordLen += i - wordStart;
+        } else {
+            while (i < len && utf8_sep_len(in + i) == 0) {
+                i++;
+                while (i < len && ((unsigned char) in[i] & 0xc0) == 0x80) {
+                    i++;
+                }
+            }
+            wordLen += utf8_char_count(in + wordStart, i - wordStart);
+        }
+        sf_out_write(out, in + wordStart, i - wordStart);
+
+        if (i < len) {
+            sf_out_write(out, " (", 2);
+            sf_out_ll(out, wordLen);
+            sf_out_write(out, ")\n", 2);
+            inWord = 0;
+        }
+    }
+
+    st->words = words;
+    st->wordLen = wordLen;
+    st->inWord = inWord;
+}
+
+/*
+ *  sf_utf8_print_words
+ *      out:      sink to print to
+ *      in, len:  whole characters of valid UTF-8
+ *      st:       word printing state, carries a word on from the last call
+ *
+ *  Prints "N. word (chars)" lines like word_print().  A word still open at
+ *  the end of in is printed as far as it goes, sf_utf8_print_words_end() closes
+ *  it once the input is done.
+ */
+void sf_utf8_print_words(sf_out_t *out, const char *in, size_t len, sf_word_print_t *st) {
+    const sf_kernels_t *kernels = sf_kernels();
+    size_t i = 0;
+
+    while (i < len) {
+        size_t ascii = kernels->ascii_prefix(in + i, len - i);
+        print_words(out, in + i, ascii, st, true);
+        i += ascii;
+
+        size_t other = i;
+        while (other < len && (unsigned char) in[other] >= 0x80) {
+            other++;
+        }
+        print_words(out, in + i, other - i, st, false);
+        i = other;
+    }
+}
+
+// sf_utf8_print_words() for plain bytes, any byte that is not an ASCII
+// separator belongs to a word and lengths are in bytes
+void sf_byte_print_words(sf_out_t *out, const char *in, size_t len, sf_word_print_t *st) {
+    print_words(out, in, len, st, true);
+}
+
+// closes the word sf_utf8_print_words() or sf_byte_print_words() left open
+void sf_utf8_print_words_end(sf_out_t *out, sf_word_print_t *st) {
+    if (st->inWord) {
+        sf_out_write(out, " (", 2);
+        sf_out_ll(out, st->wordLen);
+        sf_out_write(out, ")\n", 2);
+        st->inWord = 0;
+    }
+}
+
+// reads the next chunk into buff after the carry bytes already at its front
+// and checks it.  Sets *len to the bytes now in buff and *atEnd at the end of
+// the input, and returns how many of them are whole characters, or -1 (after
+// printing why) on a read error or invalid UTF-8
+static long long read_utf8_chunk(int fd, char *buff, size_t carry, size_t *len, int *atEnd) {
+    ssize_t got = sf_read_chunk(fd, buff + carry, STREAM_CHUNK_SZ);
+
+    if (got < 0) {
+        perror("read");
+        return -1;
+    }
+
+    *len = carry + got;
+    *atEnd = (got == 0);
+    size_t whole = *atEnd ? *len : utf8_complete_len(buff, *len);
+
+    if (!sf_kernels()->utf8_valid(buff, whole)) {
+        fprintf(stderr, "input is not valid UTF-8\n");
+        return -1;
+    }
+    return (long long) whole;
+}
+
+// sf_stream_count_words() for UTF-8, a character cut off at the end of a chunk
+// is carried over to the next one
+int sf_stream_count_words_utf8(int fd, long long *words) {
+    char *buff = malloc(STREAM_CHUNK_SZ + 4);
+    sf_scan_state_t state = {0};
+    long long count = 0;
+    size_t carry = 0;
+    size_t len;
+    int atEnd = 0;
+    int rc = 0;
+
+    if (buff == NULL) {
+        return -1;
+    }
+
+    while (!atEnd) {
+        long long whole = read_utf8_chunk(fd, buff, carry, &len, &atEnd);
+        if (whole < 0) {
+            rc = -1;
+            break;
+        }
+        count += sf_utf8_count_words(buff, whole, &state);
+        carry = len - whole;
+        memmove(buff, buff + whole, carry);
+    }
+
+    free(buff);
+    *words = count;
+    return rc;
+}
+
+// sf_stream_word_print() for UTF-8, lengths are in characters
+int sf_stream_word_print_utf8(int fd) {
+    sf_out_t *out = sf_out_stdout();
+    char *buff = malloc(STREAM_CHUNK_SZ + 4);
+    sf_word_print_t st = {0};
+    size_t carry = 0;
+    size_t len;
+    int atEnd = 0;
+    int rc = 0;
+
+    if (buff == NULL) {
+        return -1;
+    }
+
+    sf_out_str(out, "Word Print\n----------\n");
+
+    while (!atEnd) {
+        long long whole = read_utf8_chunk(fd, buff, carry, &len, &atEnd);
+        if (whole < 0) {
+            rc = -1;
+            break;
+        }
+        sf_utf8_print_words(out, buff, whole, &st);
+        carry = len - whole;
+        memmove(buff, buff + whole, carry);
+    }
+    sf_utf8_print_words_end(out, &st);
+
+    free(buff);
+    if (sf_out_flush(out) < 0) {
+        rc = -1;
+    }
+    return rc;
+}
@@ -1,115 +1,194 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-
-
-#define BUFFER_SZ 50
-
-//prototypes
-void usage(char *);
-void print_buff(char *, int);
-int setup_buff(char *, char *, int);
-
-//prototypes for functions to handle required functionality
-int count_words(char *, int);
-void reverse_string(char*, int);
-void reverse_print(char*, int);
-void word_print(char*, int);
-void selection_print(char*, int, int);
-void search_and_replace(char*, int, char*, char*);
-int string_eq(char*, char*, int, int, int);
-int size_check(int, int, int, int); 
-int size_of_null_terminated_string(char*);
-void overwrite_buff_with_replacement(char*, int, int, char*, int);
-
-// sets up the buffer by copying over user string and returns string length
-int setup_buff(char *buff, char *user_str, int len){
-    
+#include <unistd.h>
+
+#include "stringfun.h"
+
+// sets up the buffer by copying over user string and returns string length.
+// runs of spaces and tabs are collapsed to their first character by the
+// whitespace kernel (see sfsimd.c), a block of the user string at a time.
+// the kernel counts the words in the same pass, they go in *word_count
+int setup_buff(char *buff, char *user_str, int len, int *word_count){
+    const sf_kernels_t *kernels = sf_kernels();
+    sf_scan_state_t state = {0};
+    long long words = 0;
+    char block[64];
     int userStringLength = 0;
-    int bufferIndex = 0;
-    int lastCharWhiteSpace = 0;
+    size_t remaining = strlen(user_str);
+
+    // a run of blanks right after the 50th character still makes the string
+    // too long, which is the case when the last blank of the input is dropped
+    int endsInDroppedBlank = remaining >= 2 &&
+        (user_str[remaining - 1] == ' ' || user_str[remaining - 1] == '\t') &&
+        (user_str[remaining - 2] == ' ' || user_str[remaining - 2] == '\t');
 
-    // while we haven't reached the null terminator in our user string
-    while (*user_str) {
+    while (remaining > 0) {
+        size_t blockLen = (remaining < sizeof(block)) ? remaining : sizeof(block);
+        size_t outLen = kernels->normalize_count(user_str, blockLen, block, &state, &words);
 
         // we exit program if the user's string is greater than 50 characters
-        if (userStringLength >= len) {
+        if (userStringLength + (int) outLen > len) {
             exit(-1);
         }
 
-        // combinations of last previous character and current character in terms of white space
-        // this is to see if we should be coping over whitespace or not
-        if (lastCharWhiteSpace && (*(user_str) == ' ' || *(user_str) == '\t')) {
-            user_str++;
-            continue;
-        }  else if (lastCharWhiteSpace && !(*(user_str) == ' ' || *(user_str) == '\t')) {
-            lastCharWhiteSpace = 0;
-            *(buff + (sizeof(char) * userStringLength)) = *(user_str);
-            userStringLength++;
-            user_str++;
-        } else if (!lastCharWhiteSpace && (*(user_str) == ' ' || *(user_str) == '\t')) {
-            lastCharWhiteSpace = 1;
-            *(buff + (sizeof(char) * userStringLength)) = *(user_str);
-            userStringLength++;
-            user_str++;
-        } else if (!lastCharWhiteSpace && !(*(user_str) == ' ' || *(user_str) == '\t')) {
-            lastCharWhiteSpace = 0;
-            *(buff + (sizeof(char) * userStringLength)) = *(user_str);
-            userStringLength++;
-            user_str++;
-        }
+        memcpy(buff + userStringLength, block, outLen);
+        userStringLength += outLen;
+        user_str += blockLen;
+        remaining -= blockLen;
     }
 
-    bufferIndex = userStringLength;
-
-    // while we haven't reached the end of our buffer
-    while (bufferIndex < len) {
-        *(buff + (sizeof(char) * bufferIndex)) = '.';
-        bufferIndex++;
+    if (userStringLength == len && endsInDroppedBlank) {
+        exit(-1);
     }
 
+    // pad the rest of our buffer
+    memset(buff + userStringLength, '.', len - userStringLength);
+
+    *word_count = (int) words;
     return userStringLength; 
 }
 
 void print_buff(char *buff, int len){
-    printf("Buffer:  ");
-    for (int i=0; i<len; i++){
-        putchar(*(buff+i));
-    }
-    putchar('\n');
+    sf_out_t *out = sf_out_stdout();
+
+    sf_out_str(out, "Buffer:  ");
+    sf_out_write(out, buff, len);
+    sf_out_byte(out, '\n');
+    sf_out_flush(out);
 }
 
 void usage(char *exename){
-    printf("usage: %s [-h|c|r|w|x] \"string\" [other args]\n", exename);
+    printf("usage: %s [-h|c|r|w|x|e] \"string\" [other args]\n", exename);
+    printf("       %s [-c|r|w|x|e] %s file|%s [other args]\n", exename, STREAM_FLAG, STDIN_NAME);
+    printf("           streams a file (or stdin) of any size, -r and -x print only the new text\n");
+    printf("           add %s to -r to reverse the order of the lines instead\n", LINES_FLAG);
+    printf("       add %s to -c, -r or -w to work on UTF-8 characters instead of bytes\n", UTF8_FLAG);
+    printf("           add %s to -x to replace the target inside words too\n", SUBSTR_FLAG);
+    printf("       -e pattern finds the regular expression, streaming prints the lines it is on\n");
+    printf("       %s -x target replacement %s [%s N] file... [%s dir]...\n", exename, IN_PLACE_FLAG, JOBS_FLAG,
+           RECURSIVE_FLAG);
+    printf("           rewrites the files, and every file under each dir, on N threads\n");
+    printf("       %s -X rules.txt file|%s\n", exename, STDIN_NAME);
+    printf("           applies every target<TAB>replacement line of rules.txt in one pass\n");
+    printf("       %s -f [%s K] file|%s\n", exename, TOPK_FLAG, STDIN_NAME);
+    printf("           prints the K (default %d) most frequent words\n", TOPK_DEFAULT);
+    printf("       %s -c|f %s N [%s K] file\n", exename, JOBS_FLAG, TOPK_FLAG);
+    printf("           counts the words of a file on N threads\n");
+}
 
+// removes flag (SUBSTR_FLAG, UTF8_FLAG) from the args after the option,
+// returns whether it was there
+bool parse_flag(int *argc, char *argv[], const char *flag){
+    bool found = false;
+    int kept = 2;
+
+    for (int i = 2; i < *argc; i++){
+        if (strcmp(argv[i], flag) == 0){
+            found = true;
+        } else {
+            argv[kept++] = argv[i];
+        }
+    }
+
+    argv[kept] = NULL;
+    *argc = kept;
+    return found;
 }
 
-// counts words, returns the number of words in user string from buffer
-int count_words(char *buff, int str_len){
-    
-    int words = 0;
-    int buffIndex = 0;
+// removes "TOPK_FLAG K" from the args after the option, returns K, the
+// default if it was not there or -1 if K is not a number
+long long parse_topk_flag(int *argc, char *argv[]){
+    long long k = TOPK_DEFAULT;
+    int kept = 2;
+
+    for (int i = 2; i < *argc; i++){
+        if (strcmp(argv[i], TOPK_FLAG) == 0 && i + 1 < *argc){
+            char *end;
+            k = strtoll(argv[++i], &end, 10);
+            if (*end != '\0' || k < 0){
+                k = -1;
+            }
+        } else {
+            argv[kept++] = argv[i];
+        }
+    }
 
-    // if we know the string length was zero, we can immediately return to make other logic easier
-    if (str_len == 0) {
-        printf("Word Count: %d\n", words);
-        return 0;
+    argv[kept] = NULL;
+    *argc = kept;
+    return k;
+}
+
+// stream mode, argv[3] names the input instead of argv[2] holding it and
+// any other args move along by one.  returns the exit code
+int run_stream_mode(char opt, int argc, char *argv[], bool substr, bool utf8){
+    long long words;
+    int rc;
+
+    bool lines = (opt == 'r' && argc == 5 && strcmp(argv[4], LINES_FLAG) == 0);
+
+    if (argc < 4 || (opt == 'x' && argc != 6) || (opt == 'e' && argc != 5) || (opt == 'r' && argc != 4 && !lines)){
+        usage(argv[0]);
+        return 1;
     }
 
-    // while we are in range of the user string, check for white space and increment a counter every white space
-    for (int i = 0; i < str_len; i++) {
-        if (*(buff + (sizeof(char) * i)) == ' ' && i != 0 && i != str_len-1) {
-            words++;
-        }
-        buffIndex = i;
+    int fd = sf_stream_open(argv[3]);
+    if (fd < 0){
+        return 2;
     }
 
-    // increment one last time at the end of the word
-    if (*(buff + (sizeof(char) * (buffIndex + 1))) == '.') {
-        words++;
+    switch (opt){
+        case 'c':
+            rc = utf8 ? sf_stream_count_words_utf8(fd, &words) : sf_stream_count_words(fd, &words);
+            if (rc == 0){
+                printf("Word Count: %lld\n", words);
+            }
+            break;
+
+        case 'r':
+            rc = sf_stream_reverse(fd, lines, utf8);
+            break;
+
+        case 'w':
+            rc = utf8 ? sf_stream_word_print_utf8(fd) : sf_stream_word_print(fd);
+            break;
+
+        case 'x':
+            rc = sf_stream_search_and_replace(fd, argv[4], argv[5], substr);
+            break;
+
+        case 'e': {
+            sf_regex_t *re = sf_regex_compile(argv[4]);
+            if (re == NULL){
+                close(fd);
+                return 1;
+            }
+            rc = sf_stream_regex_search(fd, re);
+            sf_regex_free(re);
+            break;
+        }
+
+        default:
+            usage(argv[0]);
+            close(fd);
+            return 1;
     }
 
-    return words;
+    close(fd);
+    fflush(stdout);
+    return (rc < 0) ? 2 : 0;
+}
+
+// counts words, returns the number of words in user string from buffer.
+// a word is any run of non whitespace, counted by the whitespace kernel.
+// main() takes the count setup_buff() made instead of scanning again
+int count_words(char *buff, int str_len){
+    return (int) sf_count_words(buff, str_len, 0);
+}
+
+// count_words() for -u, separators include the Unicode white space
+int count_words_utf8(char *buff, int str_len){
+    return (int) sf_count_words(buff, str_len, SF_UTF8);
 }
 
 // reverses the string in place using a two pointer approach on the buffer
@@ -127,55 +206,55 @@ void reverse_string(char* buff, int str_len) {
     }
 }
 
+// reverse_string() for -u, characters keep their bytes in order
+void reverse_string_utf8(char* buff, int str_len) {
+    char reversed[BUFFER_SZ];
+
+    sf_utf8_reverse(buff, str_len, reversed);
+    memcpy(buff, reversed, str_len);
+}
+
 // special print function for reverse print
 // buff is not null terminated so we need to print up to a back limit
 void reverse_print(char* buff, int print_len) {
-    for (int i = 0; i < print_len; i++) {
-        printf("%c", *(buff + (sizeof(char) * i)));
-    }
-    printf("\n");
+    sf_out_t *out = sf_out_stdout();
+
+    sf_out_write(out, buff, print_len);
+    sf_out_byte(out, '\n');
+    sf_out_flush(out);
 }
 
 // similar to reverse print except this prints a portion of a string from
 // one part to another so we don't need to modify buff to print individual words
+// goes through the output sink, the caller flushes it
 void selection_print(char* buff, int start_index, int end_index) {
-    for (int i = start_index; i < end_index; i++) {
-        printf("%c", *(buff + (sizeof(char) * i)));
+    if (end_index > start_index) {
+        sf_out_write(sf_out_stdout(), buff + start_index, end_index - start_index);
     }
 }
 
-// prints words and their lengths on new lines
+// prints words and their lengths on new lines. words are split on the
+// same whitespace count_words() counts them by, so -w lists as many as -c
 void word_print(char* buff, int str_len) {
-    int words = 0;
-    int buffIndex = 0;
-    int wordStart = 0;
-    int wordEnd = 0;
-
-    printf("Word Print\n----------\n");
+    sf_out_t *out = sf_out_stdout();
+    sf_word_print_t st = {0};
 
-    // same logic as word count, except we keep track of the beginning of the word and end
-    // based on index so we can use selection print each time we reach a new word
-    for (int i = 0; i < str_len; i++) {
-        if (*(buff + (sizeof(char) * i)) == ' ' && i != 0 && i != str_len-1) {
-            words++;
-
-            printf("%d. ", words);
-            selection_print(buff, wordStart, wordEnd);
-            printf(" (%d)\n", wordEnd - wordStart);
+    sf_out_str(out, "Word Print\n----------\n");
+    sf_byte_print_words(out, buff, str_len, &st);
+    sf_utf8_print_words_end(out, &st);
+    sf_out_flush(out);
+}
 
-            wordStart = wordEnd + 1;
-        }
-        buffIndex = i;
-        wordEnd++;
-    }
+// word_print() for -u, any Unicode white space separates words and the
+// lengths are in characters
+void word_print_utf8(char* buff, int str_len) {
+    sf_out_t *out = sf_out_stdout();
+    sf_word_print_t st = {0};
 
-    // print one more time for last word in the string
-    if (*(buff + (sizeof(char) * (buffIndex + 1))) == '.') {
-        words++;
-        printf("%d. ", words);
-        selection_print(buff, wordStart, wordEnd);
-        printf(" (%d)\n", wordEnd - wordStart);
-    }
+    sf_out_str(out, "Word Print\n----------\n");
+    sf_utf8_print_words(out, buff, str_len, &st);
+    sf_utf8_print_words_end(out, &st);
+    sf_out_flush(out);
 }
 
 // calculate if a section of buffer equals a null terminated string
@@ -216,103 +295,181 @@ int size_check(int bufferSize, int targetSize, int replacementSize, int str_len)
     }
 }
 
-// creates temp buff with the original buff up to replacement, replacement gets added, then the rest of original buffer. 
-// original buffer is then overwritten with temp buff to have replaced word
-void overwrite_buff_with_replacement(char* buff, int startIndex, int endIndex, char* replacement, int replacementLength) {
-    char* tempBuff = malloc(BUFFER_SZ * sizeof(char)); // Allocate memory for temp buffer
+// replaces every occurrence of target word with replacement assuming buffer size is not exceeded by operation
+// otherwise operation is voided. does nothing is no matches were found.
+// with substr set the target is matched anywhere, not just as a whole word
+void search_and_replace(char* buff, int str_len, char* target, char* replacement, bool substr) {
+    int targetSize = size_of_null_terminated_string(target);
+    int replacementSize = size_of_null_terminated_string(replacement);
+    int newUserStringLength = str_len;
+    sf_out_t *out = sf_out_stdout();
+
+    sf_out_str(out, "Word Search and Replace\n-----------------------\n");
+
+    // the library builds the new string straight into replaced in one pass, then it
+    // is padded back into buff if it fits
+    char replaced[BUFFER_SZ];
+    long long matches = 0;
+    long long outLen = sf_search_and_replace(buff, str_len, target, targetSize, replacement, replacementSize, -1,
+                                             replaced, sizeof(replaced), substr ? SF_SUBSTR : 0, &matches);
+
+    if (matches > 0 && outLen <= BUFFER_SZ) {
+        memcpy(buff, replaced, outLen);
+        memset(buff + outLen, '.', BUFFER_SZ - outLen);
+        newUserStringLength = (int) outLen;
+    }
+
+    sf_out_str(out, "Modified String: ");
+    sf_out_write(out, buff, newUserStringLength);
+    sf_out_byte(out, '\n');
+    sf_out_flush(out);
+}
+
+// tells whether the string has a match of the regular expression pattern,
+// returns -1 if pattern is not valid
+int regex_search(char* buff, int str_len, char* pattern) {
+    sf_regex_t *re = sf_regex_compile(pattern);
+    sf_out_t *out = sf_out_stdout();
+
+    if (re == NULL) {
+        return -1;
+    }
+
+    sf_out_str(out, "Pattern Search\n--------------\n");
+    sf_out_str(out, sf_regex_line_matches(re, buff, str_len) ? "Pattern Found\n" : "Pattern Not Found\n");
+    sf_out_flush(out);
+    sf_regex_free(re);
+    return 0;
+}
+
+// multi-threaded mode, argv[3] is the number of threads and argv[4] the file.
+// returns the exit code
+int run_jobs_mode(char opt, int argc, char *argv[], long long topK){
+    long long words;
+    int jobs;
+    int rc;
 
-    int buffIndex = 0;      // tracks position in the original buffer
-    int tempBuffIndex = 0;  // tracks position in the temp buffer
+    if (argc != 5){
+        usage(argv[0]);
+        return 1;
+    }
 
-    // start by loading up the temp buffer with buffer values before target word
-    while (buffIndex < startIndex && tempBuffIndex < BUFFER_SZ) {
-        *(tempBuff + tempBuffIndex) = *(buff + buffIndex);
-        tempBuffIndex++;
-        buffIndex++;
+    jobs = atoi(argv[3]);
+    if (jobs < 1 || jobs > MAX_JOBS){
+        printf("Number of threads must be 1 to %d\n", MAX_JOBS);
+        return 1;
     }
 
-    // load replacement values from replacement into temp buff 
-    for (int i = 0; i < replacementLength && tempBuffIndex < BUFFER_SZ; i++) {
-        *(tempBuff + tempBuffIndex) = *(replacement + i);
-        tempBuffIndex++;
+    switch (opt){
+        case 'c':
+            rc = sf_parallel_count_words(argv[4], jobs, &words);
+            if (rc == 0){
+                printf("Word Count: %lld\n", words);
+            }
+            break;
+
+        case 'f':
+            rc = sf_parallel_word_freq(argv[4], jobs, topK);
+            break;
+
+        default:
+            usage(argv[0]);
+            return 1;
     }
 
-    buffIndex = endIndex;
+    fflush(stdout);
+    return (rc < 0) ? 2 : 0;
+}
 
-    // add the rest of the buffer after replacement to temp buffer
-    while (buffIndex < BUFFER_SZ && tempBuffIndex < BUFFER_SZ) {
-        *(tempBuff + tempBuffIndex) = *(buff + buffIndex);
-        tempBuffIndex++;
-        buffIndex++;
+// multi-pattern mode, argv[2] is the rules file and argv[3] the input.
+// returns the exit code
+int run_rules_mode(int argc, char *argv[]){
+    if (argc != 4){
+        usage(argv[0]);
+        return 1;
     }
 
-    // fill the rest of tempBuff with null '.' to maintain the buffer size if the replacement was smaller
-    while (tempBuffIndex < BUFFER_SZ) {
-        *(tempBuff + tempBuffIndex) = '.';
-        tempBuffIndex++;
+    sf_rules_t *rules = sf_rules_load(argv[2]);
+    if (rules == NULL){
+        return 1;
     }
 
-    // overwrite the original buffer in place with our temporary one
-    for (int i = 0; i < BUFFER_SZ; i++) {
-        *(buff + i) = *(tempBuff + i);
+    int fd = sf_stream_open(argv[3]);
+    if (fd < 0){
+        sf_rules_free(rules);
+        return 2;
     }
 
-    // free the memory cause that is good 'n stuff 'n yeah :D
-    free(tempBuff);
+    int rc = sf_stream_rules_replace(fd, rules);
+
+    close(fd);
+    sf_rules_free(rules);
+    fflush(stdout);
+    return (rc < 0) ? 2 : 0;
 }
 
+// word frequency mode, argv[2] is the input.  returns the exit code
+int run_freq_mode(int argc, char *argv[], long long topK){
+    if (argc != 3){
+        usage(argv[0]);
+        return 1;
+    }
 
-// replaces first occurrence of target word with replacement assuming buffer size is not exceeded by operation
-// otherwise operation is voided. does nothing is no matches were found.
-void search_and_replace(char* buff, int str_len, char* target, char* replacement) {
-    int words = 0;
-    int buffIndex = 0;
-    int wordStart = 0;
-    int wordEnd = 0;
-
-    printf("Word Search and Replace\n-----------------------\n");
-
-    // same functionality as word print except we do not use selection_print
-    // instead we use helpers to make sure we found a word equal to our target.
-    // and that we can replace without exceeding buffer. then we call the overwrite function
-    // the structure is otherwise identical
-    for (int i = 0; i < str_len; i++) {
-        if (*(buff + (sizeof(char) * i)) == ' ' && i != 0 && i != str_len-1) {
-            words++;
-            int targetSize = size_of_null_terminated_string(target);
-            int replacementSize = size_of_null_terminated_string(replacement);
-
-            if (size_check(BUFFER_SZ, targetSize, replacementSize, str_len)) {
-                if (string_eq(buff, target, wordStart, (wordEnd - wordStart), targetSize)) {
-                    overwrite_buff_with_replacement(buff, wordStart, wordEnd, replacement, replacementSize);
-                }
-            } 
-
-            wordStart = wordEnd + 1;
-        }
-        buffIndex = i;
-        wordEnd++;
+    int fd = sf_stream_open(argv[2]);
+    if (fd < 0){
+        return 2;
     }
 
-    if (*(buff + (sizeof(char) * (buffIndex + 1))) == '.') {
-        words++;
-        int targetSize = size_of_null_terminated_string(target);
-        int replacementSize = size_of_null_terminated_string(replacement);
-        if (size_check(BUFFER_SZ, targetSize, replacementSize, str_len)) {
-            if (string_eq(buff, target, wordStart, (wordEnd - wordStart), targetSize)) {
-                overwrite_buff_with_replacement(buff, wordStart, wordEnd, replacement, replacementSize);
+    int rc = sf_stream_word_freq(fd, topK);
+
+    close(fd);
+    fflush(stdout);
+    return (rc < 0) ? 2 : 0;
+}
+
+// in place mode, argv[2] and argv[3] are the target and replacement and the
+// rest name the files: "-R dir" adds everything under dir and "-j N" sets the
+// number of threads.  returns the exit code
+int run_in_place_mode(int argc, char *argv[], bool substr){
+    sf_file_list_t list = {0};
+    sf_inplace_stats_t stats;
+    sf_searcher_t searcher;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int jobs = (cpus < 1) ? 1 : (cpus > MAX_JOBS) ? MAX_JOBS : (int) cpus;
+    int listed = 0;
+
+    if (argc < 5 || argv[2][0] == '\0'){
+        usage(argv[0]);
+        return 1;
+    }
+
+    for (int i = 4; i < argc; i++){
+        if (strcmp(argv[i], JOBS_FLAG) == 0 && i + 1 < argc){
+            jobs = atoi(argv[++i]);
+            if (jobs < 1 || jobs > MAX_JOBS){
+                printf("Number of threads must be 1 to %d\n", MAX_JOBS);
+                sf_file_list_free(&list);
+                return 1;
             }
-        } 
+        } else if (strcmp(argv[i], RECURSIVE_FLAG) == 0 && i + 1 < argc){
+            listed |= sf_file_list_add_dir(&list, argv[++i]);
+        } else {
+            listed |= sf_file_list_add(&list, argv[i]);
+        }
     }
 
-    int newUserStringLength = str_len - size_of_null_terminated_string(target) + size_of_null_terminated_string(replacement);
+    //a file that could not be listed is reported and the rest still done
+    sf_searcher_init(&searcher, argv[2], strlen(argv[2]), substr ? SF_MATCH_SUBSTR : SF_MATCH_WORD);
+    int rc = sf_inplace_replace(&list, jobs, &searcher, argv[3], strlen(argv[3]), &stats);
 
-    printf("Modified String: ");
-    for (int i = 0; i < newUserStringLength; i++) {
-        printf("%c", *(buff + i));
+    printf("Replaced %lld matches in %lld of %lld files\n", stats.matches, stats.changed, stats.files);
+    if (stats.failed > 0){
+        printf("%lld files could not be rewritten\n", stats.failed);
     }
-    printf("\n");
 
+    sf_file_list_free(&list);
+    fflush(stdout);
+    return (rc < 0 || listed < 0) ? 2 : 0;
 }
 
 int main(int argc, char *argv[]){
@@ -320,8 +477,13 @@ int main(int argc, char *argv[]){
     char *buff;             
     char *input_string;     
     char opt;               
+    bool substr;
+    bool inPlace;
+    bool utf8;
+    long long topK = TOPK_DEFAULT;
     int  rc;                
     int  user_str_len;      
+    int  word_count;
 
     //TODO:  #1. WHY IS THIS SAFE, aka what if arv[1] does not exist?
     /* ANSWER: this is safe beecause if argv[1] doesn't exist then we won't know what option the
@@ -344,6 +506,19 @@ int main(int argc, char *argv[]){
     }
 
 
+    substr = parse_flag(&argc, argv, SUBSTR_FLAG);
+    utf8 = parse_flag(&argc, argv, UTF8_FLAG);
+    inPlace = parse_flag(&argc, argv, IN_PLACE_FLAG);
+
+    //only -f takes a count, anything else keeps "-k" as an arg
+    if (opt == 'f'){
+        topK = parse_topk_flag(&argc, argv);
+        if (topK < 0){
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+
     //TODO:  #2 Document the purpose of the if statement below
     /* ANSWER: This is to check for the amount of arguments passed into the program at run time.
                 we want to make sure that at least three are passed in (program name, flag/option and string).
@@ -355,6 +530,35 @@ int main(int argc, char *argv[]){
         exit(1);
     }
 
+    //-x --in-place rewrites files instead of the string
+    if (inPlace){
+        if (opt != 'x'){
+            usage(argv[0]);
+            exit(1);
+        }
+        exit(run_in_place_mode(argc, argv, substr));
+    }
+
+    //-X always streams, its args are the rules and the input
+    if (opt == 'X'){
+        exit(run_rules_mode(argc, argv));
+    }
+
+    //-f works on a file or stdin, -j is handled with the other jobs modes
+    if (opt == 'f' && strcmp(argv[2], JOBS_FLAG) != 0){
+        exit(run_freq_mode(argc, argv, topK));
+    }
+
+    //stream mode works on a file or stdin instead of a string
+    if (strcmp(argv[2], STREAM_FLAG) == 0){
+        exit(run_stream_mode(opt, argc, argv, substr, utf8));
+    }
+
+    //so does multi-threaded mode
+    if (strcmp(argv[2], JOBS_FLAG) == 0){
+        exit(run_jobs_mode(opt, argc, argv, topK));
+    }
+
     input_string = argv[2]; 
 
     //TODO:  #3 Allocate space for the buffer using malloc and
@@ -368,15 +572,22 @@ int main(int argc, char *argv[]){
         exit(99);
     }
 
-    user_str_len = setup_buff(buff, input_string, BUFFER_SZ);
+    user_str_len = setup_buff(buff, input_string, BUFFER_SZ, &word_count);
     if (user_str_len < 0){
         printf("Error setting up buffer, error = %d", user_str_len);
         exit(2);
     }
 
+    //-u needs the string to be UTF-8 before anything decodes it
+    if (utf8 && !sf_kernels()->utf8_valid(buff, user_str_len)){
+        printf("Error setting up buffer, string is not valid UTF-8\n");
+        exit(2);
+    }
+
     switch (opt){
         case 'c':
-            rc = count_words(buff, user_str_len); 
+            // setup_buff() already counted the words, -u needs its own separators
+            rc = utf8 ? count_words_utf8(buff, user_str_len) : word_count;
             if (rc < 0){
                 printf("Error counting words, rc = %d", rc);
                 exit(2);
@@ -385,13 +596,21 @@ int main(int argc, char *argv[]){
             break;
 
         case 'r':
-            reverse_string(buff, user_str_len);
+            if (utf8) {
+                reverse_string_utf8(buff, user_str_len);
+            } else {
+                reverse_string(buff, user_str_len);
+            }
             printf("Reversed String: ");
             reverse_print(buff, user_str_len);
             break;
 
         case 'w':
-            word_print(buff, user_str_len);
+            if (utf8) {
+                word_print_utf8(buff, user_str_len);
+            } else {
+                word_print(buff, user_str_len);
+            }
             break;
 
         case 'x':
@@ -399,7 +618,17 @@ int main(int argc, char *argv[]){
                 usage(argv[0]);
                 exit(-1);
             }
-            search_and_replace(buff, user_str_len, *(argv + 3), *(argv + 4));
+            search_and_replace(buff, user_str_len, *(argv + 3), *(argv + 4), substr);
+            break;
+
+        case 'e':
+            if (argc != 4) {
+                usage(argv[0]);
+                exit(1);
+            }
+            if (regex_search(buff, user_str_len, argv[3]) < 0) {
+                exit(1);
+            }
             break;
 
         default:
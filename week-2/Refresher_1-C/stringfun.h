@@ -0,0 +1,340 @@
+#ifndef __STRINGFUN_H__
+    #define __STRINGFUN_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "libstringfun.h"
+
+#define BUFFER_SZ 50
+
+//stream mode, "stringfun -c -s file" works on a file (or "-" for stdin) of
+//any size instead of a string in argv, reading it STREAM_CHUNK_SZ bytes at
+//a time so memory use stays constant
+#define STREAM_FLAG     "-s"
+#define STDIN_NAME      "-"
+#define STREAM_CHUNK_SZ (1024 * 1024)
+
+//-u anywhere after the option treats the input as UTF-8 for -c, -r and -w:
+//any Unicode white space separates words, lengths are in characters and -r
+//reverses characters
+#define UTF8_FLAG       "-u"
+
+//"stringfun -r -s file|- -l" reverses the order of the lines instead of
+//the bytes, like tac
+#define LINES_FLAG      "-l"
+
+//"stringfun -c -j N file" splits a mapped file across N threads, ranges are
+//never made smaller than JOBS_MIN_RANGE_SZ
+#define JOBS_FLAG           "-j"
+#define MAX_JOBS            256
+#define JOBS_MIN_RANGE_SZ   (64 * 1024)
+
+//-x replaces whole words, adding SUBSTR_FLAG anywhere after the option makes
+//it replace the target wherever it appears, even inside a word
+#define SUBSTR_FLAG     "-a"
+
+//"stringfun -x target replacement --in-place [-j N] file... [-R dir]..."
+//rewrites the files (and every regular file under each dir) in place on N
+//threads, one per CPU by default
+#define IN_PLACE_FLAG   "--in-place"
+#define RECURSIVE_FLAG  "-R"
+
+//"stringfun -X rules.txt file|-" applies every target<TAB>replacement rule in
+//the file in one pass.  Rules match anywhere, leftmost-longest
+#define RULE_LINE_SZ    4096
+
+//"stringfun -f [-k K] file|-" prints the K most frequent words, with -j the
+//file is split across threads as for -c
+#define TOPK_FLAG       "-k"
+#define TOPK_DEFAULT    10
+
+//prototypes
+void usage(char *);
+bool parse_flag(int *, char *[], const char *);
+int run_stream_mode(char, int, char *[], bool, bool);
+long long parse_topk_flag(int *, char *[]);
+int run_jobs_mode(char, int, char *[], long long);
+int run_rules_mode(int, char *[]);
+int run_freq_mode(int, char *[], long long);
+int run_in_place_mode(int, char *[], bool);
+void print_buff(char *, int);
+int setup_buff(char *, char *, int, int *);
+
+//prototypes for functions to handle required functionality
+int count_words(char *, int);
+int count_words_utf8(char *, int);
+void reverse_string(char*, int);
+void reverse_string_utf8(char*, int);
+void reverse_print(char*, int);
+void word_print(char*, int);
+void word_print_utf8(char*, int);
+void selection_print(char*, int, int);
+void search_and_replace(char*, int, char*, char*, bool);
+int regex_search(char*, int, char*);
+int string_eq(char*, char*, int, int, int);
+int size_check(int, int, int, int);
+int size_of_null_terminated_string(char*);
+
+//words in stream mode are separated by any of these, a string in argv never
+//has line breaks so for it this is the same as space and tab
+static inline bool is_word_sep(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+//whitespace kernels, see sfsimd.c.  The state carries what the next block
+//needs to know about the byte before it, zero it before the first block
+typedef struct sf_scan_state {
+    int inWord;         //the previous byte was part of a word
+    int prevBlank;      //the previous byte was a space or tab
+} sf_scan_state_t;
+
+typedef struct sf_kernels {
+    const char *name;
+    //number of words that start in in[0..len)
+    long long (*count_words)(const char *in, size_t len, sf_scan_state_t *state);
+    //copies in to out collapsing runs of spaces and tabs to their first byte
+    //like setup_buff(), adds the words that start in in to *words and returns
+    //the bytes written.  out must have room for len bytes
+    size_t (*normalize_count)(const char *in, size_t len, char *out, sf_scan_state_t *state,
+                              long long *words);
+    //out[i] = in[len - 1 - i], in and out must not overlap
+    void (*reverse_bytes)(const char *in, size_t len, char *out);
+    //length of the run of ASCII bytes in[] starts with
+    size_t (*ascii_prefix)(const char *in, size_t len);
+    //1 if in[0..len) is complete, valid UTF-8
+    int (*utf8_valid)(const char *in, size_t len);
+} sf_kernels_t;
+
+#define SF_KERNEL_ENV   "STRINGFUN_KERNEL"  //force "scalar", "sse2" or "avx2"
+
+const sf_kernels_t *sf_kernels(void);
+const sf_kernels_t *sf_kernels_by_name(const char *name);
+
+//output sink, see sfout.c
+#define SF_OUT_SZ   (64 * 1024)
+
+typedef struct sf_out {
+    int fd;                 //-1 for a memory sink
+    char *buff;
+    size_t len;
+    size_t cap;             //0 writes everything straight to fd
+    int err;                //a write failed, the rest is dropped
+    size_t over;            //bytes a memory sink had no room for
+} sf_out_t;
+
+void sf_out_init(sf_out_t *out, int fd, char *buff, size_t cap);
+void sf_out_init_mem(sf_out_t *out, char *buff, size_t cap);
+size_t sf_out_mem_len(const sf_out_t *out);
+sf_out_t *sf_out_stdout(void);
+int sf_out_flush(sf_out_t *out);
+void sf_out_write_slow(sf_out_t *out, const char *src, size_t len);
+void sf_out_str(sf_out_t *out, const char *s);
+void sf_out_ll(sf_out_t *out, long long n);
+
+//the common case, room in the buffer, is a memcpy inlined at the caller
+static inline void sf_out_write(sf_out_t *out, const char *src, size_t len) {
+    if (out->len + len <= out->cap) {
+        memcpy(out->buff + out->len, src, len);
+        out->len += len;
+    } else {
+        sf_out_write_slow(out, src, len);
+    }
+}
+
+static inline void sf_out_byte(sf_out_t *out, char c) {
+    sf_out_write(out, &c, 1);
+}
+
+//stream mode, see sfstream.c
+ssize_t sf_read_chunk(int fd, char *buff, size_t len);
+int sf_stream_open(char *path);
+int sf_stream_count_words(int fd, long long *words);
+int sf_stream_word_print(int fd);
+int sf_stream_reverse(int fd, bool lines, bool utf8);
+int sf_stream_search_and_replace(int fd, char *target, char *replacement, bool substr);
+
+//literal search engine, see sfsearch.c.  Needles at least this long use
+//Boyer-Moore-Horspool, shorter ones a memchr() scan for their first byte
+#define SF_HORSPOOL_MIN_LEN 8
+
+typedef enum {
+    SF_MATCH_WORD,      //only where the needle is a whole word
+    SF_MATCH_SUBSTR     //anywhere, even inside a word
+} sf_match_mode_t;
+
+typedef struct sf_searcher {
+    const char *needle;
+    size_t len;
+    sf_match_mode_t mode;
+    bool useHorspool;
+    size_t shift[256];  //Horspool skip for the byte under the needle's end
+} sf_searcher_t;
+
+void sf_searcher_init(sf_searcher_t *s, const char *needle, size_t len, sf_match_mode_t mode);
+const char *sf_search(const sf_searcher_t *s, const char *hay, size_t len, size_t from,
+                      bool startBoundary, bool endBoundary);
+size_t sf_replace(const sf_searcher_t *s, const char *in, size_t len, const char *replacement,
+                  size_t replacementLen, long long maxMatches, char *out, size_t outCap, long long *matches);
+long long sf_replace_out(const sf_searcher_t *s, const char *in, size_t len, const char *replacement,
+                         size_t replacementLen, sf_out_t *out);
+
+//UTF-8 mode, see sfutf8.c
+typedef struct sf_word_print {
+    long long words;        //printed so far
+    long long wordLen;      //characters in the open word so far
+    int inWord;
+} sf_word_print_t;
+
+long long sf_utf8_count_words(const char *in, size_t len, sf_scan_state_t *state);
+void sf_utf8_reverse(const char *in, size_t len, char *out);
+void sf_utf8_print_words(sf_out_t *out, const char *in, size_t len, sf_word_print_t *st);
+void sf_byte_print_words(sf_out_t *out, const char *in, size_t len, sf_word_print_t *st);
+void sf_utf8_print_words_end(sf_out_t *out, sf_word_print_t *st);
+int sf_stream_count_words_utf8(int fd, long long *words);
+int sf_stream_word_print_utf8(int fd);
+
+//multi-pattern replace, see sfrules.c
+typedef struct sf_rule {
+    char *target;           //the replacement is stored right after it
+    size_t targetLen;
+    char *replacement;
+    size_t replacementLen;
+} sf_rule_t;
+
+typedef struct sf_rules {
+    sf_rule_t *rule;
+    int count;
+    int capacity;
+    size_t maxLen;          //longest target
+    //Aho-Corasick automaton, a row of numClasses transitions per state
+    unsigned char byteClass[256];
+    int numClasses;
+    int numStates;
+    int *next;
+    int *depth;             //length of the text a state stands for
+    int *match;             //rule whose target ends at the state, or -1
+    int *outLink;           //nearest failure state with a match, or -1
+} sf_rules_t;
+
+sf_rules_t *sf_rules_load(char *path);
+void sf_rules_free(sf_rules_t *rules);
+int sf_stream_rules_replace(int fd, const sf_rules_t *rules);
+
+//regular expressions, see sfregex.c.  The pattern is compiled to an NFA
+//program, which a DFA built on demand runs
+typedef enum { RE_BYTE_SET, RE_SPLIT, RE_BOL, RE_EOL, RE_MATCH } sf_re_op_t;
+
+typedef struct sf_re_inst {
+    sf_re_op_t op;
+    int x;                  //byte set for RE_BYTE_SET, else the next pc
+    int y;                  //next pc for RE_BYTE_SET, other branch of RE_SPLIT
+} sf_re_inst_t;
+
+typedef struct sf_regex {
+    sf_re_inst_t *inst;
+    int numInsts;
+    int start;
+    uint64_t (*set)[4];     //256 bit byte sets
+    int numSets;
+    unsigned char byteClass[256];
+    unsigned char classByte[256];   //a byte of each class
+    int numClasses;
+    int required;           //byte every match contains, or -1
+    //DFA states are sorted sets of pcs kept in the arena, with a row of
+    //numClasses transitions each, -1 until first taken
+    int *next;
+    int *arena;
+    size_t arenaLen;
+    size_t arenaCap;
+    size_t *stateOff;
+    int *stateLen;
+    bool *stateBol;         //only the start of a line
+    bool *match;            //a match ends here
+    bool *matchAtEol;       //a match ends here if the line does
+    int *table;             //hash of the states
+    int numStates;
+    int initial;
+    //closure work space
+    unsigned *mark;
+    unsigned markGen;
+    int *stack;
+    int *scratch;
+    int *held;
+} sf_regex_t;
+
+sf_regex_t *sf_regex_compile(const char *pattern);
+void sf_regex_free(sf_regex_t *re);
+void sf_regex_reset(sf_regex_t *re);
+bool sf_regex_line_matches(sf_regex_t *re, const char *line, size_t len);
+int sf_stream_regex_search(int fd, sf_regex_t *re);
+
+//word frequency table, see sffreq.c.  An entry with a count of 0 is free
+typedef struct sf_freq_entry {
+    uint64_t hash;
+    size_t off;             //where the word is in the arena
+    size_t len;
+    long long count;
+} sf_freq_entry_t;
+
+typedef struct sf_freq_table {
+    sf_freq_entry_t *entry;
+    size_t capacity;        //always a power of two
+    size_t used;
+    char *arena;            //every word once, back to back
+    size_t arenaLen;
+    size_t arenaCap;
+} sf_freq_table_t;
+
+int sf_freq_init(sf_freq_table_t *t);
+void sf_freq_free(sf_freq_table_t *t);
+int sf_freq_add_words(sf_freq_table_t *t, const char *in, size_t len);
+int sf_freq_merge(sf_freq_table_t *dst, const sf_freq_table_t *src);
+int sf_freq_print_top(const sf_freq_table_t *t, long long k);
+int sf_stream_word_freq(int fd, long long k);
+
+//in place replace, see sfinplace.c.  Files are handed to threads in
+//batches of up to INPLACE_BATCH_FILES files or INPLACE_BATCH_SZ bytes, and
+//ones smaller than INPLACE_MMAP_MIN are read() rather than mapped
+#define INPLACE_BATCH_FILES 32
+#define INPLACE_BATCH_SZ    (1024 * 1024)
+#define INPLACE_MMAP_MIN    (64 * 1024)
+
+typedef struct sf_file {
+    size_t off;             //where its path is in the names arena
+    size_t size;
+    dev_t dev;
+    ino_t ino;
+    bool skip;              //the same file listed again
+} sf_file_t;
+
+typedef struct sf_file_list {
+    sf_file_t *file;
+    size_t count;
+    size_t capacity;
+    char *names;            //every path, NUL terminated, back to back
+    size_t namesLen;
+    size_t namesCap;
+} sf_file_list_t;
+
+typedef struct sf_inplace_stats {
+    long long files;        //looked at
+    long long changed;      //rewritten
+    long long matches;      //replaced, over all of them
+    long long failed;
+} sf_inplace_stats_t;
+
+int sf_file_list_add(sf_file_list_t *list, const char *path);
+int sf_file_list_add_dir(sf_file_list_t *list, const char *dir);
+void sf_file_list_free(sf_file_list_t *list);
+int sf_inplace_replace(sf_file_list_t *list, int jobs, const sf_searcher_t *s, const char *replacement,
+                       size_t replacementLen, sf_inplace_stats_t *stats);
+
+//multi-threaded mode, see sfthread.c
+int sf_parallel_count_words(char *path, int jobs, long long *words);
+int sf_parallel_word_freq(char *path, int jobs, long long k);
+
+#endif
@@ -0,0 +1,300 @@
+#!/usr/bin/env bats
+
+# Stream mode reads STREAM_CHUNK_SZ (1 MiB) at a time.  149796 lines of
+# "abc de" are 1048572 bytes, so whatever comes next straddles the first
+# chunk boundary.
+CHUNK_SZ=1048576
+PAD_LINES=149796
+
+# "boundary" runs from 4 bytes before the boundary to 4 bytes after it
+make_boundary_file() {
+    yes "abc de" | head -n $PAD_LINES > "$1"
+    printf 'boundary word\nlast line\n' >> "$1"
+}
+
+# a 2 byte character is cut in half by the boundary
+make_utf8_boundary_file() {
+    yes "abc de" | head -n $PAD_LINES > "$1"
+    printf 'xyz\xc3\xa9\xc3\xa9 w\xc3\xb6rd\n' >> "$1"
+}
+
+setup_file() {
+    rm -rf sftest_files
+}
+
+@test "Count words in a string" {
+    run ./stringfun -c "hello  there   world"
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Word Count: 3" ]
+    [ "${lines[1]}" = "Buffer:  hello there world................................." ]
+}
+
+@test "Reverse a string" {
+    run ./stringfun -r "abc def"
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Reversed String: fed cba" ]
+}
+
+@test "Print the words of a string" {
+    run ./stringfun -w "hello there"
+    [ "$status" -eq 0 ]
+    [ "${lines[2]}" = "1. hello (5)" ]
+    [ "${lines[3]}" = "2. there (5)" ]
+}
+
+@test "Count and word print split on the same whitespace" {
+    run ./stringfun -c $'this\tis a\ttest'
+    [ "${lines[0]}" = "Word Count: 4" ]
+    run ./stringfun -w $'this\tis a\ttest'
+    [ "${lines[2]}" = "1. this (4)" ]
+    [ "${lines[5]}" = "4. test (4)" ]
+
+    run ./stringfun -c "   "
+    [ "${lines[0]}" = "Word Count: 0" ]
+    run ./stringfun -w "   "
+    [ "${#lines[@]}" -eq 3 ]
+
+    run ./stringfun -w " x "
+    [ "${lines[2]}" = "1. x (1)" ]
+    [ "${#lines[@]}" -eq 4 ]
+}
+
+@test "The word count setup_buff makes is right on every kernel" {
+    # "ab" starts on the last byte of the first 64 byte block
+    long="$(printf 'x%.0s' $(seq 40))$(printf ' %.0s' $(seq 23))ab cd"
+
+    for kernel in scalar sse2 avx2; do
+        run env STRINGFUN_KERNEL=$kernel ./stringfun -c "$long"
+        [ "${lines[0]}" = "Word Count: 3" ] || {
+            echo "Failed Output with $kernel:  $output"
+            return 1
+        }
+    done
+}
+
+@test "Replace every whole word match" {
+    run ./stringfun -x "cat concat cat" cat dog
+    [ "$status" -eq 0 ]
+    [ "${lines[2]}" = "Modified String: dog concat dog" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./stringfun -x "cat concat cat" cat dog -a
+    [ "$status" -eq 0 ]
+    [ "${lines[2]}" = "Modified String: dog condog dog" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "Replacement that does not fit leaves the string alone" {
+    run ./stringfun -x "aaaa aaaa aaaa aaaa aaaa aaaa aaaa aaaa aaaa aaa" aaaa bbbbbb
+    [ "$status" -eq 0 ]
+    [ "${lines[2]}" = "Modified String: aaaa aaaa aaaa aaaa aaaa aaaa aaaa aaaa aaaa aaa" ]
+}
+
+@test "Regular expression search" {
+    run ./stringfun -e "cat concat" "c[a-z]+t$"
+    [ "$status" -eq 0 ]
+    [ "${lines[2]}" = "Pattern Found" ]
+
+    run ./stringfun -e "cat" "zz+"
+    [ "$status" -eq 0 ]
+    [ "${lines[2]}" = "Pattern Not Found" ]
+
+    run ./stringfun -e "cat" "("
+    [ "$status" -eq 1 ]
+}
+
+@test "UTF-8 mode counts, reverses and prints characters" {
+    run ./stringfun -c "héllo wörld" -u
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Word Count: 2" ]
+
+    run ./stringfun -r "héllo" -u
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Reversed String: olléh" ]
+
+    run ./stringfun -w "héllo wörld" -u
+    [ "$status" -eq 0 ]
+    [ "${lines[3]}" = "2. wörld (5)" ]
+
+    run bash -c "printf 'a\xff' | ./stringfun -c -s - -u"
+    [ "$status" -eq 2 ]
+}
+
+@test "Stream count and word print across a chunk boundary" {
+    mkdir -p sftest_files
+    make_boundary_file sftest_files/edge.txt
+
+    run ./stringfun -c -s sftest_files/edge.txt
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Word Count: $(wc -w < sftest_files/edge.txt)" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run bash -c "./stringfun -w -s - < sftest_files/edge.txt | grep -c '^[0-9]*\. boundary (8)$'"
+    [ "$output" = "1" ]
+
+    rm -rf sftest_files
+}
+
+@test "Stream count, threaded count and word print split on the same whitespace" {
+    mkdir -p sftest_files
+    yes "abc de" | head -n $PAD_LINES > sftest_files/seps.txt
+    printf 'ab\t\r\n\vcd \fe\n' >> sftest_files/seps.txt
+    words=$(wc -w < sftest_files/seps.txt)
+
+    run ./stringfun -c -s sftest_files/seps.txt
+    [ "${lines[0]}" = "Word Count: $words" ]
+
+    run ./stringfun -c -j 3 sftest_files/seps.txt
+    [ "${lines[0]}" = "Word Count: $words" ]
+
+    run bash -c "./stringfun -w -s sftest_files/seps.txt | tail -n 3"
+    expected="$((words - 2)). ab (2)"$'\n'"$((words - 1)). cd (2)"$'\n'"$words. e (1)"
+    [ "$output" = "$expected" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    rm -rf sftest_files
+}
+
+@test "Stream reverse across a chunk boundary" {
+    mkdir -p sftest_files
+    make_boundary_file sftest_files/edge.txt
+    make_utf8_boundary_file sftest_files/utf8.txt
+
+    ./stringfun -r -s sftest_files/edge.txt > sftest_files/rev1
+    [ "$(head -c 20 sftest_files/rev1 | tr '\n' '|')" = "|enil tsal|drow yrad" ]
+    ./stringfun -r -s sftest_files/rev1 > sftest_files/rev2
+    cmp sftest_files/edge.txt sftest_files/rev2
+
+    ./stringfun -r -s sftest_files/utf8.txt -u > sftest_files/rev1
+    iconv -f UTF-8 -t UTF-8 sftest_files/rev1 > /dev/null
+    ./stringfun -r -s sftest_files/rev1 -u > sftest_files/rev2
+    cmp sftest_files/utf8.txt sftest_files/rev2
+
+    run ./stringfun -c -s sftest_files/utf8.txt -u
+    [ "${lines[0]}" = "Word Count: $(wc -w < sftest_files/utf8.txt)" ]
+
+    ./stringfun -r -s sftest_files/edge.txt -l > sftest_files/rev1
+    tac sftest_files/edge.txt | cmp - sftest_files/rev1
+
+    rm -rf sftest_files
+}
+
+@test "Stream replace and search across a chunk boundary" {
+    mkdir -p sftest_files
+    make_boundary_file sftest_files/edge.txt
+
+    ./stringfun -x -s sftest_files/edge.txt boundary edge > sftest_files/out
+    sed 's/boundary/edge/' sftest_files/edge.txt | cmp - sftest_files/out
+
+    ./stringfun -x -s sftest_files/edge.txt ound OUND -a > sftest_files/out
+    sed 's/ound/OUND/' sftest_files/edge.txt | cmp - sftest_files/out
+
+    run ./stringfun -e -s sftest_files/edge.txt "^b.*y w"
+    [ "$status" -eq 0 ]
+    [ "$output" = "boundary word" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    rm -rf sftest_files
+}
+
+@test "Multi-pattern replace" {
+    mkdir -p sftest_files
+    make_boundary_file sftest_files/edge.txt
+    printf 'boundary\tedge\nlast\tfirst\nabc\tx\n' > sftest_files/rules
+
+    ./stringfun -X sftest_files/rules sftest_files/edge.txt > sftest_files/out
+    sed 's/boundary/edge/; s/last/first/; s/^abc /x /' sftest_files/edge.txt | cmp - sftest_files/out
+
+    run bash -c "echo 'the last abc' | ./stringfun -X sftest_files/rules -"
+    [ "$output" = "the first x" ]
+
+    rm -rf sftest_files
+}
+
+@test "Word frequency" {
+    run bash -c "printf 'the cat the dog the\n' | ./stringfun -f -k 2 -"
+    [ "$status" -eq 0 ]
+    [ "${lines[2]}" = "1. the (3)" ]
+    [ "${#lines[@]}" -eq 4 ]
+
+    mkdir -p sftest_files
+    make_boundary_file sftest_files/edge.txt
+
+    run ./stringfun -f sftest_files/edge.txt
+    [ "$status" -eq 0 ]
+    [[ "$output" == *"boundary (1)"* ]]
+    [[ "$output" == *"abc ($PAD_LINES)"* ]]
+    stream_output="$output"
+
+    run ./stringfun -f -j 4 sftest_files/edge.txt
+    [ "$status" -eq 0 ]
+    [ "$output" = "$stream_output" ]
+
+    rm -rf sftest_files
+}
+
+@test "Threaded count matches on any number of threads" {
+    mkdir -p sftest_files
+    make_boundary_file sftest_files/edge.txt
+    words=$(wc -w < sftest_files/edge.txt)
+
+    for jobs in 1 2 3 7 16; do
+        run ./stringfun -c -j $jobs sftest_files/edge.txt
+        [ "$status" -eq 0 ]
+        [ "${lines[0]}" = "Word Count: $words" ] || {
+            echo "Failed Output with $jobs threads:  $output"
+            return 1
+        }
+    done
+
+    rm -rf sftest_files
+}
+
+@test "In place replace rewrites files and keeps their mode" {
+    mkdir -p sftest_files/dir/sub
+    make_boundary_file sftest_files/edge.txt
+    printf 'cat concat cat\n' > sftest_files/dir/a.txt
+    printf 'no match here\n' > sftest_files/dir/sub/b.txt
+    printf 'cat\n' > sftest_files/dir/sub/c.txt
+    chmod 640 sftest_files/dir/a.txt
+    chmod 2755 sftest_files/dir/sub/c.txt
+
+    run ./stringfun -x cat dog --in-place -j 2 sftest_files/edge.txt -R sftest_files/dir
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Replaced 3 matches in 2 of 4 files" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    [ "$(cat sftest_files/dir/a.txt)" = "dog concat dog" ]
+    [ "$(cat sftest_files/dir/sub/b.txt)" = "no match here" ]
+    [ "$(cat sftest_files/dir/sub/c.txt)" = "dog" ]
+    [ "$(stat -c %a sftest_files/dir/a.txt)" = "640" ]
+    [ "$(stat -c %a sftest_files/dir/sub/c.txt)" = "2755" ]
+    [ -z "$(find sftest_files -name '.*.sf*')" ]
+
+    make_boundary_file sftest_files/expected.txt
+    cmp sftest_files/expected.txt sftest_files/edge.txt
+
+    rm -rf sftest_files
+}
+
+@test "The library exports only sf_ symbols" {
+    make -s lib
+    run bash -c "nm -g --defined-only libstringfun.a | awk 'NF == 3 && \$3 !~ /^sf_/ { print \$3 }'"
+    [ "$status" -eq 0 ]
+    [ -z "$output" ] || {
+        echo "Unprefixed:  $output"
+        return 1
+    }
+}
@@ -14,6 +14,34 @@ typedef struct student{
     int gpa; 
 } student_t;
 
+//Version 2 on-disk format, optional and selected with "sdbsc -z v2" or
+//"sdbsc --convert v2".  Most of a student_t is NUL padding in the name
+//arrays, so v2 stores only the hot columns in a fixed width slot per id and
+//keeps each distinct name once in a string heap at the end of the file.  A
+//hash index of the heap lets an add find a name it already holds without
+//reading the heap:
+//
+//  offset 0                header, starts with DB_V2_MAGIC
+//  V2_SLOT_START           student_v2_t slot for id 0, 1, 2 ... MAX_STD_ID
+//  V2_INDEX_START          V2_INDEX_SLOTS open addressing buckets, each the
+//                          heap ref + 1 of a name or 0 when empty
+//  V2_HEAP_START           heap entries, a length byte then the name bytes
+//
+//A v1 file starts with the record of student 1 (or zeros) so the magic can
+//never appear there by accident.
+typedef struct student_v2_hdr{
+    char magic[8];
+    long long heap_end;     //file offset where the next name is appended
+    char reserved[48];
+} student_v2_hdr_t;
+
+typedef struct student_v2{
+    int id;
+    int gpa;
+    unsigned int fname_ref; //offset of the name's entry from V2_HEAP_START
+    unsigned int lname_ref;
+} student_v2_t;
+
 //Define limits for sudent ids and allowable GPA ranges.  Note GPA values will
 //be stored as integers but printed as floats.  For example a GPA of 450 is really
 //that value divided by 100.0 or 4.50.
@@ -29,7 +57,28 @@ static const int STUDENT_RECORD_SIZE  = sizeof(struct student);
 static const int DELETED_STUDENT_ID = 0;
 
 
+//v2 format layout, see student_v2_hdr above
+#define DB_V2_MAGIC         "SDBv2fmt"
+#define DB_V2_ARG           "v2"
+#define DB_V1_ARG           "v1"
+#define V2_SLOT_SIZE        ((int) sizeof(student_v2_t))
+#define V2_SLOT_START       ((off_t) sizeof(student_v2_hdr_t))
+#define V2_INDEX_SLOTS      (1 << 19)   //two distinct names per id at well under half full
+#define V2_INDEX_START      ((V2_SLOT_START + (off_t) (MAX_STD_ID + 1) * V2_SLOT_SIZE + 4095) & ~(off_t) 4095)
+#define V2_HEAP_START       (V2_INDEX_START + (off_t) V2_INDEX_SLOTS * (off_t) sizeof(unsigned int))
+
 #define DB_FILE     "student.db"            //name of database file
 #define TMP_DB_FILE ".tmp_student.db"       //for extra credit
+#define REDO_DB_FILE ".redo_student.db"     //journal of a committing --txn
+#define DIRTY_DB_FILE ".dirty_student.db"   //pages changed since the last --snapshot
+
+//--backup-since tracks and emits changes in pages of this size
+#define BACKUP_PAGE_SZ          4096
+
+//compaction streams live records through buffers of this size, so memory use
+//is bounded no matter how large the database grows
+#define COMPRESS_BUFF_SZ        (1024*1024)
+#define COMPRESS_PROGRESS_SZ    (64*1024*1024)  //report progress this often
+#define COMPRESS_ONLINE_ARG     "online"        //sdbsc -x online
 
 #endif
\ No newline at end of file
@@ -0,0 +1,406 @@
+#define _GNU_SOURCE     //SEEK_DATA / SEEK_HOLE, copy_file_range()
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+//database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbstats.h"
+
+// header of the dirty page bitmap, followed by one bit per BACKUP_PAGE_SZ
+// page of the database, bit (page % 8) of byte (page / 8)
+typedef struct dirty_hdr {
+    char magic[8];
+    char snapshot[248];     // name the bitmap is relative to, NUL terminated
+} dirty_hdr_t;
+
+// header of a --backup-since file, followed by count entries of an int64
+// page offset and BACKUP_PAGE_SZ bytes.  Restoring is: copy the snapshot,
+// write every page at its offset, truncate to db_size.
+typedef struct backup_hdr {
+    char     magic[8];
+    int64_t  db_size;
+    uint32_t page_size;
+    uint32_t count;
+} backup_hdr_t;
+
+static const char DIRTY_MAGIC[8] = {'S', 'D', 'B', 'D', 'I', 'R', 'T', '1'};
+static const char BACKUP_MAGIC[8] = {'S', 'D', 'B', 'I', 'N', 'C', 'R', '1'};
+
+// pages read per pread while writing a backup
+#define BACKUP_RUN_PAGES    (COMPRESS_BUFF_SZ / BACKUP_PAGE_SZ)
+
+static void dirty_path_from_fd(int fd, char *path, size_t size) {
+    char dbPath[PATH_MAX];
+
+    db_path_from_fd(fd, dbPath, sizeof(dbPath));
+    db_sibling_path(dbPath, DIRTY_DB_FILE, path, size);
+}
+
+/*
+ *  dirty_mark
+ *      fd:      linux file descriptor of the database, locked exclusively
+ *      offset:  first byte about to be changed
+ *      len:     number of bytes about to be changed
+ *
+ *  Every path that changes the database calls this before it writes, and
+ *  bits that were not already set are made durable before it returns, so
+ *  the bitmap is never behind the file even after a crash.  A page only
+ *  costs that sync the first time it changes after a snapshot.  Until a
+ *  snapshot has been taken there is no bitmap and nothing is recorded.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE, the caller must not write on error
+ *
+ *  console:  M_ERR_DB_WRITE  error updating the bitmap
+ */
+int dirty_mark(int fd, off_t offset, off_t len){
+    char dirtyPath[PATH_MAX];
+
+    if (len <= 0) {
+        return NO_ERROR;
+    }
+
+    dirty_path_from_fd(fd, dirtyPath, sizeof(dirtyPath));
+    int dirtyFd = open(dirtyPath, O_RDWR);
+    if (dirtyFd == -1) {
+        if (errno == ENOENT) {
+            return NO_ERROR;
+        }
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
+    off_t firstPage = offset / BACKUP_PAGE_SZ;
+    off_t lastPage = (offset + len - 1) / BACKUP_PAGE_SZ;
+    off_t firstByte = firstPage / 8;
+    size_t numBytes = (size_t) (lastPage / 8 - firstByte + 1);
+    off_t bitsOffset = (off_t) sizeof(dirty_hdr_t) + firstByte;
+
+    // read-modify-write only the bytes covering the range, past the end of
+    // the bitmap reads short and the calloc'd zeros stand in
+    unsigned char *bits = calloc(numBytes, 1);
+    int rc = NO_ERROR;
+
+    if (bits == NULL || sdb_pread(dirtyFd, bits, numBytes, bitsOffset) < 0) {
+        rc = ERR_DB_FILE;
+    } else {
+        bool changed = false;
+        for (off_t page = firstPage; page <= lastPage; page++) {
+            unsigned char bit = (unsigned char) (1u << (page % 8));
+            changed |= !(bits[page / 8 - firstByte] & bit);
+            bits[page / 8 - firstByte] |= bit;
+        }
+        if (changed && (sdb_pwrite(dirtyFd, bits, numBytes, bitsOffset) != (ssize_t) numBytes ||
+                        fdatasync(dirtyFd) == -1)) {
+            rc = ERR_DB_FILE;
+        }
+    }
+
+    if (rc != NO_ERROR) {
+        printf(M_ERR_DB_WRITE);
+    }
+    free(bits);
+    close(dirtyFd);
+    return rc;
+}
+
+// copy_file_range() counted like the other syscall wrappers in sdbstats.h
+static ssize_t sdb_copy_file_range(int inFd, off_t *inOffset, int outFd, off_t *outOffset, size_t len) {
+    ssize_t rc = copy_file_range(inFd, inOffset, outFd, outOffset, len, 0);
+    if (__builtin_expect(sdb_stats_enabled, 0))
+        stats_count_write(rc);
+    return rc;
+}
+
+// copies len bytes at offset into the same offset of outFd, in kernel when
+// the filesystem allows it and through a buffer otherwise
+static int copy_extent(int inFd, int outFd, off_t offset, off_t len) {
+    char *buffer = NULL;
+    int rc = NO_ERROR;
+
+    while (rc == NO_ERROR && len > 0) {
+        off_t inOffset = offset;
+        off_t outOffset = offset;
+        size_t want = (len > COMPRESS_BUFF_SZ) ? COMPRESS_BUFF_SZ : (size_t) len;
+        ssize_t copied = -1;
+
+        if (buffer == NULL) {
+            copied = sdb_copy_file_range(inFd, &inOffset, outFd, &outOffset, want);
+        }
+
+        if (copied == -1 && (buffer != NULL || errno == EXDEV || errno == ENOSYS ||
+                             errno == EINVAL || errno == EOPNOTSUPP)) {
+            if (buffer == NULL && (buffer = malloc(COMPRESS_BUFF_SZ)) == NULL) {
+                rc = ERR_DB_FILE;
+                break;
+            }
+            copied = sdb_pread(inFd, buffer, want, offset);
+            if (copied > 0 && sdb_pwrite(outFd, buffer, copied, offset) != copied) {
+                copied = -1;
+            }
+        }
+
+        if (copied <= 0) {
+            rc = ERR_DB_FILE;
+            break;
+        }
+        offset += copied;
+        len -= copied;
+    }
+
+    free(buffer);
+    return rc;
+}
+
+// replaces the bitmap with an empty one relative to snapshotName.  Snapshots
+// only hold a shared lock, so each one builds its bitmap under a name of its
+// own and the last rename wins
+static int dirty_reset(int fd, char *snapshotName) {
+    char dbPath[PATH_MAX];
+    char dirtyPath[PATH_MAX];
+    char newPath[PATH_MAX + 8];
+    dirty_hdr_t hdr = {0};
+    mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
+
+    memcpy(hdr.magic, DIRTY_MAGIC, sizeof(hdr.magic));
+    strncpy(hdr.snapshot, snapshotName, sizeof(hdr.snapshot) - 1);
+
+    db_path_from_fd(fd, dbPath, sizeof(dbPath));
+    db_sibling_path(dbPath, DIRTY_DB_FILE, dirtyPath, sizeof(dirtyPath));
+    snprintf(newPath, sizeof(newPath), "%s.XXXXXX", dirtyPath);
+
+    int newFd = mkstemp(newPath);
+    if (newFd == -1) {
+        return ERR_DB_FILE;
+    }
+
+    if (fchmod(newFd, mode) == -1 || sdb_write(newFd, &hdr, sizeof(hdr)) != (ssize_t) sizeof(hdr) ||
+            fsync(newFd) == -1) {
+        close(newFd);
+        unlink(newPath);
+        return ERR_DB_FILE;
+    }
+    close(newFd);
+
+    if (rename(newPath, dirtyPath) == -1) {
+        unlink(newPath);
+        return ERR_DB_FILE;
+    }
+    return sync_db_dir(dbPath);
+}
+
+/*
+ *  snapshot_db
+ *      fd:    linux file descriptor of the database, main() holds a shared
+ *             lock on it so no writer can change it during the copy
+ *      name:  file to create, it must not exist yet
+ *
+ *  Copies the database to name.  Only its data extents (found with
+ *  SEEK_DATA and SEEK_HOLE) are copied, with copy_file_range() so the bytes
+ *  can stay in the kernel or be reflinked, and the copy is sized to match
+ *  so every hole stays a hole.  Once the copy is durable change tracking
+ *  restarts from it, see backup_since().
+ *
+ *  returns:  NO_ERROR       snapshot written
+ *            ERR_DB_FILE    database or snapshot file I/O issue
+ *
+ *  console:  M_DB_SNAPSHOT_OK  on success
+ *            M_ERR_SNAPSHOT    the snapshot could not be written
+ */
+static int snapshot_db_impl(int fd, char *name) {
+    mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
+    long long copied = 0;
+    int rc = NO_ERROR;
+
+    int outFd = open(name, O_WRONLY | O_CREAT | O_EXCL, mode);
+    if (outFd == -1) {
+        printf(M_ERR_SNAPSHOT, name);
+        return ERR_DB_FILE;
+    }
+
+    off_t fileSize = sdb_lseek(fd, 0, SEEK_END);
+
+    // filesystems without SEEK_DATA support report the whole file as data
+    off_t dataStart = sdb_lseek(fd, 0, SEEK_DATA);
+    if (dataStart == -1 && errno != ENXIO) {
+        dataStart = 0;
+    }
+
+    while (rc == NO_ERROR && dataStart >= 0 && dataStart < fileSize) {
+        off_t dataEnd = sdb_lseek(fd, dataStart, SEEK_HOLE);
+        if (dataEnd == -1 || dataEnd > fileSize) {
+            dataEnd = fileSize;
+        }
+
+        rc = copy_extent(fd, outFd, dataStart, dataEnd - dataStart);
+        copied += dataEnd - dataStart;
+
+        dataStart = sdb_lseek(fd, dataEnd, SEEK_DATA);
+    }
+
+    if (rc != NO_ERROR || ftruncate(outFd, fileSize) == -1 || fsync(outFd) == -1 ||
+            dirty_reset(fd, name) != NO_ERROR) {
+        printf(M_ERR_SNAPSHOT, name);
+        close(outFd);
+        unlink(name);
+        return ERR_DB_FILE;
+    }
+    close(outFd);
+
+    printf(M_DB_SNAPSHOT_OK, name, copied);
+    return NO_ERROR;
+}
+
+// instrumented entry point for snapshot_db(), see sdbstats.h
+int snapshot_db(int fd, char *name) {
+    stats_begin(STATS_OP_SNAPSHOT);
+    int rc = snapshot_db_impl(fd, name);
+    stats_end(STATS_OP_SNAPSHOT);
+    return rc;
+}
+
+/*
+ *  backup_since
+ *      fd:        linux file descriptor of the database, main() holds a
+ *                 shared lock on it
+ *      snapshot:  name given to the --snapshot the backup is relative to
+ *      outName:   backup file to write, see backup_hdr_t for the format
+ *
+ *  Emits every page whose bit is set in the dirty page bitmap.  The bitmap
+ *  is only read, so backups can be taken repeatedly against one snapshot
+ *  until the next snapshot resets it.  The amount read and written depends
+ *  on how much changed, not on the size of the database; runs of adjacent
+ *  dirty pages are read with a single pread.
+ *
+ *  returns:  <number>       number of pages in the backup
+ *            ERR_DB_FILE    database or backup file I/O issue
+ *            ERR_DB_OP      changes are not being tracked since snapshot
+ *
+ *  console:  M_DB_BACKUP_OK     on success
+ *            M_ERR_BACKUP_BASE  the bitmap is not relative to snapshot
+ *            M_ERR_BACKUP_OUT   the backup file could not be written
+ *            M_ERR_DB_READ      error reading the database or bitmap
+ */
+static int backup_since_impl(int fd, char *snapshot, char *outName) {
+    char dirtyPath[PATH_MAX];
+    dirty_hdr_t dirtyHdr;
+    mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
+
+    dirty_path_from_fd(fd, dirtyPath, sizeof(dirtyPath));
+    int dirtyFd = open(dirtyPath, O_RDONLY);
+    if (dirtyFd == -1 || sdb_pread(dirtyFd, &dirtyHdr, sizeof(dirtyHdr), 0) != (ssize_t) sizeof(dirtyHdr) ||
+            memcmp(dirtyHdr.magic, DIRTY_MAGIC, sizeof(dirtyHdr.magic)) != 0 ||
+            strncmp(dirtyHdr.snapshot, snapshot, sizeof(dirtyHdr.snapshot)) != 0) {
+        printf(M_ERR_BACKUP_BASE, snapshot);
+        if (dirtyFd != -1) {
+            close(dirtyFd);
+        }
+        return ERR_DB_OP;
+    }
+
+    off_t fileSize = sdb_lseek(fd, 0, SEEK_END);
+    off_t numPages = (fileSize + BACKUP_PAGE_SZ - 1) / BACKUP_PAGE_SZ;
+    size_t bitmapLen = (size_t) (numPages + 7) / 8;
+
+    // pages past the end of the database are covered by db_size
+    unsigned char *bits = calloc(bitmapLen + 1, 1);
+    if (bits == NULL || sdb_pread(dirtyFd, bits, bitmapLen, sizeof(dirtyHdr)) < 0) {
+        printf(M_ERR_DB_READ);
+        close(dirtyFd);
+        free(bits);
+        return ERR_DB_FILE;
+    }
+    close(dirtyFd);
+
+    int outFd = open(outName, O_WRONLY | O_CREAT | O_TRUNC, mode);
+    if (outFd == -1) {
+        printf(M_ERR_BACKUP_OUT, outName);
+        free(bits);
+        return ERR_DB_FILE;
+    }
+
+    backup_hdr_t hdr = {0};
+    memcpy(hdr.magic, BACKUP_MAGIC, sizeof(hdr.magic));
+    hdr.db_size = fileSize;
+    hdr.page_size = BACKUP_PAGE_SZ;
+
+    run_writer_t out = { .fd = outFd, .buffer = malloc(COMPRESS_BUFF_SZ) };
+    char *pages = malloc(COMPRESS_BUFF_SZ);
+    off_t outOffset = sizeof(hdr);
+    int rc = (out.buffer == NULL || pages == NULL) ? ERR_DB_FILE : NO_ERROR;
+
+    off_t page = 0;
+    while (rc == NO_ERROR && page < numPages) {
+        if (!(bits[page / 8] & (1u << (page % 8)))) {
+            page++;
+            continue;
+        }
+
+        // gather the run of dirty pages starting here
+        off_t runLen = 1;
+        while (page + runLen < numPages && runLen < BACKUP_RUN_PAGES &&
+               (bits[(page + runLen) / 8] & (1u << ((page + runLen) % 8)))) {
+            runLen++;
+        }
+
+        size_t runBytes = (size_t) runLen * BACKUP_PAGE_SZ;
+        ssize_t got = sdb_pread(fd, pages, runBytes, page * BACKUP_PAGE_SZ);
+        if (got < 0) {
+            printf(M_ERR_DB_READ);
+            rc = ERR_DB_FILE;
+            break;
+        }
+        // the last page of the database may be partial
+        memset(pages + got, 0, runBytes - (size_t) got);
+
+        for (off_t i = 0; i < runLen && rc == NO_ERROR; i++) {
+            int64_t pageOffset = (int64_t) (page + i) * BACKUP_PAGE_SZ;
+            rc = run_write(&out, outOffset, &pageOffset, sizeof(pageOffset));
+            outOffset += sizeof(pageOffset);
+            if (rc == NO_ERROR) {
+                rc = run_write(&out, outOffset, pages + i * BACKUP_PAGE_SZ, BACKUP_PAGE_SZ);
+                outOffset += BACKUP_PAGE_SZ;
+            }
+            hdr.count++;
+        }
+        page += runLen;
+    }
+
+    if (rc == NO_ERROR) {
+        rc = run_flush(&out);
+    }
+    if (rc == NO_ERROR && (sdb_pwrite(outFd, &hdr, sizeof(hdr), 0) != (ssize_t) sizeof(hdr) ||
+                           fsync(outFd) == -1)) {
+        rc = ERR_DB_FILE;
+    }
+
+    free(out.buffer);
+    free(pages);
+    free(bits);
+    close(outFd);
+
+    if (rc != NO_ERROR) {
+        printf(M_ERR_BACKUP_OUT, outName);
+        unlink(outName);
+        return rc;
+    }
+
+    printf(M_DB_BACKUP_OK, snapshot, (int) hdr.count);
+    return (int) hdr.count;
+}
+
+// instrumented entry point for backup_since(), see sdbstats.h
+int backup_since(int fd, char *snapshot, char *outName) {
+    stats_begin(STATS_OP_BACKUP);
+    int rc = backup_since_impl(fd, snapshot, outName);
+    stats_end(STATS_OP_BACKUP);
+    return rc;
+}
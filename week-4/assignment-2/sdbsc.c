@@ -1,3 +1,4 @@
+#define _GNU_SOURCE     //SEEK_DATA / SEEK_HOLE
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>      //c library for system call file routines
@@ -5,10 +6,15 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/file.h>   //flock()
 
 //database include files
 #include "db.h"
 #include "sdbsc.h"
+#include "sdbstats.h"
 
 /*
  *  open_db
@@ -45,6 +51,205 @@ int open_db(char *dbFile, bool should_truncate){
     return fd;
 }
 
+/*
+ *  lock_db
+ *      dbFile:     name of the database file fd was opened from
+ *      fd:         linux file descriptor returned from open_db()
+ *      exclusive:  true for operations that modify the database
+ * 
+ *  Takes an flock() on the database, shared for readers and exclusive for
+ *  writers.  compress_db() swaps in a new file with rename(), so a process
+ *  that was waiting on the old file can wake up holding a lock on a file
+ *  that is no longer the database.  When that happens the stale fd is closed
+ *  and the current file is opened and locked again.
+ * 
+ *  returns:  the locked file descriptor (possibly a new one), or ERR_DB_FILE
+ * 
+ *  console:  M_ERR_DB_OPEN on error
+ */
+int lock_db(char *dbFile, int fd, bool exclusive){
+    struct stat fdStat;
+    struct stat pathStat;
+
+    while (1) {
+        if (flock(fd, exclusive ? LOCK_EX : LOCK_SH) == -1 ||
+                fstat(fd, &fdStat) == -1 || stat(dbFile, &pathStat) == -1) {
+            printf(M_ERR_DB_OPEN);
+            close(fd);
+            return ERR_DB_FILE;
+        }
+
+        if (fdStat.st_dev == pathStat.st_dev && fdStat.st_ino == pathStat.st_ino) {
+            return fd;
+        }
+
+        // the database was replaced while we waited, follow it
+        close(fd);
+        fd = open_db(dbFile, false);
+        if (fd < 0) {
+            return ERR_DB_FILE;
+        }
+    }
+}
+
+/*
+ *  db_path_from_fd
+ *      fd:    linux file descriptor of an open database
+ *      path:  buffer that receives the name of the file behind fd
+ *      size:  size of the path buffer
+ * 
+ *  Looks the name up through /proc/self/fd so operations that replace the
+ *  database work on the file the caller actually opened.  Falls back to
+ *  DB_FILE if the name can not be determined.
+ * 
+ *  returns:  nothing, this is a void function
+ * 
+ *  console:  This function does not produce any output
+ */
+void db_path_from_fd(int fd, char *path, size_t size){
+    char procLink[64];
+
+    snprintf(procLink, sizeof(procLink), "/proc/self/fd/%d", fd);
+    ssize_t len = readlink(procLink, path, size - 1);
+
+    if (len <= 0 || (size_t) len >= size - 1) {
+        snprintf(path, size, "%s", DB_FILE);
+        return;
+    }
+    path[len] = '\0';
+}
+
+/*
+ *  db_sibling_path
+ *      dbPath:  name of the database file
+ *      name:    file name to place in the database's directory, or NULL
+ *               to get the directory itself
+ *      out:     buffer that receives the resulting path
+ *      size:    size of the out buffer
+ * 
+ *  Temporary and journal files are created next to the database so that
+ *  rename() never crosses a filesystem and one directory fsync covers them.
+ * 
+ *  returns:  nothing, this is a void function
+ * 
+ *  console:  This function does not produce any output
+ */
+void db_sibling_path(const char *dbPath, const char *name, char *out, size_t size){
+    const char *slash = strrchr(dbPath, '/');
+    int dirLen = (slash == NULL) ? 0 : (int) (slash - dbPath + 1);
+
+    if (name == NULL) {
+        snprintf(out, size, "%.*s", dirLen, (dirLen == 0) ? "." : dbPath);
+    } else {
+        snprintf(out, size, "%.*s%s", dirLen, dbPath, name);
+    }
+}
+
+/*
+ *  student_offset
+ *      id:  student id
+ * 
+ *  returns:  the offset of the slot that add_student() uses for this id
+ */
+off_t student_offset(int id){
+    off_t offset = 0;
+
+    if (id > 1) {
+        offset = (off_t) id * STUDENT_RECORD_SIZE;
+    }
+
+    return offset;
+}
+
+/*
+ *  scan_db_records
+ *      fd:            linux file descriptor
+ *      callback:      called with the offset and contents of each live record
+ *      ctx:           passed through to the callback
+ *      bytesScanned:  if not NULL receives the number of bytes read
+ * 
+ *  Streams the database from start to end in COMPRESS_BUFF_SZ reads.  Only
+ *  the data extents of the file are visited (found with SEEK_DATA and
+ *  SEEK_HOLE) so the holes of a sparse database are never read.  Empty or
+ *  deleted records are skipped.  Scanning stops early if the callback
+ *  returns anything other than NO_ERROR.
+ * 
+ *  returns:  NO_ERROR       every record was visited
+ *            ERR_DB_FILE    database file I/O issue
+ *            <other>        whatever the callback returned to stop the scan
+ * 
+ *  console:  M_ERR_DB_READ  error reading or seeking the database file
+ */
+int scan_db_records(int fd, record_cb_t callback, void *ctx, long long *bytesScanned){
+    char *buffer = malloc(COMPRESS_BUFF_SZ);
+    long long scanned = 0;
+    int rc = NO_ERROR;
+
+    if (buffer == NULL) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    off_t fileSize = sdb_lseek(fd, 0, SEEK_END);
+
+    // find the first extent holding data, filesystems without SEEK_DATA
+    // support just report the whole file as one extent
+    off_t dataStart = sdb_lseek(fd, 0, SEEK_DATA);
+    if (dataStart == -1 && errno != ENXIO) {
+        dataStart = 0;
+    }
+
+    while (rc == NO_ERROR && dataStart >= 0 && dataStart < fileSize) {
+        off_t dataEnd = sdb_lseek(fd, dataStart, SEEK_HOLE);
+        if (dataEnd == -1) {
+            dataEnd = fileSize;
+        }
+
+        // extents are block aligned, records are too, but be defensive
+        off_t position = dataStart - (dataStart % STUDENT_RECORD_SIZE);
+
+        while (rc == NO_ERROR && position < dataEnd) {
+            size_t want = COMPRESS_BUFF_SZ;
+            if ((off_t) want > dataEnd - position) {
+                want = (size_t) (dataEnd - position);
+            }
+
+            ssize_t bytesRead = sdb_pread(fd, buffer, want, position);
+
+            // got an error reading
+            if (bytesRead < 0) {
+                printf(M_ERR_DB_READ);
+                rc = ERR_DB_FILE;
+                break;
+            }
+
+            // a partial record at the very end of the file is not a student
+            bytesRead -= bytesRead % STUDENT_RECORD_SIZE;
+            if (bytesRead == 0) {
+                break;
+            }
+
+            for (ssize_t i = 0; i < bytesRead && rc == NO_ERROR; i += STUDENT_RECORD_SIZE) {
+                sdb_records(1);
+                if (memcmp(buffer + i, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0) {
+                    rc = callback(ctx, position + i, (student_t *) (buffer + i));
+                }
+            }
+
+            position += bytesRead;
+            scanned += bytesRead;
+        }
+
+        dataStart = sdb_lseek(fd, dataEnd, SEEK_DATA);
+    }
+
+    free(buffer);
+    if (bytesScanned != NULL) {
+        *bytesScanned = scanned;
+    }
+    return rc;
+}
+
 /*
  *  get_student
  *      fd:  linux file descriptor
@@ -58,7 +263,11 @@ int open_db(char *dbFile, bool should_truncate){
  * 
  *  console:  Does not produce any console I/O used by other functions
  */
-int get_student(int fd, int id, student_t *s){
+static int get_student_impl(int fd, int id, student_t *s) {
+    if (db_is_v2(fd)) {
+        return v2_get_student(fd, id, s);
+    }
+
     off_t fdOffset = STUDENT_RECORD_SIZE;
     ssize_t bytesRead = 0;
     bool endOfFile = false;
@@ -67,7 +276,7 @@ int get_student(int fd, int id, student_t *s){
 
 
     // lseek to start once with offset equal to 0
-    fdOffset = lseek(fd, 0, SEEK_SET);
+    fdOffset = sdb_lseek(fd, 0, SEEK_SET);
 
     if (fdOffset == -1) {
         printf(M_ERR_DB_READ);
@@ -77,7 +286,7 @@ int get_student(int fd, int id, student_t *s){
     // until we reach EOF
     while (!endOfFile) {
 
-        bytesRead = read(fd, studentBuffer, STUDENT_RECORD_SIZE);
+        bytesRead = sdb_read(fd, studentBuffer, STUDENT_RECORD_SIZE);
 
         if (bytesRead == -1) {
             printf(M_ERR_DB_READ);
@@ -89,6 +298,7 @@ int get_student(int fd, int id, student_t *s){
             continue;
         }
 
+        sdb_records(1);
         if (memcmp(studentBuffer, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0 && studentBuffer->id == id) {
             // copy read student into passed pointer then free memory
             *s = *studentBuffer;
@@ -101,6 +311,14 @@ int get_student(int fd, int id, student_t *s){
     return SRCH_NOT_FOUND;
 }
 
+// instrumented entry point for get_student(), see sdbstats.h
+int get_student(int fd, int id, student_t *s) {
+    stats_begin(STATS_OP_GET_STUDENT);
+    int rc = get_student_impl(fd, id, s);
+    stats_end(STATS_OP_GET_STUDENT);
+    return rc;
+}
+
 /*
  *  add_student
  *      fd:     linux file descriptor
@@ -126,7 +344,11 @@ int get_student(int fd, int id, student_t *s){
  *            M_ERR_DB_WRITE    error writing to db file (adding student)
  *            
  */
-int add_student(int fd, int id, char *fname, char *lname, int gpa){
+static int add_student_impl(int fd, int id, char *fname, char *lname, int gpa) {
+    if (db_is_v2(fd)) {
+        return v2_add_student(fd, id, fname, lname, gpa);
+    }
+
     student_t* student = (student_t*) malloc(STUDENT_RECORD_SIZE);  
 
     int wasFound = get_student(fd, id, student);
@@ -137,22 +359,12 @@ int add_student(int fd, int id, char *fname, char *lname, int gpa){
         return ERR_DB_OP;
     }
 
-    off_t offset = 0;
+    off_t offset = student_offset(id);
 
-    if (id > 1) {
-        offset = (off_t) (id * STUDENT_RECORD_SIZE);
-    }
-
-    off_t offsetAfterReading = lseek(fd, offset, SEEK_SET);
-
-    // if there was an error seeking
-    if (offsetAfterReading < 0) {
-        printf(M_ERR_DB_READ);
-        free(student);
-        return ERR_DB_FILE;
-    }
-
-    ssize_t numberBytesRead = read(fd, student, STUDENT_RECORD_SIZE);
+    // positioned reads and writes keep the slot we check and the slot we
+    // write the same, a plain read() would move the file offset past it
+    memset(student, 0, STUDENT_RECORD_SIZE);
+    ssize_t numberBytesRead = sdb_pread(fd, student, STUDENT_RECORD_SIZE, offset);
 
     // if there was an error reading
     if (numberBytesRead < 0) {
@@ -161,17 +373,25 @@ int add_student(int fd, int id, char *fname, char *lname, int gpa){
         return ERR_DB_FILE;
     }
 
+    sdb_records(1);
     if (memcmp(student, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) == 0) {
         // this means we can write here, the memory at this id is 0
 
         // making a new student and populating 'fields'
-        student_t* newStudent = (student_t*) malloc(STUDENT_RECORD_SIZE);
+        student_t* newStudent = (student_t*) calloc(1, STUDENT_RECORD_SIZE);
         newStudent->id = id;
         strncpy(newStudent->fname, fname, sizeof(newStudent->fname)-1);
         strncpy(newStudent->lname, lname, sizeof(newStudent->lname)-1);
         newStudent->gpa = gpa;
 
-        ssize_t numberBytesWritten = write(fd, newStudent, (size_t)STUDENT_RECORD_SIZE);
+        // record the page as changed for --backup-since before changing it
+        if (dirty_mark(fd, offset, STUDENT_RECORD_SIZE) != NO_ERROR) {
+            free(student);
+            free(newStudent);
+            return ERR_DB_FILE;
+        }
+
+        ssize_t numberBytesWritten = sdb_pwrite(fd, newStudent, (size_t)STUDENT_RECORD_SIZE, offset);
 
         // if there was an error writing
         if (numberBytesWritten < 0) {
@@ -195,6 +415,14 @@ int add_student(int fd, int id, char *fname, char *lname, int gpa){
     
 }
 
+// instrumented entry point for add_student(), see sdbstats.h
+int add_student(int fd, int id, char *fname, char *lname, int gpa) {
+    stats_begin(STATS_OP_ADD_STUDENT);
+    int rc = add_student_impl(fd, id, fname, lname, gpa);
+    stats_end(STATS_OP_ADD_STUDENT);
+    return rc;
+}
+
 /*
  *  del_student
  *      fd:     linux file descriptor
@@ -217,7 +445,11 @@ int add_student(int fd, int id, char *fname, char *lname, int gpa){
  *            M_ERR_DB_WRITE     error writing to db file (adding student)
  *            
  */
-int del_student(int fd, int id) { 
+static int del_student_impl(int fd, int id) {
+    if (db_is_v2(fd)) {
+        return v2_del_student(fd, id);
+    }
+
     student_t* student = (student_t*) malloc(STUDENT_RECORD_SIZE);
     // get student
     int wasFound = get_student(fd, id, student);
@@ -228,7 +460,7 @@ int del_student(int fd, int id) {
     }
 
     // lseek to start once with offset equal to 0
-    off_t fdOffset = lseek(fd, 0, SEEK_SET);
+    off_t fdOffset = sdb_lseek(fd, 0, SEEK_SET);
     if (fdOffset == -1) {
         printf(M_ERR_DB_READ);
         return ERR_DB_FILE;
@@ -239,7 +471,7 @@ int del_student(int fd, int id) {
     student_t* studentBuffer = (student_t*) malloc(STUDENT_RECORD_SIZE);
 
     while (!endOfFile) {
-        bytesRead = read(fd, studentBuffer, STUDENT_RECORD_SIZE);
+        bytesRead = sdb_read(fd, studentBuffer, STUDENT_RECORD_SIZE);
 
         // reached EOF
         if (bytesRead == 0) {
@@ -252,17 +484,23 @@ int del_student(int fd, int id) {
             return ERR_DB_FILE;
         }
 
+        sdb_records(1);
+
         // if we find the student, overwrite with EMPTY_STUDENT_RECORD
         if (memcmp(studentBuffer, student, STUDENT_RECORD_SIZE) == 0) {
             // move file pointer to correct location
-            fdOffset = lseek(fd, -STUDENT_RECORD_SIZE, SEEK_CUR);
+            fdOffset = sdb_lseek(fd, -STUDENT_RECORD_SIZE, SEEK_CUR);
             if (fdOffset == -1) {
                 printf(M_ERR_DB_READ);
                 return ERR_DB_FILE;
             }
 
+            if (dirty_mark(fd, fdOffset, STUDENT_RECORD_SIZE) != NO_ERROR) {
+                return ERR_DB_FILE;
+            }
+
             // overwrite with empty student record
-            ssize_t bytesWritten = write(fd, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE);
+            ssize_t bytesWritten = sdb_write(fd, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE);
             if (bytesWritten < 0) {
                 printf(M_ERR_DB_WRITE);
                 return ERR_DB_FILE;
@@ -277,6 +515,14 @@ int del_student(int fd, int id) {
     return ERR_DB_OP;
 }
 
+// instrumented entry point for del_student(), see sdbstats.h
+int del_student(int fd, int id) {
+    stats_begin(STATS_OP_DEL_STUDENT);
+    int rc = del_student_impl(fd, id);
+    stats_end(STATS_OP_DEL_STUDENT);
+    return rc;
+}
+
 
 /*
  *  count_db_records
@@ -302,7 +548,11 @@ int del_student(int fd, int id) {
  *            M_ERR_DB_WRITE   error writing to db file (adding student)
  *            
  */
-int count_db_records(int fd){
+static int count_db_records_impl(int fd) {
+    if (db_is_v2(fd)) {
+        return v2_count_db_records(fd);
+    }
+
     off_t fdOffset = STUDENT_RECORD_SIZE;
     ssize_t bytesRead = 0;
     int studentCount = 0;
@@ -312,7 +562,7 @@ int count_db_records(int fd){
 
 
     // lseek to start once with offset equal to 0
-    fdOffset = lseek(fd, 0, SEEK_SET);
+    fdOffset = sdb_lseek(fd, 0, SEEK_SET);
 
     if (fdOffset == -1) {
         printf(M_ERR_DB_READ);
@@ -322,7 +572,7 @@ int count_db_records(int fd){
     // until we reach EOF
     while (!endOfFile) {
 
-        bytesRead = read(fd, studentBuffer, STUDENT_RECORD_SIZE);
+        bytesRead = sdb_read(fd, studentBuffer, STUDENT_RECORD_SIZE);
 
         if (bytesRead == -1) {
             printf(M_ERR_DB_READ);
@@ -334,6 +584,7 @@ int count_db_records(int fd){
             continue;
         }
 
+        sdb_records(1);
         if (memcmp(studentBuffer, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0) {
             studentCount++;
         }
@@ -347,6 +598,14 @@ int count_db_records(int fd){
     return studentCount;
 }
 
+// instrumented entry point for count_db_records(), see sdbstats.h
+int count_db_records(int fd) {
+    stats_begin(STATS_OP_COUNT_DB);
+    int rc = count_db_records_impl(fd);
+    stats_end(STATS_OP_COUNT_DB);
+    return rc;
+}
+
 /*
  *  print_db
  *      fd:     linux file descriptor
@@ -380,8 +639,12 @@ int count_db_records(int fd){
  *            M_ERR_DB_READ    error reading or seeking the database file
  *            
  */
-int print_db(int fd) {
-    if (lseek(fd, 0, SEEK_SET) == -1) {
+static int print_db_impl(int fd) {
+    if (db_is_v2(fd)) {
+        return v2_print_db(fd);
+    }
+
+    if (sdb_lseek(fd, 0, SEEK_SET) == -1) {
         printf(M_ERR_DB_READ);
         return ERR_DB_FILE;
     }
@@ -392,7 +655,7 @@ int print_db(int fd) {
     bool hasPrinted = false;
 
     while (!endOfFile) {
-        bytesRead = read(fd, studentBuffer, STUDENT_RECORD_SIZE);
+        bytesRead = sdb_read(fd, studentBuffer, STUDENT_RECORD_SIZE);
 
         // reached EOF
         if (bytesRead == 0) {
@@ -405,6 +668,8 @@ int print_db(int fd) {
             return ERR_DB_FILE;
         }
 
+        sdb_records(1);
+
         // don't print student section is that empty
         if (memcmp(studentBuffer, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) == 0) {
             continue;
@@ -433,6 +698,14 @@ int print_db(int fd) {
     return NO_ERROR;
 }
 
+// instrumented entry point for print_db(), see sdbstats.h
+int print_db(int fd) {
+    stats_begin(STATS_OP_PRINT_DB);
+    int rc = print_db_impl(fd);
+    stats_end(STATS_OP_PRINT_DB);
+    return rc;
+}
+
 /*
  *  print_student
  *      *s:   a pointer to a student_t structure that should
@@ -477,6 +750,191 @@ void print_student(student_t *s){
     return;
 }
 
+/*
+ *  run_write
+ *      w:       run writer, fd and a COMPRESS_BUFF_SZ buffer filled in
+ *      offset:  file offset the data belongs at
+ *      data:    bytes to write
+ *      len:     number of bytes, at most COMPRESS_BUFF_SZ
+ * 
+ *  Collects writes to increasing, mostly contiguous offsets into a buffer
+ *  and issues one pwrite per contiguous run instead of one per record.
+ *  Anything not written is left as a hole in the file.
+ * 
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ * 
+ *  console:  M_ERR_DB_WRITE  error writing the file
+ */
+int run_write(run_writer_t *w, off_t offset, const void *data, size_t len){
+    // flush the pending run if this write does not extend it or would
+    // overflow the buffer
+    if (w->length > 0 && (w->start + (off_t) w->length != offset ||
+                          w->length + len > COMPRESS_BUFF_SZ)) {
+        if (run_flush(w) != NO_ERROR) {
+            return ERR_DB_FILE;
+        }
+    }
+
+    if (w->length == 0) {
+        w->start = offset;
+    }
+    memcpy(w->buffer + w->length, data, len);
+    w->length += len;
+    return NO_ERROR;
+}
+
+// writes the pending run, see run_write()
+int run_flush(run_writer_t *w){
+    if (w->length == 0) {
+        return NO_ERROR;
+    }
+
+    if (sdb_pwrite(w->fd, w->buffer, w->length, w->start) != (ssize_t) w->length) {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+    w->length = 0;
+    return NO_ERROR;
+}
+
+/*
+ *  open_tmp_db
+ *      dbPath:   name of the database that will be replaced
+ *      tmpPath:  receives the name of the temporary file
+ *      size:     size of the tmpPath buffer
+ * 
+ *  Creates the empty temporary database next to dbPath.  The temp file is
+ *  locked so that two rewrites (compactions running in online mode only
+ *  hold a shared lock on the database) never write it at the same time.
+ * 
+ *  returns:  <number>       fd of the temporary file
+ *            ERR_DB_FILE    it could not be created or is in use
+ * 
+ *  console:  M_ERR_DB_OPEN, M_ERR_DB_CREATE on error
+ */
+int open_tmp_db(char *dbPath, char *tmpPath, size_t size){
+    mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
+
+    db_sibling_path(dbPath, TMP_DB_FILE, tmpPath, size);
+
+    int newFd = open(tmpPath, O_RDWR | O_CREAT, mode);
+
+    // see if we made a new file successfully
+    if (newFd == -1) {
+        printf(M_ERR_DB_OPEN);
+        return ERR_DB_FILE;
+    }
+
+    if (flock(newFd, LOCK_EX | LOCK_NB) == -1 || ftruncate(newFd, 0) == -1) {
+        printf(M_ERR_DB_CREATE);
+        close(newFd);
+        return ERR_DB_FILE;
+    }
+
+    return newFd;
+}
+
+/*
+ *  install_tmp_db
+ *      newFd:    fd returned from open_tmp_db(), closed by this function
+ *      tmpPath:  name of the temporary file
+ *      dbPath:   name of the database it replaces
+ * 
+ *  Makes the temporary file durable, atomically renames it over the
+ *  database and makes the rename durable, so a crash leaves either the old
+ *  or the new database, never a partial one.  Processes that have the old
+ *  file open keep seeing it until they close it.
+ * 
+ *  returns:  NO_ERROR or ERR_DB_FILE (the temporary file is removed)
+ * 
+ *  console:  M_ERR_DB_WRITE, M_ERR_DB_CREATE on error
+ */
+int install_tmp_db(int newFd, char *tmpPath, char *dbPath){
+    if (fsync(newFd) == -1) {
+        printf(M_ERR_DB_WRITE);
+        close(newFd);
+        unlink(tmpPath);
+        return ERR_DB_FILE;
+    }
+    close(newFd);
+
+    if (rename(tmpPath, dbPath) == -1) {
+        printf(M_ERR_DB_CREATE);
+        unlink(tmpPath);
+        return ERR_DB_FILE;
+    }
+
+    if (sync_db_dir(dbPath) != NO_ERROR) {
+        printf(M_ERR_DB_CREATE);
+        return ERR_DB_FILE;
+    }
+
+    return NO_ERROR;
+}
+
+/*
+ *  sync_db_dir
+ *      dbPath:  name of the database file
+ * 
+ *  Makes the entries of the database's directory durable, so files created
+ *  or renamed next to the database survive a crash along with their data.
+ * 
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ * 
+ *  console:  This function does not produce any output
+ */
+int sync_db_dir(char *dbPath){
+    char dirPath[PATH_MAX];
+
+    db_sibling_path(dbPath, NULL, dirPath, sizeof(dirPath));
+    int dirFd = open(dirPath, O_RDONLY | O_DIRECTORY);
+    if (dirFd == -1) {
+        return ERR_DB_FILE;
+    }
+    if (fsync(dirFd) == -1) {
+        close(dirFd);
+        return ERR_DB_FILE;
+    }
+    close(dirFd);
+
+    return NO_ERROR;
+}
+
+// state threaded through scan_db_records() while compacting
+typedef struct compress_ctx {
+    run_writer_t out;
+    off_t liveEnd;          // end of the last live record seen
+    bool showProgress;
+    off_t nextProgress;
+    off_t fileSize;
+    struct timespec startTime;
+} compress_ctx_t;
+
+static double seconds_since(struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// scan_db_records() callback, appends a live record to the current run
+static int compress_record(void *arg, off_t offset, student_t *student) {
+    compress_ctx_t *ctx = (compress_ctx_t *) arg;
+
+    if (run_write(&ctx->out, offset, student, STUDENT_RECORD_SIZE) != NO_ERROR) {
+        return ERR_DB_FILE;
+    }
+    ctx->liveEnd = offset + STUDENT_RECORD_SIZE;
+
+    if (ctx->showProgress && offset >= ctx->nextProgress) {
+        double seconds = seconds_since(&ctx->startTime);
+        fprintf(stderr, M_DB_COMPRESS_PROG, (long long) offset >> 20, (long long) ctx->fileSize >> 20,
+                seconds > 0 ? (offset / 1e6) / seconds : 0.0);
+        ctx->nextProgress += COMPRESS_PROGRESS_SZ;
+    }
+
+    return NO_ERROR;
+}
+
 /*
  *  NOTE IMPLEMENTING THIS FUNCTION IS EXTRA CREDIT
  *
@@ -503,6 +961,25 @@ void print_student(student_t *s){
  *         #define DB_FILE     "student.db"        //name of database file
  *         #define TMP_DB_FILE ".tmp_student.db"   //for extra credit 
  * 
+ *  The copy is streamed: data extents of the old file (found with SEEK_DATA
+ *  and SEEK_HOLE so holes are never read) are read COMPRESS_BUFF_SZ bytes at
+ *  a time and runs of live records are written through an output buffer of
+ *  the same size.  Records keep their offset so add_student() can still find
+ *  an id's slot directly, deleted records simply become holes.  The temporary
+ *  file lives next to the database the caller opened (found from the fd) and
+ *  it and its directory are fsync'd before and after the rename, so a crash
+ *  leaves either the old or the new database, never a partial one.
+ * 
+ *  Writers are kept out by the lock main() takes before calling this.  In
+ *  online mode that lock is shared, so readers keep working against the old
+ *  file until the rename swaps the new one in; lock_db() makes anyone still
+ *  waiting on the old file reopen the new one.
+ * 
+ *  A v2 database is handed to convert_db() instead, which rebuilds the
+ *  string heap as well.  A v1 compaction leaves every byte of the file
+ *  where it was (up to the new, shorter size) so it does not need to mark
+ *  anything for --backup-since.
+ * 
  *  Note that you are passed in the fd of the database file to be compressed, 
  *  it is very likely you will need to close it to overwrite it with the
  *  compressed version of the file.  To ensure the caller can work with the
@@ -514,96 +991,112 @@ void print_student(student_t *s){
  * 
  * 
  *  console:  M_DB_COMPRESSED_OK  on success, the db was successfully compressed.
+ *            M_DB_COMPRESS_PROG  on stderr while running, if it is a terminal
  *            M_ERR_DB_OPEN    error when opening/creating temporary database file.
  *                             this error should also be returned after you
  *                             compressed the database file and if you are unable
  *                             to open it to pass the fd back to the caller
  *            M_ERR_DB_CREATE  error creating the db file. For instance the
  *                             inability to copy the temporary file back as
- *                             the primary database file. 
+ *                             the primary database file, or another compaction
+ *                             already running
  *            M_ERR_DB_READ    error reading or seeking the the db or tempdb file
  *            M_ERR_DB_WRITE   error writing to db or tempdb file (adding student)
  *            
  */
-int compress_db(int fd){
+static int compress_db_impl(int fd, bool online) {
+    // a v2 database is compacted by rewriting it, which also drops names
+    // no student refers to any more
+    if (db_is_v2(fd)) {
+        int newFd = convert_db(fd, true, online);
+        if (newFd >= 0) {
+            printf(M_DB_COMPRESSED_OK);
+        }
+        return newFd;
+    }
+
     int originalFd = fd;
     int newFd;
-
-    mode_t mode = S_IRUSR | S_IWUSR;
-
-    newFd = open(TMP_DB_FILE, O_WRONLY | O_CREAT | O_TRUNC, mode);
-
-    // see if we made a new file successfully
-    if (newFd == -1) {
-        printf(M_ERR_DB_OPEN);
+    char dbPath[PATH_MAX];
+    char tmpPath[PATH_MAX];
+
+    // the temp file goes in the same directory as the database the caller
+    // opened so the final rename() never crosses a filesystem
+    db_path_from_fd(originalFd, dbPath, sizeof(dbPath));
+    newFd = open_tmp_db(dbPath, tmpPath, sizeof(tmpPath));
+    if (newFd < 0) {
         return ERR_DB_FILE;
     }
 
-    // now we follow the same algorithm we used for printing the db, except now we write at each found student instead of printing
-    if (lseek(originalFd, 0, SEEK_SET) == -1) {
-        printf(M_ERR_DB_READ);
+    compress_ctx_t ctx = {0};
+    ctx.out.fd = newFd;
+    ctx.out.buffer = malloc(COMPRESS_BUFF_SZ);
+    ctx.showProgress = isatty(STDERR_FILENO);
+    ctx.nextProgress = COMPRESS_PROGRESS_SZ;
+    ctx.fileSize = sdb_lseek(originalFd, 0, SEEK_END);
+    clock_gettime(CLOCK_MONOTONIC, &ctx.startTime);
+
+    if (ctx.out.buffer == NULL) {
+        printf(M_ERR_DB_CREATE);
+        close(newFd);
+        unlink(tmpPath);
         return ERR_DB_FILE;
     }
 
-    bool endOfFile = false;
-    ssize_t bytesRead;
-    student_t* studentBuffer = (student_t*) malloc(STUDENT_RECORD_SIZE);
-
-    while (!endOfFile) {
-        bytesRead = read(originalFd, studentBuffer, STUDENT_RECORD_SIZE);
+    int rc = scan_db_records(originalFd, compress_record, &ctx, NULL);
 
-        // reached EOF
-        if (bytesRead == 0) {
-            break;
-        }
-
-        // got an error reading
-        if (bytesRead < 0) {
-            printf(M_ERR_DB_READ);
-            return ERR_DB_FILE;
-        }
-
-        // don't print student section is that empty
-        if (memcmp(studentBuffer, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) == 0) {
-            continue;
-        }
+    if (ctx.showProgress && ctx.nextProgress > COMPRESS_PROGRESS_SZ) {
+        fprintf(stderr, "\n");
+    }
 
-        // found a student, so write to temporary file
-        ssize_t bytesWritten = write(newFd, studentBuffer, STUDENT_RECORD_SIZE);
+    // write out the last run, then size the file so trailing holes are
+    // dropped
+    if (rc == NO_ERROR) {
+        rc = run_flush(&ctx.out);
+    }
+    free(ctx.out.buffer);
 
-        // if we had an error writing the new student found to temp file
-        if (bytesWritten <= 0) {
-            printf(M_ERR_DB_WRITE);
-            return ERR_DB_FILE;
-        }    
+    if (rc == NO_ERROR && ftruncate(newFd, ctx.liveEnd) == -1) {
+        printf(M_ERR_DB_WRITE);
+        rc = ERR_DB_FILE;
     }
 
-    // close original file so we can overwrite its contents via renaming
-    int closeErr = close(originalFd);
+    if (rc != NO_ERROR) {
+        close(newFd);
+        unlink(tmpPath);
+        return rc;
+    }
 
-    // if there was an I/O error when closing the file
-    if (closeErr == -1) {
-        printf(M_ERR_DB_CREATE);
+    // now we atomically swap the new file in, readers holding the old file
+    // keep seeing it until they close it
+    if (install_tmp_db(newFd, tmpPath, dbPath) != NO_ERROR) {
         return ERR_DB_FILE;
     }
 
-
-    // now we rename the temporary file
-    int renameErr = rename(TMP_DB_FILE, DB_FILE);
-
-    // if there was an error renaming
-    if (renameErr == -1) {
+    // close original file, this also releases our lock on it
+    if (close(originalFd) == -1) {
         printf(M_ERR_DB_CREATE);
         return ERR_DB_FILE;
     }
 
     printf(M_DB_COMPRESSED_OK);
 
-    int returnFd = open_db(DB_FILE, false);
+    int returnFd = open_db(dbPath, false);
+    if (returnFd >= 0) {
+        returnFd = lock_db(dbPath, returnFd, !online);
+    }
 
     return returnFd;
 }
 
+// instrumented entry point for compress_db(), see sdbstats.h
+int compress_db(int fd, bool online) {
+    stats_begin(STATS_OP_COMPRESS_DB);
+    int rc = compress_db_impl(fd, online);
+    stats_end(STATS_OP_COMPRESS_DB);
+    return rc;
+}
+
 
 /*
  *  validate_range
@@ -650,8 +1143,49 @@ void usage(char *exename){
     printf("\t-d id:  deletes a student\n");
     printf("\t-f id:  finds and prints a student in the database\n");
     printf("\t-p:  prints all records in the student database\n");
-    printf("\t-x:  compress the database file [EXTRA CREDIT]\n");
-    printf("\t-z:  zero db file (remove all records)\n");
+    printf("\t-x [online]:  compress the database file, online lets readers continue\n");
+    printf("\t-z [v2]:  zero db file (remove all records), v2 starts it in the v2 format\n");
+    printf("\t--convert v1|v2:  rewrite the database in the v1 or the compact v2 format\n");
+    printf("\t--snapshot name:  copy the database to the new file name, and\n");
+    printf("\t                  start tracking changes from that point\n");
+    printf("\t--backup-since name file:  write the pages changed since snapshot name\n");
+    printf("\t--txn file:  apply every add (a), delete (d) and update (u) line in\n");
+    printf("\t             file as one transaction, all or nothing\n");
+    printf("\t--stats[=file.json]:  report per operation timings and I/O counts\n");
+    printf("\t                      on stderr or to a JSON file (or set %s)\n", STATS_ENV_VAR);
+}
+
+/*
+ *  parse_stats_flag
+ *      argc, argv:  the arguments passed to main()
+ *
+ *  Turns on instrumentation if the SDBSC_STATS environment variable is set
+ *  or if any argument is --stats or --stats=file.json.  Those arguments are
+ *  removed from argv so the rest of main() sees the usual option layout.
+ *
+ *  returns:    the new argc
+ *
+ *  console:  This function does not produce any output
+ */
+int parse_stats_flag(int argc, char *argv[]){
+    char *statsEnv = getenv(STATS_ENV_VAR);
+    int flagLen = strlen(STATS_FLAG);
+    int newArgc = 0;
+
+    if (statsEnv != NULL && *statsEnv != '\0' && strcmp(statsEnv, "0") != 0)
+        stats_init(statsEnv);
+
+    for (int i = 0; i < argc; i++) {
+        if (i > 0 && strncmp(argv[i], STATS_FLAG, flagLen) == 0 &&
+                (argv[i][flagLen] == '\0' || argv[i][flagLen] == '=')) {
+            stats_init(argv[i][flagLen] == '=' ? argv[i] + flagLen + 1 : NULL);
+            continue;
+        }
+        argv[newArgc++] = argv[i];
+    }
+    argv[newArgc] = NULL;
+
+    return newArgc;
 }
 
 
@@ -663,12 +1197,17 @@ int main(int argc, char *argv[]){
     int exit_code;      //exit code to shell
     int id;             //userid from argv[2]
     int gpa;            //gpa from argv[5]
+    bool online;        //-x online, compact while readers keep going
+    bool exclusive;     //operation needs an exclusive lock on the db
+    off_t oldSize;      //-z, size of the database before it is emptied
 
     //space for a student structure which we will get back from
     //some of the functions we will be writing such as get_student(),
     //and print_student(). 
     student_t student = {0};
 
+    argc = parse_stats_flag(argc, argv);
+
     //This function must have at least one arg, and the arg must start
     //with a dash
     if ((argc < 2) || (*argv[1] != '-')){
@@ -679,6 +1218,14 @@ int main(int argc, char *argv[]){
     //The option is the first character after the dash for example
     //-h -a -c -d -f -p -x -z
     opt = (char)*(argv[1]+1);   //get the option flag
+    if (strcmp(argv[1], TXN_FLAG) == 0)
+        opt = OPT_TXN;
+    if (strcmp(argv[1], CONVERT_FLAG) == 0)
+        opt = OPT_CONVERT;
+    if (strcmp(argv[1], SNAPSHOT_FLAG) == 0)
+        opt = OPT_SNAPSHOT;
+    if (strcmp(argv[1], BACKUP_FLAG) == 0)
+        opt = OPT_BACKUP;
 
     //handle the help flag and then exit normally
     if (opt == 'h'){
@@ -694,6 +1241,27 @@ int main(int argc, char *argv[]){
         exit(EXIT_FAIL_DB);
     }
 
+    //operations that change the database need it to themselves, everything
+    //else (including online compaction, snapshots and backups) only keeps
+    //writers out
+    online = (opt == 'x' && argc == 3 && strcmp(argv[2], COMPRESS_ONLINE_ARG) == 0);
+    exclusive = (opt == 'a' || opt == 'd' || opt == 'z' || opt == OPT_TXN || opt == OPT_CONVERT ||
+                 (opt == 'x' && !online));
+
+    //finish any transaction that committed but was interrupted before it
+    //was applied, this needs the database to ourselves for a moment
+    if (access(REDO_DB_FILE, F_OK) == 0){
+        fd = lock_db(DB_FILE, fd, true);
+        if (fd < 0 || replay_redo_log(fd) < 0){
+            exit(EXIT_FAIL_DB);
+        }
+    }
+
+    fd = lock_db(DB_FILE, fd, exclusive);
+    if (fd < 0){
+        exit(EXIT_FAIL_DB);
+    }
+
     //set rc to the return code of the operation to ensure the program
     //use that to determine the proper exit_code.  Look at the header
     //sdbsc.h for expected values. 
@@ -799,24 +1367,107 @@ int main(int argc, char *argv[]){
             //prog_name     -x 
             //-----------------
             //example:  prog_name -x 
+            //          prog_name -x online
 
             //remember compress_db returns a fd of the compressed database.
             //we close it after this switch statement 
-            fd = compress_db(fd);
+            fd = compress_db(fd, online);
             if (fd < 0)
                 exit_code = EXIT_FAIL_DB;
             break;
 
+        case OPT_TXN:
+            //    arv[0] arv[1] arv[2]
+            //prog_name  --txn   file
+            //-------------------------
+            //example:  prog_name --txn enroll.txn
+            if (argc != 3){
+                usage(argv[0]);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            if (db_is_v2(fd)){
+                printf(M_ERR_DB_V2_TXN);
+                exit_code = EXIT_FAIL_DB;
+                break;
+            }
+            rc = run_txn(fd, argv[2]);
+            if (rc < 0)
+                exit_code = EXIT_FAIL_DB;
+            break;
+
+        case OPT_CONVERT:
+            //    arv[0]    arv[1] arv[2]
+            //prog_name --convert  v1|v2
+            //---------------------------
+            //example:  prog_name --convert v2
+            if (argc != 3 || (strcmp(argv[2], DB_V1_ARG) != 0 && strcmp(argv[2], DB_V2_ARG) != 0)){
+                usage(argv[0]);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            fd = convert_db(fd, strcmp(argv[2], DB_V2_ARG) == 0, false);
+            if (fd < 0){
+                exit_code = EXIT_FAIL_DB;
+                break;
+            }
+            printf(M_DB_CONVERTED, argv[2]);
+            break;
+
+        case OPT_SNAPSHOT:
+            //    arv[0]     arv[1] arv[2]
+            //prog_name --snapshot   name
+            //----------------------------
+            //example:  prog_name --snapshot nightly.db
+            if (argc != 3){
+                usage(argv[0]);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            rc = snapshot_db(fd, argv[2]);
+            if (rc < 0)
+                exit_code = EXIT_FAIL_DB;
+            break;
+
+        case OPT_BACKUP:
+            //    arv[0]         arv[1] arv[2] arv[3]
+            //prog_name --backup-since   name   file
+            //----------------------------------------
+            //example:  prog_name --backup-since nightly.db changes.bak
+            if (argc != 4){
+                usage(argv[0]);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            rc = backup_since(fd, argv[2], argv[3]);
+            if (rc < 0)
+                exit_code = EXIT_FAIL_DB;
+            break;
+
         case 'z':
-            //    arv[0] arv[1]    
-            //prog_name     -x 
+            //    arv[0] arv[1] arv[2]
+            //prog_name     -z   [v2]
             //-----------------
-            //example:  prog_name -x 
-            //HINT:  close the db file, we already have fd 
-            //       and reopen db indicating truncate=true
-            close(fd);
-            fd = open_db(DB_FILE, true);
-            if (fd < 0){
+            //example:  prog_name -z 
+            //          prog_name -z v2
+            //truncate through the fd we already hold locked rather than
+            //closing and reopening it, which would drop the lock
+            oldSize = sdb_lseek(fd, 0, SEEK_END);
+            if (oldSize == -1){
+                printf(M_ERR_DB_READ);
+                exit_code = EXIT_FAIL_DB;
+                break;
+            }
+            if (dirty_mark(fd, 0, oldSize) != NO_ERROR){
+                exit_code = EXIT_FAIL_DB;
+                break;
+            }
+            if (ftruncate(fd, 0) == -1){
+                printf(M_ERR_DB_WRITE);
+                exit_code = EXIT_FAIL_DB;
+                break;
+            }
+            if (argc == 3 && strcmp(argv[2], DB_V2_ARG) == 0 && v2_init_db(fd) != NO_ERROR){
                 exit_code = EXIT_FAIL_DB;
                 break;
             }
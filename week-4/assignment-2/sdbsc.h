@@ -1,5 +1,7 @@
 #ifndef __SDB_H__
 
+#include <sys/types.h>
+
 #include "db.h" //get student record type
 
 //prototypes for functions go below for this assignment
@@ -7,12 +9,73 @@ int open_db(char *dbFile, bool should_truncate);
 int add_student(int fd, int id, char *fname, char *lname, int gpa);
 int get_student(int fd, int id, student_t *s);
 int del_student(int fd, int id);
-int compress_db(int fd);
+int compress_db(int fd, bool online);
+int lock_db(char *dbFile, int fd, bool exclusive);
+void db_path_from_fd(int fd, char *path, size_t size);
+void db_sibling_path(const char *dbPath, const char *name, char *out, size_t size);
+off_t student_offset(int id);
+
+//scan_db_records() calls back once per live record, returning anything other
+//than NO_ERROR from the callback stops the scan
+typedef int (*record_cb_t)(void *ctx, off_t offset, student_t *student);
+int scan_db_records(int fd, record_cb_t callback, void *ctx, long long *bytesScanned);
+
+//buffered writer that turns runs of adjacent records into single pwrites
+typedef struct run_writer {
+    int    fd;
+    char   *buffer;         //COMPRESS_BUFF_SZ bytes
+    off_t  start;           //file offset of the first byte in buffer
+    size_t length;          //bytes waiting in buffer
+} run_writer_t;
+int run_write(run_writer_t *w, off_t offset, const void *data, size_t len);
+int run_flush(run_writer_t *w);
+
+//rewrites go to a temporary file that is then swapped in atomically
+int open_tmp_db(char *dbPath, char *tmpPath, size_t size);
+int install_tmp_db(int newFd, char *tmpPath, char *dbPath);
+int sync_db_dir(char *dbPath);
+
+//transactions, see sdbtxn.c
+int run_txn(int fd, char *txnFile);
+int replay_redo_log(int fd);
+
+//v2 storage format, see db.h and sdbv2.c
+bool db_is_v2(int fd);
+int v2_init_db(int fd);
+int v2_get_student(int fd, int id, student_t *s);
+int v2_add_student(int fd, int id, char *fname, char *lname, int gpa);
+int v2_del_student(int fd, int id);
+int v2_count_db_records(int fd);
+int v2_print_db(int fd);
+int v2_scan_records(int fd, record_cb_t callback, void *ctx, bool withNames);
+int convert_db(int fd, bool toV2, bool online);
+
+//snapshots and incremental backups, see sdbbackup.c
+int snapshot_db(int fd, char *name);
+int backup_since(int fd, char *snapshot, char *outName);
+int dirty_mark(int fd, off_t offset, off_t len);
+
+//long options map onto option characters that can not be typed after a
+//single dash so they can share the switch in main()
+#define TXN_FLAG        "--txn"
+#define OPT_TXN         '\001'
+#define CONVERT_FLAG    "--convert"
+#define OPT_CONVERT     '\002'
+#define SNAPSHOT_FLAG   "--snapshot"
+#define OPT_SNAPSHOT    '\003'
+#define BACKUP_FLAG     "--backup-since"
+#define OPT_BACKUP      '\004'
+
+//operations in a transaction file
+#define TXN_OP_ADD      'a'
+#define TXN_OP_DEL      'd'
+#define TXN_OP_UPDATE   'u'
 void print_student(student_t *s);
 int validate_range(int id, int gpa);
 int count_db_records(int fd);
 int print_db(int fd);
 void usage(char *);
+int parse_stats_flag(int argc, char *argv[]);
 
 //error codes to be returned from individual functions
 // NO_ERROR is returned if there are no errors
@@ -49,9 +112,23 @@ void usage(char *);
 #define M_STD_DEL_MSG     "Student %d was deleted from database.\n"
 #define M_STD_NOT_FND_MSG "Student %d was not found in database.\n"
 #define M_DB_COMPRESSED_OK "Database successfully compressed!\n"
+#define M_DB_COMPRESS_PROG "\rcompacting: %lld of %lld MB scanned (%.1f MB/s)"
 #define M_DB_ZERO_OK      "All database records removed!\n"
 #define M_DB_EMPTY        "Database contains no student records.\n"
 #define M_DB_RECORD_CNT   "Database contains %d student record(s).\n"
+#define M_TXN_COMMITTED   "Transaction committed, %d operation(s) applied.\n"
+#define M_TXN_ABORTED     "Transaction aborted, no changes were made.\n"
+#define M_TXN_RECOVERED   "Recovered committed transaction, %d record(s) replayed.\n"
+#define M_TXN_LINE        "Transaction line %d: "
+#define M_ERR_TXN_OPEN    "Cant open transaction file %s.\n"
+#define M_ERR_TXN_PARSE   "Transaction line %d is not a valid operation.\n"
+#define M_DB_CONVERTED    "Database converted to %s format.\n"
+#define M_ERR_DB_V2_TXN   "Transactions are not supported on a v2 database, convert it to v1 first.\n"
+#define M_DB_SNAPSHOT_OK  "Snapshot %s taken, %lld bytes copied.\n"
+#define M_DB_BACKUP_OK    "Backup since %s written, %d changed page(s).\n"
+#define M_ERR_SNAPSHOT    "Cant create snapshot %s.\n"
+#define M_ERR_BACKUP_BASE "Changes are not being tracked since snapshot %s.\n"
+#define M_ERR_BACKUP_OUT  "Cant write backup file %s.\n"
 #define M_NOT_IMPL        "The requested operation is not implemented yet!\n"
 
 //useful format strings for print students
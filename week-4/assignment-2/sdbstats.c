@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sdbstats.h"
+
+bool sdb_stats_enabled = false;
+
+static const char *STATS_OP_NAMES[STATS_OP_MAX] = {
+    "get_student",
+    "add_student",
+    "del_student",
+    "count_db_records",
+    "print_db",
+    "compress_db",
+    "run_txn",
+    "snapshot_db",
+    "backup_since",
+};
+
+static op_stats_t opStats[STATS_OP_MAX];
+
+// operations can nest (add_student calls get_student) so we keep a small stack
+// of the active operations, every syscall is charged to all of them so the
+// numbers reported for an operation are inclusive of what it called.  Begins
+// past the top of the stack are only counted, so their ends can be matched
+// and ignored instead of popping a frame that belongs to an outer operation
+#define STATS_MAX_DEPTH 8
+static stats_op_t activeOps[STATS_MAX_DEPTH];
+static uint64_t activeStart[STATS_MAX_DEPTH];
+static int activeDepth = 0;
+static int droppedDepth = 0;
+
+static char *jsonPath = NULL;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/*
+ *  stats_init
+ *      dest:  NULL, "1" or "stderr" to report on stderr, otherwise the path
+ *             of a file that will receive a JSON report
+ *
+ *  Turns instrumentation on and registers the report to run at exit.
+ *
+ *  returns:  0 on success, -1 if stats were already enabled
+ */
+int stats_init(const char *dest) {
+    if (sdb_stats_enabled) {
+        return -1;
+    }
+
+    if (dest != NULL && *dest != '\0' && strcmp(dest, "1") != 0 && strcmp(dest, "stderr") != 0) {
+        jsonPath = strdup(dest);
+    }
+
+    memset(opStats, 0, sizeof(opStats));
+    sdb_stats_enabled = true;
+    atexit(stats_report);
+    return 0;
+}
+
+void stats_begin(stats_op_t op) {
+    if (!sdb_stats_enabled) {
+        return;
+    }
+    if (activeDepth >= STATS_MAX_DEPTH) {
+        droppedDepth++;
+        return;
+    }
+
+    activeOps[activeDepth] = op;
+    activeStart[activeDepth] = now_ns();
+    activeDepth++;
+    opStats[op].calls++;
+}
+
+void stats_end(stats_op_t op) {
+    if (!sdb_stats_enabled) {
+        return;
+    }
+    if (droppedDepth > 0) {
+        droppedDepth--;
+        return;
+    }
+    if (activeDepth == 0) {
+        return;
+    }
+
+    // operations are strictly nested so the top of the stack is always op
+    activeDepth--;
+    opStats[op].wall_ns += now_ns() - activeStart[activeDepth];
+}
+
+void stats_count_read(ssize_t bytes) {
+    for (int i = 0; i < activeDepth; i++) {
+        opStats[activeOps[i]].reads++;
+        if (bytes > 0) {
+            opStats[activeOps[i]].bytes_read += (uint64_t) bytes;
+        }
+    }
+}
+
+void stats_count_write(ssize_t bytes) {
+    for (int i = 0; i < activeDepth; i++) {
+        opStats[activeOps[i]].writes++;
+        if (bytes > 0) {
+            opStats[activeOps[i]].bytes_written += (uint64_t) bytes;
+        }
+    }
+}
+
+void stats_count_seek(void) {
+    for (int i = 0; i < activeDepth; i++) {
+        opStats[activeOps[i]].seeks++;
+    }
+}
+
+void stats_count_records(int records) {
+    for (int i = 0; i < activeDepth; i++) {
+        opStats[activeOps[i]].records += (uint64_t) records;
+    }
+}
+
+static void report_text(FILE *out) {
+    fprintf(out, "%-18s %6s %12s %8s %8s %8s %12s %12s %10s\n", "OPERATION", "CALLS",
+            "WALL_US", "READS", "WRITES", "SEEKS", "BYTES_RD", "BYTES_WR", "RECORDS");
+
+    for (int op = 0; op < STATS_OP_MAX; op++) {
+        op_stats_t *s = &opStats[op];
+        if (s->calls == 0) {
+            continue;
+        }
+        fprintf(out, "%-18s %6llu %12.3f %8llu %8llu %8llu %12llu %12llu %10llu\n",
+                STATS_OP_NAMES[op], (unsigned long long) s->calls, s->wall_ns / 1000.0,
+                (unsigned long long) s->reads, (unsigned long long) s->writes,
+                (unsigned long long) s->seeks, (unsigned long long) s->bytes_read,
+                (unsigned long long) s->bytes_written, (unsigned long long) s->records);
+    }
+}
+
+static void report_json(FILE *out) {
+    bool first = true;
+
+    fprintf(out, "{\"ops\": [");
+    for (int op = 0; op < STATS_OP_MAX; op++) {
+        op_stats_t *s = &opStats[op];
+        if (s->calls == 0) {
+            continue;
+        }
+        fprintf(out, "%s\n  {\"op\": \"%s\", \"calls\": %llu, \"wall_ns\": %llu, \"reads\": %llu, "
+                "\"writes\": %llu, \"seeks\": %llu, \"bytes_read\": %llu, \"bytes_written\": %llu, "
+                "\"records\": %llu}",
+                first ? "" : ",", STATS_OP_NAMES[op], (unsigned long long) s->calls,
+                (unsigned long long) s->wall_ns, (unsigned long long) s->reads,
+                (unsigned long long) s->writes, (unsigned long long) s->seeks,
+                (unsigned long long) s->bytes_read, (unsigned long long) s->bytes_written,
+                (unsigned long long) s->records);
+        first = false;
+    }
+    fprintf(out, "\n]}\n");
+}
+
+/*
+ *  stats_report
+ *
+ *  Writes the collected numbers either to stderr as a table or to the JSON
+ *  file given to stats_init().  Registered with atexit() so every exit path
+ *  out of main() produces a report.
+ */
+void stats_report(void) {
+    if (!sdb_stats_enabled) {
+        return;
+    }
+
+    // keep the report after any normal output when both go to a terminal
+    fflush(stdout);
+
+    if (jsonPath == NULL) {
+        report_text(stderr);
+        return;
+    }
+
+    FILE *out = fopen(jsonPath, "w");
+    if (out == NULL) {
+        perror(jsonPath);
+        return;
+    }
+    report_json(out);
+    fclose(out);
+}
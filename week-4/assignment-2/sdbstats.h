@@ -0,0 +1,103 @@
+#ifndef __SDB_STATS_H__
+    #define __SDB_STATS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+//Instrumentation layer for sdbsc.  When enabled (either with the --stats
+//command line flag or the SDBSC_STATS environment variable) every public
+//database operation records its wall time using a monotonic clock, the
+//number of read/write/lseek syscalls it issued, the bytes it moved and the
+//number of student records it examined.  A report is emitted at exit to
+//stderr or, if a file name was given, as a JSON document.
+//
+//When disabled the only cost is a single predictable branch on a global
+//flag inside each syscall wrapper.
+
+//operations that are tracked, keep in sync with STATS_OP_NAMES in sdbstats.c
+typedef enum {
+    STATS_OP_GET_STUDENT,
+    STATS_OP_ADD_STUDENT,
+    STATS_OP_DEL_STUDENT,
+    STATS_OP_COUNT_DB,
+    STATS_OP_PRINT_DB,
+    STATS_OP_COMPRESS_DB,
+    STATS_OP_TXN,
+    STATS_OP_SNAPSHOT,
+    STATS_OP_BACKUP,
+    STATS_OP_MAX
+} stats_op_t;
+
+typedef struct op_stats {
+    uint64_t calls;
+    uint64_t wall_ns;
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t seeks;
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint64_t records;
+} op_stats_t;
+
+//environment variable that turns on stats, "1" or "stderr" reports to
+//stderr, anything else is treated as the path of a JSON report file
+#define STATS_ENV_VAR       "SDBSC_STATS"
+#define STATS_FLAG          "--stats"
+
+extern bool sdb_stats_enabled;
+
+int stats_init(const char *dest);
+void stats_begin(stats_op_t op);
+void stats_end(stats_op_t op);
+void stats_report(void);
+
+//slow paths, only called when stats are enabled
+void stats_count_read(ssize_t bytes);
+void stats_count_write(ssize_t bytes);
+void stats_count_seek(void);
+void stats_count_records(int records);
+
+//syscall wrappers used by the database code in place of read/write/lseek
+//and their positioned variants
+static inline ssize_t sdb_read(int fd, void *buf, size_t count) {
+    ssize_t rc = read(fd, buf, count);
+    if (__builtin_expect(sdb_stats_enabled, 0))
+        stats_count_read(rc);
+    return rc;
+}
+
+static inline ssize_t sdb_write(int fd, const void *buf, size_t count) {
+    ssize_t rc = write(fd, buf, count);
+    if (__builtin_expect(sdb_stats_enabled, 0))
+        stats_count_write(rc);
+    return rc;
+}
+
+static inline ssize_t sdb_pread(int fd, void *buf, size_t count, off_t offset) {
+    ssize_t rc = pread(fd, buf, count, offset);
+    if (__builtin_expect(sdb_stats_enabled, 0))
+        stats_count_read(rc);
+    return rc;
+}
+
+static inline ssize_t sdb_pwrite(int fd, const void *buf, size_t count, off_t offset) {
+    ssize_t rc = pwrite(fd, buf, count, offset);
+    if (__builtin_expect(sdb_stats_enabled, 0))
+        stats_count_write(rc);
+    return rc;
+}
+
+static inline off_t sdb_lseek(int fd, off_t offset, int whence) {
+    if (__builtin_expect(sdb_stats_enabled, 0))
+        stats_count_seek();
+    return lseek(fd, offset, whence);
+}
+
+static inline void sdb_records(int records) {
+    if (__builtin_expect(sdb_stats_enabled, 0))
+        stats_count_records(records);
+}
+
+#endif
@@ -0,0 +1,490 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+//database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbstats.h"
+
+// one parsed line of a transaction file
+typedef struct txn_op {
+    char op;                // TXN_OP_ADD, TXN_OP_DEL or TXN_OP_UPDATE
+    int  line;              // line number in the transaction file
+    int  id;
+    char fname[24];
+    char lname[32];
+    int  gpa;
+} txn_op_t;
+
+// in-memory state of one student touched by the transaction
+typedef struct txn_slot {
+    int       id;
+    bool      wasPresent;   // present in the database before the txn
+    off_t     oldOffset;    // where it lives in the database if wasPresent
+    bool      present;      // present after the ops applied so far
+    off_t     offset;       // where it will live if present
+    student_t record;
+} txn_slot_t;
+
+// what txn_locate() needs to find the slot for a record it is shown
+typedef struct txn_locate_ctx {
+    txn_slot_t *slots;
+    int numSlots;
+} txn_locate_ctx_t;
+
+// a full record image to be written at an offset, also the redo entry format
+typedef struct txn_write {
+    int64_t   offset;
+    student_t record;
+} txn_write_t;
+
+// header of the redo journal, followed by count txn_write_t entries
+typedef struct txn_redo_hdr {
+    char     magic[8];
+    uint32_t count;
+    uint32_t checksum;
+} txn_redo_hdr_t;
+
+static const char TXN_REDO_MAGIC[8] = {'S', 'D', 'B', 'R', 'E', 'D', 'O', '1'};
+
+// FNV-1a, enough to tell a complete journal from a torn one
+static uint32_t redo_checksum(const void *data, size_t len) {
+    const unsigned char *bytes = data;
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int cmp_slot_id(const void *a, const void *b) {
+    return ((const txn_slot_t *) a)->id - ((const txn_slot_t *) b)->id;
+}
+
+static int cmp_write_offset(const void *a, const void *b) {
+    int64_t lhs = ((const txn_write_t *) a)->offset;
+    int64_t rhs = ((const txn_write_t *) b)->offset;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+static txn_slot_t *find_slot(txn_slot_t *slots, int numSlots, int id) {
+    txn_slot_t key = { .id = id };
+    return bsearch(&key, slots, numSlots, sizeof(txn_slot_t), cmp_slot_id);
+}
+
+// scan_db_records() callback, remembers where touched students live
+static int txn_locate(void *ctx, off_t offset, student_t *student) {
+    txn_locate_ctx_t *locate = ctx;
+    txn_slot_t *slot = find_slot(locate->slots, locate->numSlots, student->id);
+
+    if (slot != NULL && !slot->wasPresent) {
+        slot->wasPresent = slot->present = true;
+        slot->oldOffset = slot->offset = offset;
+        slot->record = *student;
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  parse_txn_file
+ *      txnFile:  name of the transaction file
+ *      ops:      receives a malloc'd array of parsed operations
+ *
+ *  Each non empty line that does not start with # is one operation:
+ *
+ *      a id first_name last_name gpa     add a student
+ *      d id                              delete a student
+ *      u id first_name last_name gpa     update an existing student
+ *
+ *  returns:  <number>       the number of operations parsed
+ *            ERR_DB_OP      the file could not be read or a line is invalid
+ *
+ *  console:  M_ERR_TXN_OPEN, M_ERR_TXN_PARSE, M_ERR_STD_RNG on error
+ */
+static int parse_txn_file(char *txnFile, txn_op_t **ops) {
+    FILE *in = fopen(txnFile, "r");
+    if (in == NULL) {
+        printf(M_ERR_TXN_OPEN, txnFile);
+        return ERR_DB_OP;
+    }
+
+    int numOps = 0;
+    int capacity = 16;
+    int lineNo = 0;
+    char *line = NULL;
+    size_t lineCap = 0;
+    txn_op_t *parsed = malloc(capacity * sizeof(txn_op_t));
+
+    while (parsed != NULL && getline(&line, &lineCap, in) != -1) {
+        char *fields[6];
+        int numFields = 0;
+        char *savePtr = NULL;
+
+        lineNo++;
+        for (char *tok = strtok_r(line, " \t\r\n", &savePtr); tok != NULL && numFields < 6;
+                tok = strtok_r(NULL, " \t\r\n", &savePtr)) {
+            fields[numFields++] = tok;
+        }
+
+        if (numFields == 0 || fields[0][0] == '#') {
+            continue;
+        }
+
+        char op = fields[0][0];
+        bool wantsNames = (op == TXN_OP_ADD || op == TXN_OP_UPDATE);
+        if (fields[0][1] != '\0' || (op != TXN_OP_DEL && !wantsNames) ||
+                numFields != (wantsNames ? 5 : 2)) {
+            printf(M_ERR_TXN_PARSE, lineNo);
+            free(parsed);
+            parsed = NULL;
+            break;
+        }
+
+        if (numOps == capacity) {
+            capacity *= 2;
+            txn_op_t *grown = realloc(parsed, capacity * sizeof(txn_op_t));
+            if (grown == NULL) {
+                free(parsed);
+                parsed = NULL;
+                break;
+            }
+            parsed = grown;
+        }
+
+        //same conversions as the -a and -d command line options
+        txn_op_t *cur = &parsed[numOps];
+        memset(cur, 0, sizeof(*cur));
+        cur->op = op;
+        cur->line = lineNo;
+        cur->id = atoi(fields[1]);
+        if (wantsNames) {
+            strncpy(cur->fname, fields[2], sizeof(cur->fname) - 1);
+            strncpy(cur->lname, fields[3], sizeof(cur->lname) - 1);
+            cur->gpa = atoi(fields[4]);
+        }
+
+        if (validate_range(cur->id, wantsNames ? cur->gpa : MIN_STD_GPA) != NO_ERROR) {
+            printf(M_TXN_LINE, lineNo);
+            printf(M_ERR_STD_RNG);
+            free(parsed);
+            parsed = NULL;
+            break;
+        }
+        numOps++;
+    }
+
+    free(line);
+    fclose(in);
+
+    if (parsed == NULL) {
+        return ERR_DB_OP;
+    }
+
+    *ops = parsed;
+    return numOps;
+}
+
+// writes sorted record images, merging adjacent ones into a single pwrite
+static int apply_writes(int fd, txn_write_t *writes, int numWrites) {
+    student_t *run = malloc((numWrites > 0 ? numWrites : 1) * sizeof(student_t));
+    if (run == NULL) {
+        return ERR_DB_FILE;
+    }
+
+    int i = 0;
+    while (i < numWrites) {
+        int runLen = 0;
+        off_t runStart = writes[i].offset;
+
+        do {
+            run[runLen++] = writes[i].record;
+            i++;
+        } while (i < numWrites && writes[i].offset == runStart + (off_t) runLen * STUDENT_RECORD_SIZE);
+
+        size_t runBytes = (size_t) runLen * STUDENT_RECORD_SIZE;
+        if (dirty_mark(fd, runStart, runBytes) != NO_ERROR ||
+                sdb_pwrite(fd, run, runBytes, runStart) != (ssize_t) runBytes) {
+            free(run);
+            return ERR_DB_FILE;
+        }
+    }
+
+    free(run);
+    return NO_ERROR;
+}
+
+/*
+ *  replay_redo_log
+ *      fd:  linux file descriptor of the database, locked exclusively
+ *
+ *  If a transaction committed its redo journal but did not get to finish
+ *  applying it (for instance the machine crashed), the journal is replayed
+ *  here.  Entries are full record images so replaying twice is harmless.
+ *  A journal that is incomplete was never committed and is discarded.
+ *
+ *  returns:  NO_ERROR       no journal, or the journal was handled
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  M_TXN_RECOVERED  when a committed transaction was replayed
+ *            M_ERR_DB_WRITE   error writing to the db file
+ */
+int replay_redo_log(int fd) {
+    char dbPath[PATH_MAX];
+    char redoPath[PATH_MAX];
+
+    db_path_from_fd(fd, dbPath, sizeof(dbPath));
+    db_sibling_path(dbPath, REDO_DB_FILE, redoPath, sizeof(redoPath));
+
+    int redoFd = open(redoPath, O_RDONLY);
+    if (redoFd == -1) {
+        return NO_ERROR;
+    }
+
+    struct stat redoStat;
+    txn_redo_hdr_t hdr;
+    txn_write_t *writes = NULL;
+    bool committed = false;
+
+    if (fstat(redoFd, &redoStat) == 0 && read(redoFd, &hdr, sizeof(hdr)) == (ssize_t) sizeof(hdr) &&
+            memcmp(hdr.magic, TXN_REDO_MAGIC, sizeof(hdr.magic)) == 0 &&
+            redoStat.st_size == (off_t) (sizeof(hdr) + hdr.count * sizeof(txn_write_t))) {
+        size_t bytes = hdr.count * sizeof(txn_write_t);
+        writes = malloc(bytes > 0 ? bytes : 1);
+        committed = writes != NULL && read(redoFd, writes, bytes) == (ssize_t) bytes &&
+                    redo_checksum(writes, bytes) == hdr.checksum;
+    }
+    close(redoFd);
+
+    if (committed) {
+        if (apply_writes(fd, writes, (int) hdr.count) != NO_ERROR || fdatasync(fd) == -1) {
+            printf(M_ERR_DB_WRITE);
+            free(writes);
+            return ERR_DB_FILE;
+        }
+        printf(M_TXN_RECOVERED, (int) hdr.count);
+    }
+
+    free(writes);
+    unlink(redoPath);
+    return NO_ERROR;
+}
+
+/*
+ *  run_txn
+ *      fd:       linux file descriptor of the database, locked exclusively
+ *      txnFile:  name of a file of operations, see parse_txn_file()
+ *
+ *  Applies every operation in the file or none of them.  The file is parsed
+ *  and every operation is checked against an in-memory copy of the students
+ *  it touches, which is loaded with one scan of the database.  If all of them
+ *  are valid the resulting record images are written to a redo journal and
+ *  made durable with its directory entry (the commit point), then applied
+ *  to the database with positioned writes, adjacent records coalesced,
+ *  followed by a single fdatasync.  The journal is removed once the
+ *  database is durable; if that never happens replay_redo_log() finishes
+ *  the job the next time the database is opened.
+ *
+ *  returns:  <number>       number of operations applied
+ *            ERR_DB_FILE    database file I/O issue
+ *            ERR_DB_OP      the transaction was invalid and was not applied
+ *
+ *  console:  M_TXN_COMMITTED on success
+ *            M_TXN_ABORTED   followed by the reason when nothing was applied
+ */
+static int run_txn_impl(int fd, char *txnFile) {
+    txn_op_t *ops = NULL;
+    int numOps = parse_txn_file(txnFile, &ops);
+
+    if (numOps < 0) {
+        printf(M_TXN_ABORTED);
+        return ERR_DB_OP;
+    }
+
+    // one slot per distinct id, sorted so they can be binary searched
+    txn_slot_t *slots = calloc(numOps > 0 ? numOps : 1, sizeof(txn_slot_t));
+    txn_write_t *writes = calloc(numOps > 0 ? 2 * numOps : 1, sizeof(txn_write_t));
+    int numSlots = 0;
+    int numWrites = 0;
+    int rc = NO_ERROR;
+
+    if (slots == NULL || writes == NULL) {
+        free(ops);
+        free(slots);
+        free(writes);
+        printf(M_TXN_ABORTED);
+        return ERR_DB_FILE;
+    }
+
+    for (int i = 0; i < numOps; i++) {
+        slots[numSlots].id = ops[i].id;
+        numSlots++;
+    }
+    qsort(slots, numSlots, sizeof(txn_slot_t), cmp_slot_id);
+    int unique = 0;
+    for (int i = 0; i < numSlots; i++) {
+        if (unique == 0 || slots[unique - 1].id != slots[i].id) {
+            slots[unique++] = slots[i];
+        }
+    }
+    numSlots = unique;
+
+    // one pass over the database finds every student the ops refer to
+    txn_locate_ctx_t locate = { slots, numSlots };
+    rc = scan_db_records(fd, txn_locate, &locate, NULL);
+
+    // replay the ops against the in-memory state, nothing is written yet
+    for (int i = 0; rc == NO_ERROR && i < numOps; i++) {
+        txn_op_t *op = &ops[i];
+        txn_slot_t *slot = find_slot(slots, numSlots, op->id);
+
+        switch (op->op) {
+            case TXN_OP_ADD:
+                if (slot->present) {
+                    printf(M_TXN_LINE, op->line);
+                    printf(M_ERR_DB_ADD_DUP, op->id);
+                    rc = ERR_DB_OP;
+                    break;
+                }
+
+                // the id's own slot must not be in use by anyone else, which
+                // can only happen in databases written by older versions
+                slot->offset = student_offset(op->id);
+                if (!slot->wasPresent || slot->oldOffset != slot->offset) {
+                    student_t existing = {0};
+                    if (sdb_pread(fd, &existing, STUDENT_RECORD_SIZE, slot->offset) < 0) {
+                        printf(M_ERR_DB_READ);
+                        rc = ERR_DB_FILE;
+                        break;
+                    }
+                    if (memcmp(&existing, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0 &&
+                            !(slot->wasPresent && existing.id == op->id)) {
+                        printf(M_TXN_LINE, op->line);
+                        printf(M_ERR_DB_ADD_DUP, existing.id);
+                        rc = ERR_DB_OP;
+                        break;
+                    }
+                }
+                // fall through to fill in the record
+                __attribute__((fallthrough));
+
+            case TXN_OP_UPDATE:
+                if (op->op == TXN_OP_UPDATE && !slot->present) {
+                    printf(M_TXN_LINE, op->line);
+                    printf(M_STD_NOT_FND_MSG, op->id);
+                    rc = ERR_DB_OP;
+                    break;
+                }
+                memset(&slot->record, 0, sizeof(slot->record));
+                slot->record.id = op->id;
+                memcpy(slot->record.fname, op->fname, sizeof(slot->record.fname));
+                memcpy(slot->record.lname, op->lname, sizeof(slot->record.lname));
+                slot->record.gpa = op->gpa;
+                slot->present = true;
+                break;
+
+            case TXN_OP_DEL:
+                if (!slot->present) {
+                    printf(M_TXN_LINE, op->line);
+                    printf(M_STD_NOT_FND_MSG, op->id);
+                    rc = ERR_DB_OP;
+                    break;
+                }
+                slot->present = false;
+                break;
+        }
+    }
+
+    // turn the final state into record images, clearing old locations that
+    // are no longer used
+    for (int i = 0; rc == NO_ERROR && i < numSlots; i++) {
+        txn_slot_t *slot = &slots[i];
+
+        if (slot->wasPresent && (!slot->present || slot->oldOffset != slot->offset)) {
+            writes[numWrites].offset = slot->oldOffset;
+            writes[numWrites].record = EMPTY_STUDENT_RECORD;
+            numWrites++;
+        }
+        if (slot->present) {
+            writes[numWrites].offset = slot->offset;
+            writes[numWrites].record = slot->record;
+            numWrites++;
+        }
+    }
+    qsort(writes, numWrites, sizeof(txn_write_t), cmp_write_offset);
+
+    // commit point: the redo journal is written with one write and made
+    // durable, along with its entry in the database's directory
+    char dbPath[PATH_MAX];
+    char redoPath[PATH_MAX];
+    db_path_from_fd(fd, dbPath, sizeof(dbPath));
+    db_sibling_path(dbPath, REDO_DB_FILE, redoPath, sizeof(redoPath));
+
+    if (rc == NO_ERROR && numWrites > 0) {
+        size_t entryBytes = numWrites * sizeof(txn_write_t);
+        size_t redoBytes = sizeof(txn_redo_hdr_t) + entryBytes;
+        char *redo = malloc(redoBytes);
+        int redoFd = open(redoPath, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+
+        if (redo != NULL && redoFd != -1) {
+            txn_redo_hdr_t *hdr = (txn_redo_hdr_t *) redo;
+            memcpy(hdr->magic, TXN_REDO_MAGIC, sizeof(hdr->magic));
+            hdr->count = (uint32_t) numWrites;
+            hdr->checksum = redo_checksum(writes, entryBytes);
+            memcpy(redo + sizeof(txn_redo_hdr_t), writes, entryBytes);
+        }
+
+        if (redo == NULL || redoFd == -1 || sdb_write(redoFd, redo, redoBytes) != (ssize_t) redoBytes ||
+                fdatasync(redoFd) == -1 || sync_db_dir(dbPath) != NO_ERROR) {
+            printf(M_ERR_DB_WRITE);
+            rc = ERR_DB_FILE;
+            unlink(redoPath);
+        }
+
+        if (redoFd != -1) {
+            close(redoFd);
+        }
+        free(redo);
+
+        // the transaction is durable, now apply it with a single sync
+        if (rc == NO_ERROR) {
+            if (apply_writes(fd, writes, numWrites) != NO_ERROR || fdatasync(fd) == -1) {
+                // the journal stays behind and will be replayed on next open
+                printf(M_ERR_DB_WRITE);
+                rc = ERR_DB_FILE;
+            } else {
+                unlink(redoPath);
+            }
+        }
+    }
+
+    free(ops);
+    free(slots);
+    free(writes);
+
+    if (rc != NO_ERROR) {
+        if (rc == ERR_DB_OP) {
+            printf(M_TXN_ABORTED);
+        }
+        return rc;
+    }
+
+    printf(M_TXN_COMMITTED, numOps);
+    return numOps;
+}
+
+// instrumented entry point for run_txn(), see sdbstats.h
+int run_txn(int fd, char *txnFile) {
+    stats_begin(STATS_OP_TXN);
+    int rc = run_txn_impl(fd, txnFile);
+    stats_end(STATS_OP_TXN);
+    return rc;
+}
@@ -0,0 +1,801 @@
+#define _GNU_SOURCE     //SEEK_DATA / SEEK_HOLE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+//database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbstats.h"
+
+// the longest name each column keeps, same as the v1 char arrays
+#define V2_FNAME_MAX    ((int) sizeof(((student_t *) 0)->fname) - 1)
+#define V2_LNAME_MAX    ((int) sizeof(((student_t *) 0)->lname) - 1)
+
+// buckets of a name's probe sequence an add looks at, one pread's worth.  A
+// name that isn't found and has no empty bucket among them is appended
+// without an index entry, it is only stored twice until -x
+#define V2_INDEX_PROBES 32
+
+// state threaded through a scan while a database is rewritten by convert_db()
+typedef struct convert_ctx {
+    run_writer_t out;
+    bool toV2;
+    off_t liveEnd;          // v1 output, end of the last record written
+    char *heap;             // v2 output, string heap built in memory
+    size_t heapLen;
+    size_t heapCap;
+    uint32_t *index;        // v2 output, the name index, see V2_INDEX_START
+} convert_ctx_t;
+
+static off_t v2_slot_offset(int id) {
+    return V2_SLOT_START + (off_t) id * V2_SLOT_SIZE;
+}
+
+static off_t v2_bucket_offset(uint32_t bucket) {
+    return V2_INDEX_START + (off_t) bucket * (off_t) sizeof(uint32_t);
+}
+
+static uint32_t name_hash(const char *name, size_t len) {
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char) name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// copies the heap entry at ref into out, an empty name if ref is not valid
+static void v2_heap_name(const char *heap, size_t heapLen, uint32_t ref, char *out, size_t size) {
+    size_t len = 0;
+
+    if (ref < heapLen) {
+        len = (unsigned char) heap[ref];
+        if (len > heapLen - ref - 1) {
+            len = heapLen - ref - 1;
+        }
+        if (len > size - 1) {
+            len = size - 1;
+        }
+        memcpy(out, heap + ref + 1, len);
+    }
+    out[len] = '\0';
+}
+
+static int v2_read_hdr(int fd, student_v2_hdr_t *hdr) {
+    if (sdb_pread(fd, hdr, sizeof(*hdr), 0) != (ssize_t) sizeof(*hdr)) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  v2_load_heap
+ *      fd:       linux file descriptor of a v2 database
+ *      hdr:      its header
+ *      heapLen:  receives the number of bytes in the heap
+ *
+ *  returns:  malloc'd copy of the string heap, NULL on error
+ *
+ *  console:  M_ERR_DB_READ  error reading the database file
+ */
+static char *v2_load_heap(int fd, student_v2_hdr_t *hdr, size_t *heapLen) {
+    off_t heapEnd = hdr->heap_end;
+
+    if (heapEnd < V2_HEAP_START) {
+        heapEnd = V2_HEAP_START;
+    }
+
+    size_t len = (size_t) (heapEnd - V2_HEAP_START);
+    char *heap = malloc(len + 1);
+    if (heap == NULL) {
+        printf(M_ERR_DB_READ);
+        return NULL;
+    }
+
+    if (len > 0 && sdb_pread(fd, heap, len, V2_HEAP_START) != (ssize_t) len) {
+        printf(M_ERR_DB_READ);
+        free(heap);
+        return NULL;
+    }
+
+    *heapLen = len;
+    return heap;
+}
+
+// writes the heap entry for name to buf, returns the bytes it used
+static size_t v2_heap_entry(char *buf, const char *name, size_t len) {
+    buf[0] = (char) len;
+    memcpy(buf + 1, name, len);
+    return 1 + len;
+}
+
+/*
+ *  v2_index_find
+ *      fd:         linux file descriptor of a v2 database
+ *      hdr:        its header
+ *      name, len:  the name to look up
+ *      taken:      a bucket to step over as if it held another name, or
+ *                  V2_INDEX_SLOTS for none
+ *      ref:        receives the heap ref of the name, -1 if it isn't there
+ *      bucket:     receives the empty bucket a new name goes in, or
+ *                  V2_INDEX_SLOTS if there is none within V2_INDEX_PROBES
+ *
+ *  Reads the buckets of the name's probe sequence with one pread, the same
+ *  sequence convert_intern() fills, and only reads the heap entries they
+ *  point at.  Buckets past the end of the file read as empty.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ *
+ *  console:  M_ERR_DB_READ  error reading the database file
+ */
+static int v2_index_find(int fd, const student_v2_hdr_t *hdr, const char *name, size_t len, uint32_t taken,
+                         int64_t *ref, uint32_t *bucket) {
+    uint32_t buckets[V2_INDEX_PROBES] = {0};
+    uint32_t first = name_hash(name, len) & (V2_INDEX_SLOTS - 1);
+    uint32_t beforeWrap = V2_INDEX_SLOTS - first;
+    size_t heapLen = (size_t) (hdr->heap_end - V2_HEAP_START);
+    char entry[1 + V2_LNAME_MAX];
+
+    if (beforeWrap > V2_INDEX_PROBES) {
+        beforeWrap = V2_INDEX_PROBES;
+    }
+    if (sdb_pread(fd, buckets, beforeWrap * sizeof(uint32_t), v2_bucket_offset(first)) < 0 ||
+            (beforeWrap < V2_INDEX_PROBES &&
+             sdb_pread(fd, buckets + beforeWrap, (V2_INDEX_PROBES - beforeWrap) * sizeof(uint32_t),
+                       v2_bucket_offset(0)) < 0)) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    *ref = -1;
+    *bucket = V2_INDEX_SLOTS;
+    for (uint32_t p = 0; p < V2_INDEX_PROBES; p++) {
+        uint32_t at = (first + p) & (V2_INDEX_SLOTS - 1);
+        if (at == taken) {
+            continue;
+        }
+        if (buckets[p] == 0) {
+            *bucket = at;
+            return NO_ERROR;
+        }
+
+        uint32_t candidate = buckets[p] - 1;
+        if (candidate >= heapLen || heapLen - candidate < 1 + len) {
+            continue;
+        }
+        if (sdb_pread(fd, entry, 1 + len, V2_HEAP_START + candidate) != (ssize_t) (1 + len)) {
+            printf(M_ERR_DB_READ);
+            return ERR_DB_FILE;
+        }
+        if ((unsigned char) entry[0] == len && memcmp(entry + 1, name, len) == 0) {
+            *ref = candidate;
+            return NO_ERROR;
+        }
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  db_is_v2
+ *      fd:  linux file descriptor
+ *
+ *  returns:  true if the database starts with the v2 header
+ */
+bool db_is_v2(int fd){
+    char magic[sizeof(((student_v2_hdr_t *) 0)->magic)];
+
+    if (sdb_pread(fd, magic, sizeof(magic), 0) != (ssize_t) sizeof(magic)) {
+        return false;
+    }
+    return memcmp(magic, DB_V2_MAGIC, sizeof(magic)) == 0;
+}
+
+/*
+ *  v2_init_db
+ *      fd:  linux file descriptor of an empty database
+ *
+ *  Writes the header of an empty v2 database.  The slot array and the heap
+ *  start out as holes so the file uses almost no storage.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ *
+ *  console:  M_ERR_DB_WRITE  error writing the database file
+ */
+int v2_init_db(int fd){
+    student_v2_hdr_t hdr = {0};
+
+    memcpy(hdr.magic, DB_V2_MAGIC, sizeof(hdr.magic));
+    hdr.heap_end = V2_HEAP_START;
+
+    if (dirty_mark(fd, 0, sizeof(hdr)) != NO_ERROR) {
+        return ERR_DB_FILE;
+    }
+    if (sdb_pwrite(fd, &hdr, sizeof(hdr), 0) != (ssize_t) sizeof(hdr)) {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  v2_get_student
+ *      fd:  linux file descriptor of a v2 database
+ *      id:  the student id we are looking for
+ *      *s:  receives the student
+ *
+ *  Reads the id's slot and then its two heap entries, three small preads no
+ *  matter how large the database is.
+ *
+ *  returns:  NO_ERROR, ERR_DB_FILE or SRCH_NOT_FOUND like get_student()
+ *
+ *  console:  M_ERR_DB_READ  error reading the database file
+ */
+int v2_get_student(int fd, int id, student_t *s){
+    student_v2_t slot = {0};
+    char entry[1 + V2_LNAME_MAX];
+
+    if (id < MIN_STD_ID || id > MAX_STD_ID) {
+        return SRCH_NOT_FOUND;
+    }
+
+    if (sdb_pread(fd, &slot, sizeof(slot), v2_slot_offset(id)) < 0) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+    sdb_records(1);
+
+    if (slot.id != id) {
+        return SRCH_NOT_FOUND;
+    }
+
+    memset(s, 0, sizeof(*s));
+    s->id = slot.id;
+    s->gpa = slot.gpa;
+
+    // an entry is at most a length byte and V2_LNAME_MAX characters, a short
+    // read near the end of the heap is fine and v2_heap_name() clips to it
+    ssize_t got = sdb_pread(fd, entry, sizeof(entry), V2_HEAP_START + slot.fname_ref);
+    if (got < 0) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+    v2_heap_name(entry, (size_t) got, 0, s->fname, sizeof(s->fname));
+
+    got = sdb_pread(fd, entry, sizeof(entry), V2_HEAP_START + slot.lname_ref);
+    if (got < 0) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+    v2_heap_name(entry, (size_t) got, 0, s->lname, sizeof(s->lname));
+
+    return NO_ERROR;
+}
+
+/*
+ *  v2_add_student
+ *      fd, id, fname, lname, gpa:  see add_student()
+ *
+ *  Looks both names up through the name index, so a name already in the
+ *  heap is referenced again for a few small preads however large the heap
+ *  is.  New names are appended.  The heap bytes are written first, then the
+ *  header that makes them part of the heap, then their index buckets and
+ *  last the slot that makes the student visible, so a crash at any point
+ *  leaves at most some unreferenced heap bytes that the next -x drops.
+ *
+ *  returns:  NO_ERROR, ERR_DB_FILE or ERR_DB_OP like add_student()
+ *
+ *  console:  same as add_student()
+ */
+int v2_add_student(int fd, int id, char *fname, char *lname, int gpa){
+    student_v2_hdr_t hdr;
+    student_v2_t slot = {0};
+    char entries[2 + V2_FNAME_MAX + V2_LNAME_MAX];
+    size_t fnameLen = strnlen(fname, V2_FNAME_MAX);
+    size_t lnameLen = strnlen(lname, V2_LNAME_MAX);
+    bool sameName = (fnameLen == lnameLen && memcmp(fname, lname, fnameLen) == 0);
+    int64_t fnameRef;
+    int64_t lnameRef;
+    uint32_t fnameBucket;
+    uint32_t lnameBucket = V2_INDEX_SLOTS;
+
+    if (sdb_pread(fd, &slot, sizeof(slot), v2_slot_offset(id)) < 0) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+    sdb_records(1);
+
+    if (slot.id != 0) {
+        printf(M_ERR_DB_ADD_DUP, id);
+        return ERR_DB_OP;
+    }
+
+    if (v2_read_hdr(fd, &hdr) != NO_ERROR) {
+        return ERR_DB_FILE;
+    }
+    if (hdr.heap_end < V2_HEAP_START) {
+        hdr.heap_end = V2_HEAP_START;
+    }
+
+    // a new first name claims its bucket before the last name is looked up
+    if (v2_index_find(fd, &hdr, fname, fnameLen, V2_INDEX_SLOTS, &fnameRef, &fnameBucket) != NO_ERROR) {
+        return ERR_DB_FILE;
+    }
+    lnameRef = fnameRef;
+    if (!sameName && v2_index_find(fd, &hdr, lname, lnameLen, (fnameRef < 0) ? fnameBucket : V2_INDEX_SLOTS,
+                                   &lnameRef, &lnameBucket) != NO_ERROR) {
+        return ERR_DB_FILE;
+    }
+
+    off_t heapOffset = hdr.heap_end;
+    size_t added = 0;
+    uint32_t newBuckets[2][2];      // bucket and heap ref + 1 of each new name
+    int numNew = 0;
+
+    if (fnameRef < 0) {
+        fnameRef = heapOffset - V2_HEAP_START;
+        added += v2_heap_entry(entries, fname, fnameLen);
+        if (fnameBucket < V2_INDEX_SLOTS) {
+            newBuckets[numNew][0] = fnameBucket;
+            newBuckets[numNew++][1] = (uint32_t) fnameRef + 1;
+        }
+    }
+    if (sameName) {
+        lnameRef = fnameRef;
+    } else if (lnameRef < 0) {
+        lnameRef = heapOffset - V2_HEAP_START + added;
+        added += v2_heap_entry(entries + added, lname, lnameLen);
+        if (lnameBucket < V2_INDEX_SLOTS) {
+            newBuckets[numNew][0] = lnameBucket;
+            newBuckets[numNew++][1] = (uint32_t) lnameRef + 1;
+        }
+    }
+
+    slot.id = id;
+    slot.gpa = gpa;
+    slot.fname_ref = (uint32_t) fnameRef;
+    slot.lname_ref = (uint32_t) lnameRef;
+
+    // record everything about to change for --backup-since
+    if (added > 0 && (dirty_mark(fd, heapOffset, added) != NO_ERROR ||
+                      dirty_mark(fd, 0, sizeof(hdr)) != NO_ERROR)) {
+        return ERR_DB_FILE;
+    }
+    for (int i = 0; i < numNew; i++) {
+        if (dirty_mark(fd, v2_bucket_offset(newBuckets[i][0]), sizeof(uint32_t)) != NO_ERROR) {
+            return ERR_DB_FILE;
+        }
+    }
+    if (dirty_mark(fd, v2_slot_offset(id), sizeof(slot)) != NO_ERROR) {
+        return ERR_DB_FILE;
+    }
+
+    if (added > 0) {
+        if (sdb_pwrite(fd, entries, added, heapOffset) != (ssize_t) added) {
+            printf(M_ERR_DB_WRITE);
+            return ERR_DB_FILE;
+        }
+
+        hdr.heap_end = heapOffset + added;
+        if (sdb_pwrite(fd, &hdr, sizeof(hdr), 0) != (ssize_t) sizeof(hdr)) {
+            printf(M_ERR_DB_WRITE);
+            return ERR_DB_FILE;
+        }
+    }
+
+    for (int i = 0; i < numNew; i++) {
+        if (sdb_pwrite(fd, &newBuckets[i][1], sizeof(uint32_t), v2_bucket_offset(newBuckets[i][0])) !=
+                (ssize_t) sizeof(uint32_t)) {
+            printf(M_ERR_DB_WRITE);
+            return ERR_DB_FILE;
+        }
+    }
+
+    if (sdb_pwrite(fd, &slot, sizeof(slot), v2_slot_offset(id)) != (ssize_t) sizeof(slot)) {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
+    printf(M_STD_ADDED, id);
+    return NO_ERROR;
+}
+
+/*
+ *  v2_del_student
+ *      fd, id:  see del_student()
+ *
+ *  Zeroes the id's slot.  Its names stay in the heap, other students may
+ *  share them, until -x rebuilds the heap.
+ *
+ *  returns:  NO_ERROR, ERR_DB_FILE or ERR_DB_OP like del_student()
+ *
+ *  console:  same as del_student()
+ */
+int v2_del_student(int fd, int id){
+    static const student_v2_t emptySlot = {0};
+    student_v2_t slot = {0};
+
+    if (id >= MIN_STD_ID && id <= MAX_STD_ID &&
+            sdb_pread(fd, &slot, sizeof(slot), v2_slot_offset(id)) < 0) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+    sdb_records(1);
+
+    if (slot.id != id || id == DELETED_STUDENT_ID) {
+        printf(M_STD_NOT_FND_MSG, id);
+        return ERR_DB_OP;
+    }
+
+    if (dirty_mark(fd, v2_slot_offset(id), sizeof(emptySlot)) != NO_ERROR) {
+        return ERR_DB_FILE;
+    }
+    if (sdb_pwrite(fd, &emptySlot, sizeof(emptySlot), v2_slot_offset(id)) != (ssize_t) sizeof(emptySlot)) {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
+    printf(M_STD_DEL_MSG, id);
+    return NO_ERROR;
+}
+
+/*
+ *  v2_scan_records
+ *      fd:         linux file descriptor of a v2 database
+ *      callback:   called with the slot offset and contents of each student
+ *      ctx:        passed through to the callback
+ *      withNames:  load the heap and fill in the names, otherwise the names
+ *                  passed to the callback are empty
+ *
+ *  The v2 counterpart of scan_db_records().  Only the data extents of the
+ *  slot array are read, COMPRESS_BUFF_SZ bytes at a time, so a scan that
+ *  only needs ids and gpas reads a quarter of the bytes a v1 scan would and
+ *  never touches the heap.
+ *
+ *  returns:  NO_ERROR, ERR_DB_FILE or whatever the callback returned
+ *
+ *  console:  M_ERR_DB_READ  error reading or seeking the database file
+ */
+int v2_scan_records(int fd, record_cb_t callback, void *ctx, bool withNames){
+    student_v2_hdr_t hdr;
+    char *heap = NULL;
+    size_t heapLen = 0;
+    int rc = NO_ERROR;
+
+    if (withNames) {
+        if (v2_read_hdr(fd, &hdr) != NO_ERROR) {
+            return ERR_DB_FILE;
+        }
+        heap = v2_load_heap(fd, &hdr, &heapLen);
+        if (heap == NULL) {
+            return ERR_DB_FILE;
+        }
+    }
+
+    char *buffer = malloc(COMPRESS_BUFF_SZ);
+    if (buffer == NULL) {
+        printf(M_ERR_DB_READ);
+        free(heap);
+        return ERR_DB_FILE;
+    }
+
+    off_t slotsEnd = sdb_lseek(fd, 0, SEEK_END);
+    if (slotsEnd > v2_slot_offset(MAX_STD_ID + 1)) {
+        slotsEnd = v2_slot_offset(MAX_STD_ID + 1);
+    }
+
+    // filesystems without SEEK_DATA support report the whole file as data
+    off_t dataStart = sdb_lseek(fd, V2_SLOT_START, SEEK_DATA);
+    if (dataStart == -1 && errno != ENXIO) {
+        dataStart = V2_SLOT_START;
+    }
+
+    while (rc == NO_ERROR && dataStart >= 0 && dataStart < slotsEnd) {
+        off_t dataEnd = sdb_lseek(fd, dataStart, SEEK_HOLE);
+        if (dataEnd == -1 || dataEnd > slotsEnd) {
+            dataEnd = slotsEnd;
+        }
+
+        off_t position = dataStart - (dataStart - V2_SLOT_START) % V2_SLOT_SIZE;
+
+        while (rc == NO_ERROR && position < dataEnd) {
+            size_t want = COMPRESS_BUFF_SZ;
+            if ((off_t) want > dataEnd - position) {
+                want = (size_t) (dataEnd - position);
+            }
+
+            ssize_t bytesRead = sdb_pread(fd, buffer, want, position);
+            if (bytesRead < 0) {
+                printf(M_ERR_DB_READ);
+                rc = ERR_DB_FILE;
+                break;
+            }
+
+            bytesRead -= bytesRead % V2_SLOT_SIZE;
+            if (bytesRead == 0) {
+                break;
+            }
+
+            for (ssize_t i = 0; i < bytesRead && rc == NO_ERROR; i += V2_SLOT_SIZE) {
+                student_v2_t *slot = (student_v2_t *) (buffer + i);
+                sdb_records(1);
+                if (slot->id == DELETED_STUDENT_ID) {
+                    continue;
+                }
+
+                student_t student = {0};
+                student.id = slot->id;
+                student.gpa = slot->gpa;
+                if (withNames) {
+                    v2_heap_name(heap, heapLen, slot->fname_ref, student.fname, sizeof(student.fname));
+                    v2_heap_name(heap, heapLen, slot->lname_ref, student.lname, sizeof(student.lname));
+                }
+                rc = callback(ctx, position + i, &student);
+            }
+
+            position += bytesRead;
+        }
+
+        dataStart = sdb_lseek(fd, dataEnd, SEEK_DATA);
+    }
+
+    free(buffer);
+    free(heap);
+    return rc;
+}
+
+// v2_scan_records() callbacks for count and print
+static int v2_count_record(void *arg, off_t offset, student_t *student) {
+    (void) offset;
+    (void) student;
+    (*(int *) arg)++;
+    return NO_ERROR;
+}
+
+static int v2_print_record(void *arg, off_t offset, student_t *student) {
+    bool *hasPrinted = (bool *) arg;
+
+    (void) offset;
+    if (!*hasPrinted) {
+        printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA");
+        *hasPrinted = true;
+    }
+    printf(STUDENT_PRINT_FMT_STRING, student->id, student->fname, student->lname, student->gpa / 100.0f);
+    return NO_ERROR;
+}
+
+/*
+ *  v2_count_db_records
+ *      fd:  linux file descriptor of a v2 database
+ *
+ *  returns:  same as count_db_records(), only the slot array is read
+ *
+ *  console:  same as count_db_records()
+ */
+int v2_count_db_records(int fd){
+    int studentCount = 0;
+
+    if (v2_scan_records(fd, v2_count_record, &studentCount, false) != NO_ERROR) {
+        return ERR_DB_FILE;
+    }
+
+    printf(M_DB_RECORD_CNT, studentCount);
+    return studentCount;
+}
+
+/*
+ *  v2_print_db
+ *      fd:  linux file descriptor of a v2 database
+ *
+ *  returns:  same as print_db()
+ *
+ *  console:  same as print_db()
+ */
+int v2_print_db(int fd){
+    bool hasPrinted = false;
+
+    if (v2_scan_records(fd, v2_print_record, &hasPrinted, true) != NO_ERROR) {
+        return ERR_DB_FILE;
+    }
+
+    if (!hasPrinted) {
+        printf(M_DB_EMPTY);
+    }
+    return NO_ERROR;
+}
+
+// interns name in the heap being built, returns its ref or -1 when out of memory
+static int64_t convert_intern(convert_ctx_t *ctx, const char *name, size_t maxLen) {
+    size_t len = strnlen(name, maxLen);
+    uint32_t mask = V2_INDEX_SLOTS - 1;
+    uint32_t i = name_hash(name, len) & mask;
+
+    for (; ctx->index[i] != 0; i = (i + 1) & mask) {
+        uint32_t ref = ctx->index[i] - 1;
+        if ((unsigned char) ctx->heap[ref] == len && memcmp(ctx->heap + ref + 1, name, len) == 0) {
+            return ref;
+        }
+    }
+
+    if (ctx->heapLen + 1 + len > ctx->heapCap) {
+        size_t newCap = ctx->heapCap ? ctx->heapCap * 2 : 64 * 1024;
+        char *newHeap = realloc(ctx->heap, newCap);
+        if (newHeap == NULL) {
+            return -1;
+        }
+        ctx->heap = newHeap;
+        ctx->heapCap = newCap;
+    }
+
+    uint32_t ref = (uint32_t) ctx->heapLen;
+    ctx->heap[ref] = (char) len;
+    memcpy(ctx->heap + ref + 1, name, len);
+    ctx->heapLen += 1 + len;
+    ctx->index[i] = ref + 1;
+    return ref;
+}
+
+// scan callback, writes one student in the output format
+static int convert_record(void *arg, off_t offset, student_t *student) {
+    convert_ctx_t *ctx = (convert_ctx_t *) arg;
+
+    (void) offset;
+    if (!ctx->toV2) {
+        off_t outOffset = student_offset(student->id);
+        if (run_write(&ctx->out, outOffset, student, STUDENT_RECORD_SIZE) != NO_ERROR) {
+            return ERR_DB_FILE;
+        }
+        if (outOffset + STUDENT_RECORD_SIZE > ctx->liveEnd) {
+            ctx->liveEnd = outOffset + STUDENT_RECORD_SIZE;
+        }
+        return NO_ERROR;
+    }
+
+    if (student->id < MIN_STD_ID || student->id > MAX_STD_ID) {
+        return NO_ERROR;
+    }
+
+    int64_t fnameRef = convert_intern(ctx, student->fname, V2_FNAME_MAX);
+    int64_t lnameRef = convert_intern(ctx, student->lname, V2_LNAME_MAX);
+    if (fnameRef < 0 || lnameRef < 0) {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
+    student_v2_t slot = {
+        .id = student->id,
+        .gpa = student->gpa,
+        .fname_ref = (uint32_t) fnameRef,
+        .lname_ref = (uint32_t) lnameRef,
+    };
+    return run_write(&ctx->out, v2_slot_offset(student->id), &slot, sizeof(slot));
+}
+
+// writes what convert_record() collected for a v2 output file.  The interning
+// table is the file's name index, only its used buckets are written so the
+// rest stays a hole
+static int convert_finish_v2(convert_ctx_t *ctx) {
+    student_v2_hdr_t hdr = {0};
+
+    memcpy(hdr.magic, DB_V2_MAGIC, sizeof(hdr.magic));
+    hdr.heap_end = V2_HEAP_START + ctx->heapLen;
+
+    for (uint32_t i = 0; i < V2_INDEX_SLOTS; i++) {
+        if (ctx->index[i] != 0 &&
+                run_write(&ctx->out, v2_bucket_offset(i), &ctx->index[i], sizeof(uint32_t)) != NO_ERROR) {
+            return ERR_DB_FILE;
+        }
+    }
+    if (run_flush(&ctx->out) != NO_ERROR) {
+        return ERR_DB_FILE;
+    }
+
+    if ((ctx->heapLen > 0 &&
+         sdb_pwrite(ctx->out.fd, ctx->heap, ctx->heapLen, V2_HEAP_START) != (ssize_t) ctx->heapLen) ||
+        sdb_pwrite(ctx->out.fd, &hdr, sizeof(hdr), 0) != (ssize_t) sizeof(hdr) ||
+        ftruncate(ctx->out.fd, hdr.heap_end) == -1) {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  convert_db
+ *      fd:      linux file descriptor, the lock main() took on it keeps
+ *               writers out
+ *      toV2:    write the v2 format, otherwise v1
+ *      online:  reopen the result with a shared rather than exclusive lock
+ *
+ *  Rewrites the database in the requested format through the same temp
+ *  file and atomic rename that compress_db() uses.  Either format can be
+ *  the source.  Rewriting a v2 database as v2 is how it is compacted: only
+ *  names still referenced by a student are copied into the new heap.
+ *
+ *  returns:  <number>       fd of the rewritten database
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  nothing on success, errors as for compress_db()
+ */
+int convert_db(int fd, bool toV2, bool online){
+    char dbPath[PATH_MAX];
+    char tmpPath[PATH_MAX];
+    int rc;
+
+    db_path_from_fd(fd, dbPath, sizeof(dbPath));
+    int newFd = open_tmp_db(dbPath, tmpPath, sizeof(tmpPath));
+    if (newFd < 0) {
+        return ERR_DB_FILE;
+    }
+
+    convert_ctx_t ctx = {0};
+    ctx.toV2 = toV2;
+    ctx.out.fd = newFd;
+    ctx.out.buffer = malloc(COMPRESS_BUFF_SZ);
+    if (toV2) {
+        ctx.index = calloc(V2_INDEX_SLOTS, sizeof(*ctx.index));
+    }
+
+    if (ctx.out.buffer == NULL || (toV2 && ctx.index == NULL)) {
+        printf(M_ERR_DB_CREATE);
+        rc = ERR_DB_FILE;
+    } else if (db_is_v2(fd)) {
+        rc = v2_scan_records(fd, convert_record, &ctx, true);
+    } else {
+        rc = scan_db_records(fd, convert_record, &ctx, NULL);
+    }
+
+    if (rc == NO_ERROR) {
+        rc = run_flush(&ctx.out);
+    }
+    if (rc == NO_ERROR) {
+        if (toV2) {
+            rc = convert_finish_v2(&ctx);
+        } else if (ftruncate(newFd, ctx.liveEnd) == -1) {
+            printf(M_ERR_DB_WRITE);
+            rc = ERR_DB_FILE;
+        }
+    }
+
+    free(ctx.out.buffer);
+    free(ctx.heap);
+    free(ctx.index);
+
+    if (rc != NO_ERROR) {
+        close(newFd);
+        unlink(tmpPath);
+        return rc;
+    }
+
+    // the rewrite moves nearly every byte, so --backup-since has to send
+    // the whole file, as far as it reaches in either format
+    off_t oldSize = sdb_lseek(fd, 0, SEEK_END);
+    off_t newSize = sdb_lseek(newFd, 0, SEEK_END);
+    if (dirty_mark(fd, 0, (oldSize > newSize) ? oldSize : newSize) != NO_ERROR) {
+        close(newFd);
+        unlink(tmpPath);
+        return ERR_DB_FILE;
+    }
+
+    if (install_tmp_db(newFd, tmpPath, dbPath) != NO_ERROR) {
+        return ERR_DB_FILE;
+    }
+
+    // the old file and our lock on it go away together
+    close(fd);
+
+    int returnFd = open_db(dbPath, false);
+    if (returnFd >= 0) {
+        returnFd = lock_db(dbPath, returnFd, !online);
+    }
+    return returnFd;
+}
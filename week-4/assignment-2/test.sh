@@ -238,7 +238,229 @@ setup_file() {
 #    }
 #}
 
+@test "Stats report written as JSON" {
+    run ./sdbsc --stats=stats.json -c
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Database contains 3 student record(s)." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run grep -c '"op": "count_db_records", "calls": 1' stats.json
+    rm -f stats.json
+    [ "$output" = "1" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "Online compress keeps records addressable" {
+    run ./sdbsc -x online
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Database successfully compressed!" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -a 2 new student 300
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Student 2 added to database." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
 
+    run ./sdbsc -c
+    [ "${lines[0]}" = "Database contains 4 student record(s)." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
 
+    [ ! -f .tmp_student.db ]
+}
 
+@test "Transaction applies every operation" {
+    printf 'd 2\na 70 txn student 300\nu 3 jane smith 390\n' > txn_ok.txt
+    run ./sdbsc --txn txn_ok.txt
+    rm -f txn_ok.txt
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Transaction committed, 3 operation(s) applied." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
 
+    run ./sdbsc -c
+    [ "${lines[0]}" = "Database contains 4 student record(s)." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "Failed transaction changes nothing" {
+    printf 'd 70\na 1 dup student 300\n' > txn_bad.txt
+    run ./sdbsc --txn txn_bad.txt
+    rm -f txn_bad.txt
+    [ "$status" -eq 1 ]
+    [ "${lines[0]}" = "Transaction line 2: Cant add student with ID=1, already exists in db." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -f 70
+    [ "$status" -eq 0 ]
+    [ ! -f .redo_student.db ]
+}
+
+@test "Convert to v2 keeps every record" {
+    run ./sdbsc -p
+    v1_output="$output"
+
+    run ./sdbsc --convert v2
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Database converted to v2 format." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -p
+    [ "$output" = "$v1_output" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "v2 adds store a repeated name once" {
+    run ./sdbsc -a 81 jim doe 250
+    [ "$status" -eq 0 ]
+    first_size=$(stat -c %s student.db)
+    run ./sdbsc -a 82 jim doe 260
+    [ "$status" -eq 0 ]
+    [ "$(stat -c %s student.db)" -eq "$first_size" ]
+
+    # a name used for both halves is appended once, as a 1 byte length and 3 chars
+    run ./sdbsc -a 83 lee lee 270
+    [ "$status" -eq 0 ]
+    [ "$(stat -c %s student.db)" -eq "$((first_size + 4))" ]
+    run ./sdbsc -a 84 lee lee 280
+    [ "$status" -eq 0 ]
+    [ "$(stat -c %s student.db)" -eq "$((first_size + 4))" ]
+
+    run ./sdbsc -x
+    [ "$status" -eq 0 ]
+
+    run ./sdbsc -f 82
+    [ "$status" -eq 0 ]
+    [ "${lines[1]}" = "82     jim                      doe                              2.60" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+    run ./sdbsc -f 84
+    [ "$status" -eq 0 ]
+    [ "${lines[1]}" = "84     lee                      lee                              2.80" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    for id in 81 82 83 84; do
+        run ./sdbsc -d $id
+        [ "$status" -eq 0 ]
+    done
+}
+
+@test "v2 database add, find, delete and convert back" {
+    run ./sdbsc -a 80 jim doe 250
+    [ "$status" -eq 0 ]
+
+    run ./sdbsc -f 80
+    [ "$status" -eq 0 ]
+    [ "${lines[1]}" = "80     jim                      doe                              2.50" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -d 80
+    [ "$status" -eq 0 ]
+
+    run ./sdbsc -x
+    [ "$status" -eq 0 ]
+
+    run ./sdbsc -p
+    v2_output="$output"
+
+    run ./sdbsc --convert v1
+    [ "$status" -eq 0 ]
+
+    run ./sdbsc -p
+    [ "$output" = "$v2_output" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "Snapshot copies the database" {
+    rm -f snap_test.db .dirty_student.db
+    run ./sdbsc --snapshot snap_test.db
+    [ "$status" -eq 0 ]
+    cmp student.db snap_test.db
+
+    run ./sdbsc --snapshot snap_test.db
+    [ "$status" -eq 1 ]
+    [ "${lines[0]}" = "Cant create snapshot snap_test.db." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "Backup since snapshot holds only changed pages" {
+    run ./sdbsc --backup-since snap_test.db none.bak
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Backup since snap_test.db written, 0 changed page(s)." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -a 90 backup student 300
+    [ "$status" -eq 0 ]
+
+    run ./sdbsc --backup-since snap_test.db one.bak
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Backup since snap_test.db written, 1 changed page(s)." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    # 24 byte header plus one 8 byte offset and 4096 byte page
+    [ "$(stat -c %s one.bak)" -eq 4128 ]
+
+    run ./sdbsc --backup-since other.db other.bak
+    [ "$status" -eq 1 ]
+
+    rm -f snap_test.db none.bak one.bak .dirty_student.db
+}
+
+@test "Concurrent snapshots each restart change tracking" {
+    for i in 1 2 3 4; do
+        ./sdbsc --snapshot snap_par_$i.db > /dev/null &
+    done
+    wait
+
+    for i in 1 2 3 4; do
+        cmp student.db snap_par_$i.db
+    done
+
+    # every snapshot built its bitmap under its own name and renamed it in
+    [ -f .dirty_student.db ]
+    [ -z "$(ls -A | grep '^\.dirty_student\.db\.')" ]
+
+    run ./sdbsc -a 91 parallel student 300
+    [ "$status" -eq 0 ]
+
+    latest=$(dd if=.dirty_student.db bs=1 skip=8 count=248 2>/dev/null | tr -d '\0')
+    run ./sdbsc --backup-since "$latest" par.bak
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Backup since $latest written, 1 changed page(s)." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    rm -f snap_par_*.db par.bak .dirty_student.db
+}
@@ -0,0 +1,175 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "dshlib.h"
+
+/*
+ * The per-line arena. Everything parsing a command line needs (the line
+ * itself, the command list and what hangs off it) is carved out of one
+ * block with a bump pointer, and the whole lot is given back at once by
+ * arena_reset() when the line is done. The block is allocated when the
+ * loop starts, so reading, parsing and running a command makes no heap
+ * allocations and there is nothing to leak.
+ *
+ * A line that needs more than the block gets more: another chunk at least
+ * twice the size of the last is chained on, and nothing already handed out
+ * moves. arena_reset() then swaps the chain for one block as big as all of
+ * it, so the next line that size fits in one block again and lines only
+ * cost a malloc() when they are longer than any before them.
+ */
+
+// allocations keep the alignment malloc() would give them
+#define ARENA_ALIGN _Alignof(max_align_t)
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+// a chunk's data starts after its header, aligned like an allocation
+#define CHUNK_DATA(chunk) ((char *) (chunk) + ARENA_ROUND(sizeof(arena_chunk_t)))
+
+
+/*
+ * function: arena_add_chunk
+ * purpose: chains a chunk with room for cap bytes onto the arena and makes
+ *          it the one allocations are carved from
+ * parameters:
+ *    arena: the arena
+ *    cap: size of the chunk's data in bytes
+ * returns: ok, or err_memory if the chunk can't be allocated
+ */
+static int arena_add_chunk(arena_t *arena, size_t cap) {
+    arena_chunk_t *chunk = malloc(ARENA_ROUND(sizeof(arena_chunk_t)) + cap);
+
+    if (chunk == NULL) {
+        return ERR_MEMORY;
+    }
+    chunk->prev = arena->chunk;
+    chunk->cap = cap;
+
+    arena->chunk = chunk;
+    arena->base = CHUNK_DATA(chunk);
+    arena->used = 0;
+    arena->cap = cap;
+    arena->total += cap;
+    return OK;
+}
+
+
+/*
+ * function: arena_init
+ * purpose: allocates the arena's first block
+ * parameters:
+ *    arena: the arena to set up
+ *    cap: size of the block in bytes
+ * returns: ok, or err_memory if the block can't be allocated
+ */
+int arena_init(arena_t *arena, size_t cap) {
+    memset(arena, 0, sizeof(*arena));
+    return arena_add_chunk(arena, cap);
+}
+
+
+/*
+ * function: arena_alloc
+ * purpose: carves size bytes out of the arena, chaining on a bigger chunk
+ *          if the current one is full
+ * parameters:
+ *    arena: the arena
+ *    size: bytes wanted
+ * returns: the memory, or NULL if no more can be allocated
+ */
+void *arena_alloc(arena_t *arena, size_t size) {
+    size_t start = ARENA_ROUND(arena->used);
+
+    if (arena->chunk == NULL || start > arena->cap || size > arena->cap - start) {
+        size_t cap = (arena->cap > size / 2) ? arena->cap * 2 : ARENA_ROUND(size);
+        if (arena_add_chunk(arena, cap) != OK) {
+            return NULL;
+        }
+        start = 0;
+    }
+
+    arena->last = arena->base + start;
+    arena->used = start + size;
+    return arena->last;
+}
+
+
+/*
+ * function: arena_grow
+ * purpose: makes an allocation bigger. The newest allocation grows in place
+ *          while its chunk has room, anything else is copied, so an array
+ *          grown by doubling costs linear time either way
+ * parameters:
+ *    arena: the arena
+ *    ptr: memory from arena_alloc() or arena_grow()
+ *    oldSize: its size
+ *    newSize: the size wanted, at least oldSize
+ * returns: the memory, which may have moved, or NULL if no more can be
+ *          allocated (ptr is left as it was)
+ */
+void *arena_grow(arena_t *arena, void *ptr, size_t oldSize, size_t newSize) {
+    if (ptr == arena->last && newSize <= arena->cap - (size_t) ((char *) ptr - arena->base)) {
+        arena->used = (size_t) ((char *) ptr - arena->base) + newSize;
+        return ptr;
+    }
+
+    void *grown = arena_alloc(arena, newSize);
+    if (grown != NULL) {
+        memcpy(grown, ptr, oldSize);
+    }
+    return grown;
+}
+
+
+/*
+ * function: arena_reset
+ * purpose: gives back everything allocated from the arena. That is O(1)
+ *          unless the last line needed more chunks, which are swapped for
+ *          one block of their combined size
+ * parameters:
+ *    arena: the arena
+ * returns: none
+ */
+void arena_reset(arena_t *arena) {
+    arena->used = 0;
+    arena->last = NULL;
+    if (arena->chunk == NULL || arena->chunk->prev == NULL) {
+        return;
+    }
+
+    // if the bigger block can't be had, keep the newest chunk, it is the largest
+    size_t total = arena->total;
+    arena_chunk_t *chunk = arena->chunk;
+    arena->chunk = NULL;
+    arena->total = 0;
+    if (arena_add_chunk(arena, total) != OK) {
+        arena->chunk = chunk;
+        arena->base = CHUNK_DATA(chunk);
+        arena->cap = chunk->cap;
+        arena->total = chunk->cap;
+        chunk = chunk->prev;
+        arena->chunk->prev = NULL;
+    }
+
+    while (chunk != NULL) {
+        arena_chunk_t *prev = chunk->prev;
+        free(chunk);
+        chunk = prev;
+    }
+}
+
+
+/*
+ * function: arena_free
+ * purpose: frees the arena's chunks
+ * parameters:
+ *    arena: the arena
+ * returns: none
+ */
+void arena_free(arena_t *arena) {
+    while (arena->chunk != NULL) {
+        arena_chunk_t *prev = arena->chunk->prev;
+        free(arena->chunk);
+        arena->chunk = prev;
+    }
+    memset(arena, 0, sizeof(*arena));
+}
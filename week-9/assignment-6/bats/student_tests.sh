@@ -44,7 +44,7 @@ EOF
     # Remove all whitespace from output
     stripped_output=$(echo "$output" | tr -d '[:space:]')
     # Format the expected output similarly (no spaces/newlines):
-    expected_output="hellolocalmodedsh4>dsh4>cmdloopreturned0"
+    expected_output="localmodehellocmdloopreturned0"
 
     # Debug prints (only visible when the test fails)
     echo "Captured stdout:"
@@ -63,7 +63,7 @@ pwd
 EOF
 
     stripped_output=$(echo "$output" | tr -d '[:space:]')
-    expected_output="/tmplocalmodedsh4>dsh4>dsh4>cmdloopreturned0"
+    expected_output="localmode/tmpcmdloopreturned0"
 
     echo "Captured stdout:"
     echo "$output"
@@ -79,7 +79,7 @@ dragon | wc -l
 EOF
 
     stripped_output=$(echo "$output" | tr -d '[:space:]')
-    expected_output="39localmodedsh4>dsh4>cmdloopreturned0"
+    expected_output="localmode38cmdloopreturned0"
 
     echo "Captured stdout:"
     echo "$output"
@@ -89,13 +89,47 @@ EOF
     [ "$status" -eq 0 ]
 }
 
-@test "[ LOCAL MODE ] Handle over pipe limit" {
+@test "[ LOCAL MODE ] Pipelines are not limited to 8 commands" {
     run "./dsh" <<EOF
-echo 1 | echo 2 | echo 3 | echo 4 | echo 5 | echo 6 | echo 7 | echo 8 | echo 9
+echo "result" | cat | cat | cat | cat | cat | cat | cat | cat
 EOF
 
     stripped_output=$(echo "$output" | tr -d '[:space:]')
-    expected_output="localmodedsh4>error:pipinglimitedto8commandsdsh4>cmdloopreturned0"
+    expected_output="localmoderesultcmdloopreturned0"
+
+    echo "Captured stdout:"
+    echo "$output"
+    echo "$stripped_output -> $expected_output"
+
+    [ "$stripped_output" = "$expected_output" ]
+    [ "$status" -eq 0 ]
+}
+
+@test "[ LOCAL MODE ] Long pipeline" {
+    pipeline="echo result"$(printf ' | cat%.0s' $(seq 600))
+    run "./dsh" <<EOF
+$pipeline
+EOF
+
+    stripped_output=$(echo "$output" | tr -d '[:space:]')
+    expected_output="localmoderesultcmdloopreturned0"
+
+    echo "Captured stdout:"
+    echo "$output"
+    echo "$stripped_output -> $expected_output"
+
+    [ "$stripped_output" = "$expected_output" ]
+    [ "$status" -eq 0 ]
+}
+
+@test "[ LOCAL MODE ] Long line with many arguments" {
+    words=$(seq 2000 | tr '\n' ' ')
+    run "./dsh" <<EOF
+echo $words | wc -w
+EOF
+
+    stripped_output=$(echo "$output" | tr -d '[:space:]')
+    expected_output="localmode2000cmdloopreturned0"
 
     echo "Captured stdout:"
     echo "$output"
@@ -112,7 +146,7 @@ echo "result" | cat | cat | cat | cat | cat | cat | cat
 EOF
 
     stripped_output=$(echo "$output" | tr -d '[:space:]')
-    expected_output="resultlocalmodedsh4>dsh4>warning:nocommandsprovideddsh4>cmdloopreturned0"
+    expected_output="localmoderesultcmdloopreturned0"
 
     echo "Captured stdout:"
     echo "$output"
@@ -134,7 +168,7 @@ EOF
 
     stripped_output=$(echo "$output" | tr -d '[:space:]')
     # We expect "testing" from the first cat, then "testing\ntesting again" from the second cat.
-    expected_output="testingtestingtestingagainlocalmodedsh4>dsh4>dsh4>dsh4>dsh4>dsh4>dsh4>cmdloopreturned0"
+    expected_output="localmodetestingtestingtestingagaincmdloopreturned0"
 
     echo "Captured stdout:"
     echo "$output"
@@ -153,7 +187,7 @@ rm out.txt
 EOF
 
     stripped_output=$(echo "$output" | tr -d '[:space:]')
-    expected_output="helloworldlocalmodedsh4>dsh4>dsh4>dsh4>dsh4>cmdloopreturned0"
+    expected_output="localmodehelloworldcmdloopreturned0"
 
     echo "Captured stdout:"
     echo "$output"
@@ -172,7 +206,7 @@ rm in.txt
 EOF
 
     stripped_output=$(echo "$output" | tr -d '[:space:]')
-    expected_output="inputworkslocalmodedsh4>dsh4>dsh4>dsh4>dsh4>cmdloopreturned0"
+    expected_output="localmodeinputworkscmdloopreturned0"
 
     echo "Captured stdout:"
     echo "$output"
@@ -191,7 +225,7 @@ EOF
     stripped_output=$(echo "$output" | tr -d '[:space:]')
 
     # Expected output with all whitespace removed for easier matching
-    expected_output="localmodedsh4>cmdloopreturned0"
+    expected_output="localmodecmdloopreturned0"
 
     # These echo commands will help with debugging and will only print
     # if the test fails
@@ -216,7 +250,7 @@ EOF
     stripped_output=$(echo "$output" | tr -d '[:space:]')
 
     # Expected output with all whitespace removed for easier matching
-    expected_output=$(echo $(ls) | tr -d '[:space:]')"localmodedsh4>dsh4>cmdloopreturned0"
+    expected_output="localmode"$(echo $(ls) | tr -d '[:space:]')"cmdloopreturned0"
 
     # These echo commands will help with debugging and will only print
     # if the test fails
@@ -246,7 +280,7 @@ EOF
     stripped_output=$(echo "$output" | tr -d '[:space:]')
 
     # Expected output with all whitespace removed for easier matching
-    expected_output="/tmp/testlocalmodedsh4>dsh4>dsh4>dsh4>dsh4>cmdloopreturned0"
+    expected_output="localmode/tmp/testcmdloopreturned0"
 
     # Print debugging information for failed tests
     echo "Captured stdout:"
@@ -278,7 +312,7 @@ EOF
     stripped_output=$(echo "$output" | tr -d '[:space:]')
 
     # Expected output with all whitespace removed for easier matching
-    expected_output="/tmp/test/tmplocalmodedsh4>dsh4>dsh4>dsh4>dsh4>dsh4>dsh4>cmdloopreturned0"
+    expected_output="localmode/tmp/test/tmpcmdloopreturned0"
 
     # Print debugging information for failed tests
     echo "Captured stdout:"
@@ -305,7 +339,7 @@ EOF
     stripped_output=$(echo "$output" | tr -d '[:space:]')
 
     # Expected output with all whitespace removed for easier matching
-    expected_output="localmodedsh4>localmodedsh4>CommandnotfoundinPATHdsh4>2dsh4>cmdloopreturned0"
+    expected_output="localmodeCommandnotfoundinPATH2cmdloopreturned0"
 
     # Print debugging information for failed tests
     echo "Captured stdout:"
@@ -332,7 +366,7 @@ EOF
 
     # Strip all whitespace (spaces, tabs, newlines) from the output
     stripped_output=$(echo "$output" | tr -d '[:space:]')
-    expected_output="localmodedsh4>localmodedsh4>Permissiondeniedtoexecutecommanddsh4>13dsh4>cmdloopreturned0"
+    expected_output="localmodePermissiondeniedtoexecutecommand13cmdloopreturned0"
 
     # Print debugging information for failed tests
     echo "Captured stdout:"
@@ -361,7 +395,7 @@ EOF
 
     # Strip all whitespace (spaces, tabs, newlines) from the output
     stripped_output=$(echo "$output" | tr -d '[:space:]')
-    expected_output="localmodedsh4>localmodedsh4>Permissiondeniedtoexecutecommanddsh4>13dsh4>cmdloopreturned0"
+    expected_output="localmodePermissiondeniedtoexecutecommand13cmdloopreturned0"
 
     # Print debugging information for failed tests
     echo "Captured stdout:"
@@ -410,12 +444,236 @@ EOF
     rmdir /tmp/test_dir
 }
 
+@test "[ LOCAL MODE ] hash lists cached commands and hash -r clears them" {
+    run "./dsh" <<EOF
+echo a
+echo b | cat
+hash
+hash -r
+hash
+EOF
+
+    stripped_output=$(echo "$output" | tr -d '[:space:]')
+    expected_output="localmodeabhitscommand2$(type -P echo)1$(type -P cat)hash:hashtableemptycmdloopreturned0"
+    expected_swapped="localmodeabhitscommand1$(type -P cat)2$(type -P echo)hash:hashtableemptycmdloopreturned0"
+
+    echo "Captured stdout:"
+    echo "$output"
+    echo "$stripped_output -> $expected_output"
+
+    # the table lists in hash order
+    [ "$stripped_output" = "$expected_output" ] || [ "$stripped_output" = "$expected_swapped" ]
+    [ "$status" -eq 0 ]
+}
+
+@test "[ LOCAL MODE ] A cached command that moved is found again" {
+    mkdir -p /tmp/dsh_hash_a /tmp/dsh_hash_b
+    printf '#!/bin/sh\necho found\n' > /tmp/dsh_hash_a/hashed_cmd
+    chmod +x /tmp/dsh_hash_a/hashed_cmd
+
+    run env PATH="/tmp/dsh_hash_a:/tmp/dsh_hash_b:$PATH" ./dsh <<EOF
+hashed_cmd
+mv /tmp/dsh_hash_a/hashed_cmd /tmp/dsh_hash_b/hashed_cmd
+hashed_cmd
+EOF
+
+    stripped_output=$(echo "$output" | tr -d '[:space:]')
+    expected_output="localmodefoundfoundcmdloopreturned0"
+
+    echo "Captured stdout:"
+    echo "$output"
+    echo "$stripped_output -> $expected_output"
+
+    rm -rf /tmp/dsh_hash_a /tmp/dsh_hash_b
+    [ "$stripped_output" = "$expected_output" ]
+    [ "$status" -eq 0 ]
+}
+
+@test "[ LOCAL MODE ] Executables without a #! line run as shell scripts" {
+    mkdir -p /tmp/dsh_noshebang
+    printf 'echo from-noshebang "$@"\n' > /tmp/dsh_noshebang/nosb_cmd
+    chmod +x /tmp/dsh_noshebang/nosb_cmd
+
+    run env PATH="/tmp/dsh_noshebang:$PATH" ./dsh <<EOF
+/tmp/dsh_noshebang/nosb_cmd one
+nosb_cmd two | cat
+EOF
+
+    stripped_output=$(echo "$output" | tr -d '[:space:]')
+    expected_output="localmodefrom-noshebangonefrom-noshebangtwocmdloopreturned0"
+
+    echo "Captured stdout:"
+    echo "$output"
+    echo "$stripped_output -> $expected_output"
+
+    rm -rf /tmp/dsh_noshebang
+    [ "$stripped_output" = "$expected_output" ]
+    [ "$status" -eq 0 ]
+}
+
+@test "[ LOCAL MODE ] -e runs ; && and || lists" {
+    run "./dsh" -e "echo a; false && echo b || echo c; echo d || echo e"
+
+    stripped_output=$(echo "$output" | tr -d '[:space:]')
+    expected_output="acd"
+
+    echo "Captured stdout:"
+    echo "$output"
+    echo "$stripped_output -> $expected_output"
+
+    [ "$stripped_output" = "$expected_output" ]
+    [ "$status" -eq 0 ]
+}
+
+@test "[ LOCAL MODE ] Exit statuses pass through, launch failures are 127 and 126" {
+    run "./dsh" -e "ls /dsh_no_such_dir"
+    [[ "$output" != *"Command not found"* ]]
+    [ "$status" -eq 2 ]
+
+    run "./dsh" -e "sh -c 'exit 7'"
+    [ -z "$output" ]
+    [ "$status" -eq 7 ]
+
+    run "./dsh" -e "dsh_no_such_cmd"
+    [[ "$output" == *"Command not found in PATH"* ]]
+    [ "$status" -eq 127 ]
+
+    mkdir -p /tmp/dsh_not_exec_dir
+    run "./dsh" -e "/tmp/dsh_not_exec_dir"
+    rmdir /tmp/dsh_not_exec_dir
+    [[ "$output" == *"Permission denied to execute command"* ]]
+    [ "$status" -eq 126 ]
+}
+
+@test "[ LOCAL MODE ] -f runs a script file without prompts" {
+    cat > /tmp/dsh_script.dsh <<EOF
+echo one
+cd /tmp
+pwd
+exit
+echo never
+EOF
+
+    run "./dsh" -f /tmp/dsh_script.dsh
+
+    stripped_output=$(echo "$output" | tr -d '[:space:]')
+    expected_output="one/tmp"
+
+    echo "Captured stdout:"
+    echo "$output"
+    echo "$stripped_output -> $expected_output"
+
+    rm -f /tmp/dsh_script.dsh
+    [ "$stripped_output" = "$expected_output" ]
+    [ "$status" -eq 0 ]
+}
+
+@test "[ LOCAL MODE ] Script syntax errors and missing scripts set the exit status" {
+    run "./dsh" -e "echo a ;; echo b"
+
+    echo "Captured stdout:"
+    echo "$output"
+
+    [[ "$output" == *"syntax error"* ]]
+    [[ "$output" != *"a"$'\n'* ]]
+    [ "$status" -eq 2 ]
+
+    run "./dsh" -f /tmp/dsh_no_such_script.dsh
+    [ "$status" -eq 127 ]
+}
+
+@test "[ LOCAL MODE ] Running commands makes no heap allocations per line" {
+    make -s bench/alloc_count.so
+
+    # the same lines run 10 and 200 times, the count must not change
+    for reps in 10 200; do
+        rm -f /tmp/dsh_alloc_script.dsh
+        for i in $(seq $reps); do
+            printf 'true | true\necho x > /dev/null\ncd /tmp\nfalse || true\n' >> /tmp/dsh_alloc_script.dsh
+        done
+        ALLOC_COUNT_OUT=/tmp/dsh_alloc_count.$reps LD_PRELOAD="$PWD/bench/alloc_count.so" \
+            ./dsh -f /tmp/dsh_alloc_script.dsh > /dev/null 2>&1
+    done
+
+    few=$(cat /tmp/dsh_alloc_count.10)
+    many=$(cat /tmp/dsh_alloc_count.200)
+    rm -f /tmp/dsh_alloc_script.dsh /tmp/dsh_alloc_count.*
+
+    echo "allocations: $few for 10 repetitions, $many for 200"
+    [ -n "$few" ]
+    [ "$few" -eq "$many" ]
+}
+
+@test "[ LOCAL MODE ] Empty pipeline stages are syntax errors" {
+    for line in "|" "echo a | | cat" "echo a ||| cat" "echo a |"; do
+        run "./dsh" -e "$line"
+
+        echo "Captured stdout for $line:"
+        echo "$output"
+
+        [[ "$output" == *"syntax error"* ]]
+        [[ "$output" != *"a"$'\n'* ]]
+        [ "$status" -eq 2 ]
+    done
+}
+
+@test "[ LOCAL MODE ] Failed built-ins report their status to && and ||" {
+    run "./dsh" -e "cd /dsh_no_such_dir && echo bad || echo good; hash dsh_no_such_cmd || echo failed"
+
+    echo "Captured stdout:"
+    echo "$output"
+
+    [[ "$output" == *"cd: /dsh_no_such_dir"* ]]
+    [[ "$output" != *"bad"* ]]
+    [[ "$output" == *"good"* ]]
+    [[ "$output" == *"failed"* ]]
+    [ "$status" -eq 0 ]
+
+    run "./dsh" -e "cd /dsh_no_such_dir"
+    [ "$status" -eq 1 ]
+}
+
+@test "[ LOCAL MODE ] Single quotes keep list operators in a word" {
+    run "./dsh" -e "echo 'a && b' \"it's\"; echo 'c; d'"
+
+    stripped_output=$(echo "$output" | tr -d '[:space:]')
+    expected_output="a&&bit'sc;d"
+
+    echo "Captured stdout:"
+    echo "$output"
+    echo "$stripped_output -> $expected_output"
+
+    [ "$stripped_output" = "$expected_output" ]
+    [ "$status" -eq 0 ]
+}
+
+@test "[ LOCAL MODE ] A piped script exits with its last command's status" {
+    run "./dsh" <<EOF
+echo one
+false
+EOF
+
+    echo "Captured stdout:"
+    echo "$output"
+
+    [[ "$output" == *"one"* ]]
+    [[ "$output" == *"cmd loop returned 1"* ]]
+    [ "$status" -eq 1 ]
+
+    run "./dsh" <<EOF
+false
+true
+EOF
+    [ "$status" -eq 0 ]
+}
+
 @test "[ LOCAL MODE ] Can boot shell in shell" {
     run "./dsh" <<EOF
 exit
 EOF
 
-    # Expected prompt in output (assuming "dsh2>" is the prompt)
+    # Input that isn't a terminal is run as a script, without prompts
+    expected_banner="local mode"
     expected_prompt="dsh4>"
 
     # Print debugging information for failed tests
@@ -423,8 +681,9 @@ EOF
     echo "Output: $output"
     echo "Exit Status: $status"
 
-    # Ensure the expected prompt is in the output
-    [[ "$output" == *"$expected_prompt"* ]]
+    # Ensure the shell started and printed no prompt
+    [[ "$output" == *"$expected_banner"* ]]
+    [[ "$output" != *"$expected_prompt"* ]]
 
     # Assert that the exit status is 0 (successful execution)
     [ "$status" -eq 0 ]
@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Counts the heap allocations of a process it is preloaded into, for the
+// bats check that the shell's steady state makes none.  The count is
+// written at exit to the file named by ALLOC_COUNT_OUT.  The variable is
+// taken out of the environment at startup, so the commands the shell runs
+// inherit the preload but don't overwrite the count.
+//
+//   make bench/alloc_count.so
+//   ALLOC_COUNT_OUT=/tmp/n LD_PRELOAD=./bench/alloc_count.so ./dsh -f script
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t num, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static unsigned long allocations;
+static char outPath[4096];
+
+void *malloc(size_t size) {
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t num, size_t size) {
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(num, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+__attribute__((constructor)) static void count_start(void) {
+    const char *path = getenv("ALLOC_COUNT_OUT");
+
+    if (path != NULL && strlen(path) < sizeof(outPath)) {
+        strcpy(outPath, path);
+    }
+    unsetenv("ALLOC_COUNT_OUT");
+}
+
+__attribute__((destructor)) static void count_end(void) {
+    char line[32];
+
+    if (outPath[0] == '\0') {
+        return;
+    }
+    int fd = open(outPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        int len = snprintf(line, sizeof(line), "%lu\n", allocations);
+        if (write(fd, line, len) != len) {
+            perror("alloc_count");
+        }
+        close(fd);
+    }
+}
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dshlib.h"
+
+// Cost of starting and reaping a pipeline of STAGES `true` commands through
+// start_pipeline(), once with spawn_stage() and once forking every stage as
+// the shell used to.  fork() copies the page tables of the whole process, so
+// each shape also runs with RSS_MB of touched heap in the benchmark, standing
+// in for a shell or threaded server that has grown.
+//
+//   make bench
+//   ./bench/launch_bench [stages rss_mb]   one shape instead of the defaults
+
+#define BENCH_ROUND_SEC 0.3
+#define BENCH_ROUNDS    3
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// starts and reaps the pipeline once, returns false if a stage failed
+static bool run_once(const char *line, arena_t *arena, bool useSpawn) {
+    command_list_t clist;
+    char *work;
+    bool ok = true;
+
+    arena_reset(arena);
+    work = arena_alloc(arena, strlen(line) + 1);
+    strcpy(work, line);
+    if (build_cmd_list(work, &clist, arena) != OK) {
+        return false;
+    }
+
+    start_pipeline(&clist, useSpawn);
+    for (int i = 0; i < clist.num; i++) {
+        if (wait_stage(&clist.commands[i]) != 0) {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// best of BENCH_ROUNDS in us per pipeline, or -1 if the pipeline fails
+static double bench_launch(const char *line, bool useSpawn) {
+    arena_t arena;
+    double best = -1;
+    long reps = 1;
+
+    if (arena_init(&arena, ARENA_SZ) != OK) {
+        fprintf(stderr, "launch_bench: out of memory\n");
+        exit(1);
+    }
+
+    for (int round = 0; round <= BENCH_ROUNDS; round++) {
+        double start = now_sec();
+        for (long r = 0; r < reps; r++) {
+            if (!run_once(line, &arena, useSpawn)) {
+                arena_free(&arena);
+                return -1;
+            }
+        }
+        double us = (now_sec() - start) * 1e6 / reps;
+
+        // the first round only sizes the others
+        if (round == 0) {
+            reps = (long) (BENCH_ROUND_SEC * 1e6 / (us + 1)) + 1;
+        } else if (best < 0 || us < best) {
+            best = us;
+        }
+    }
+
+    arena_free(&arena);
+    return best;
+}
+
+int main(int argc, char *argv[]) {
+    int shapes[][2] = { { 1, 0 }, { 8, 0 }, { 64, 0 }, { 1, 512 }, { 8, 512 }, { 64, 512 } };
+    int numShapes = sizeof(shapes) / sizeof(shapes[0]);
+    char *heap = NULL;
+    size_t heapMb = 0;
+
+    if (argc == 3) {
+        shapes[0][0] = atoi(argv[1]);
+        shapes[0][1] = atoi(argv[2]);
+        numShapes = 1;
+    }
+
+    printf("%6s %7s %14s %14s %8s\n", "STAGES", "RSS_MB", "SPAWN_US", "FORK_US", "SPEEDUP");
+    for (int i = 0; i < numShapes; i++) {
+        int stages = shapes[i][0];
+        size_t rssMb = shapes[i][1];
+
+        // the heap only grows, shapes are ordered so it is touched once per size
+        if (rssMb > heapMb) {
+            free(heap);
+            heap = malloc(rssMb << 20);
+            if (heap == NULL) {
+                fprintf(stderr, "launch_bench: can't allocate %zu MB\n", rssMb);
+                return 1;
+            }
+            memset(heap, 1, rssMb << 20);
+            heapMb = rssMb;
+        }
+
+        char *line = malloc((size_t) stages * 8 + 1);
+        size_t len = 0;
+        line[0] = '\0';
+        for (int s = 0; s < stages; s++) {
+            len += sprintf(line + len, "%s", (s > 0) ? " | true" : "true");
+        }
+
+        double spawnUs = bench_launch(line, true);
+        double forkUs = bench_launch(line, false);
+        if (spawnUs < 0 || forkUs < 0) {
+            printf("%6d %7zu   pipeline failed\n", stages, rssMb);
+        } else {
+            printf("%6d %7zu %14.1f %14.1f %7.1fx\n", stages, rssMb, spawnUs, forkUs, forkUs / spawnUs);
+        }
+        free(line);
+    }
+
+    free(heap);
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dshlib.h"
+
+// Cost of build_cmd_list() on generated pipelines.  Each line has STAGES
+// commands of ARGS words, every third word quoted with a blank and a pipe
+// inside it, and the last stage redirects its output.  A line is copied back
+// into the work buffer before every parse since parsing overwrites it, the
+// copy is timed too.  The commands and their argv come from an arena that is
+// reset before every parse, as the shell does for each line; the defaults run
+// up to pipelines of thousands of stages and commands of thousands of words,
+// and the ns per byte should stay flat across them.
+//
+//   make bench
+//   ./bench/parse_bench [stages args]   one shape instead of the defaults
+
+#define BENCH_ROUND_SEC 0.2
+#define BENCH_ROUNDS    3
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// the longest line make_line() writes for the shape
+static size_t line_size(int stages, int args) {
+    return (size_t) stages * (3 + 16 + (size_t) args * 16) + 16;
+}
+
+// writes the line for the shape to out, returns its length
+static size_t make_line(char *out, int stages, int args) {
+    size_t len = 0;
+
+    for (int s = 0; s < stages; s++) {
+        len += sprintf(out + len, "%scmd%d", (s > 0) ? " | " : "", s);
+        for (int a = 1; a < args; a++) {
+            len += sprintf(out + len, (a % 3 == 0) ? " \"q %d|x\"" : " arg%d", a);
+        }
+    }
+    len += sprintf(out + len, " >> out.txt");
+    return len;
+}
+
+// best of BENCH_ROUNDS in ns per line, or -1 if the line does not parse
+static double bench_shape(int stages, int args, size_t *lineLen) {
+    char *line = malloc(line_size(stages, args));
+    char *work = malloc(line_size(stages, args));
+    command_list_t clist;
+    arena_t arena;
+    double best = -1;
+
+    if (line == NULL || work == NULL || arena_init(&arena, ARENA_SZ) != OK) {
+        fprintf(stderr, "parse_bench: out of memory\n");
+        exit(1);
+    }
+
+    *lineLen = make_line(line, stages, args);
+    memcpy(work, line, *lineLen + 1);
+    if (build_cmd_list(work, &clist, &arena) != OK || clist.num != stages
+        || clist.commands[stages - 1].argc != args) {
+        goto done;
+    }
+
+    long reps = 1;
+    for (int round = 0; round <= BENCH_ROUNDS; round++) {
+        double start = now_sec();
+        for (long r = 0; r < reps; r++) {
+            arena_reset(&arena);
+            memcpy(work, line, *lineLen + 1);
+            build_cmd_list(work, &clist, &arena);
+        }
+        double ns = (now_sec() - start) * 1e9 / reps;
+
+        // the first round only sizes the others
+        if (round == 0) {
+            reps = (long) (BENCH_ROUND_SEC * 1e9 / (ns + 1)) + 1;
+        } else if (best < 0 || ns < best) {
+            best = ns;
+        }
+    }
+
+done:
+    arena_free(&arena);
+    free(work);
+    free(line);
+    return best;
+}
+
+int main(int argc, char *argv[]) {
+    int shapes[][2] = { { 1, 2 }, { 1, CMD_ARGV_MAX - 1 }, { CMD_MAX, 4 }, { 1, 1000 },
+                        { 1, 10000 }, { 100, 4 }, { 1000, 4 }, { 10000, 4 }, { 1000, 100 } };
+    int numShapes = sizeof(shapes) / sizeof(shapes[0]);
+
+    if (argc == 3) {
+        shapes[0][0] = atoi(argv[1]);
+        shapes[0][1] = atoi(argv[2]);
+        numShapes = 1;
+    }
+
+    printf("%6s %5s %9s %12s %10s\n", "STAGES", "ARGS", "BYTES", "NS/LINE", "NS/BYTE");
+    for (int i = 0; i < numShapes; i++) {
+        size_t len;
+        double ns = bench_shape(shapes[i][0], shapes[i][1], &len);
+        if (ns < 0) {
+            printf("%6d %5d %9zu   does not parse\n", shapes[i][0], shapes[i][1], len);
+            continue;
+        }
+        printf("%6d %5d %9zu %12.1f %10.2f\n", shapes[i][0], shapes[i][1], len, ns, ns / len);
+    }
+    return 0;
+}
@@ -15,12 +15,15 @@
 #define MODE_LCLI   0       //Local client
 #define MODE_SCLI   1       //Socket client
 #define MODE_SSVR   2       //Socket server
+#define MODE_LSCR   3       //Local script, from -f or -e
 
 typedef struct cmd_args {
   int   mode;
   char  ip[16];   //e.g., 192.168.100.101\0
   int   port;
   int   threaded_server;
+  char  *script_file;   //-f
+  char  *script_cmds;   //-e
 } cmd_args_t;
 
 
@@ -31,10 +34,12 @@ typedef struct cmd_args {
 //with passing optional connection parameters. 
 
 void print_usage(const char *progname) {
-  printf("Usage: %s [-c | -s] [-i IP] [-p PORT] [-x] [-h]\n", progname);
-  printf("  Default is to run %s in local mode\n", progname);
+  printf("Usage: %s [-c | -s | -f SCRIPT | -e CMDS] [-i IP] [-p PORT] [-x] [-h]\n", progname);
+  printf("  Default is to run %s in local mode, prompting only when stdin is a terminal\n", progname);
   printf("  -c            Run as client\n");
   printf("  -s            Run as server\n");
+  printf("  -f SCRIPT     Run the commands in SCRIPT without prompts\n");
+  printf("  -e CMDS       Run CMDS (lines, or joined by ; && ||) without prompts\n");
   printf("  -i IP         Set IP/Interface address (only valid with -c or -s)\n");
   printf("  -p PORT       Set port number (only valid with -c or -s)\n");
   printf("  -x            Enable threaded mode (only valid with -s)\n");
@@ -50,9 +55,26 @@ void parse_args(int argc, char *argv[], cmd_args_t *cargs) {
   cargs->mode = MODE_LCLI;
   cargs->port = RDSH_DEF_PORT;
 
-  while ((opt = getopt(argc, argv, "csi:p:xh")) != -1) {
+  while ((opt = getopt(argc, argv, "csi:p:xf:e:h")) != -1) {
       switch (opt) {
+          case 'f':
+          case 'e':
+              if (cargs->mode != MODE_LCLI) {
+                  fprintf(stderr, "Error: -f and -e can't be used with each other, -c or -s\n");
+                  exit(EXIT_FAILURE);
+              }
+              cargs->mode = MODE_LSCR;
+              if (opt == 'f') {
+                  cargs->script_file = optarg;
+              } else {
+                  cargs->script_cmds = optarg;
+              }
+              break;
           case 'c':
+              if (cargs->mode == MODE_LSCR) {
+                  fprintf(stderr, "Error: -f and -e can't be used with each other, -c or -s\n");
+                  exit(EXIT_FAILURE);
+              }
               if (cargs->mode != MODE_LCLI) {
                   fprintf(stderr, "Error: Cannot use both -c and -s\n");
                   exit(EXIT_FAILURE);
@@ -61,6 +83,10 @@ void parse_args(int argc, char *argv[], cmd_args_t *cargs) {
               strncpy(cargs->ip, RDSH_DEF_CLI_CONNECT, sizeof(cargs->ip) - 1);
               break;
           case 's':
+              if (cargs->mode == MODE_LSCR) {
+                  fprintf(stderr, "Error: -f and -e can't be used with each other, -c or -s\n");
+                  exit(EXIT_FAILURE);
+              }
               if (cargs->mode != MODE_LCLI) {
                   fprintf(stderr, "Error: Cannot use both -c and -s\n");
                   exit(EXIT_FAILURE);
@@ -69,7 +95,7 @@ void parse_args(int argc, char *argv[], cmd_args_t *cargs) {
               strncpy(cargs->ip, RDSH_DEF_SVR_INTFACE, sizeof(cargs->ip) - 1);
               break;
           case 'i':
-              if (cargs->mode == MODE_LCLI) {
+              if (cargs->mode == MODE_LCLI || cargs->mode == MODE_LSCR) {
                   fprintf(stderr, "Error: -i can only be used with -c or -s\n");
                   exit(EXIT_FAILURE);
               }
@@ -77,7 +103,7 @@ void parse_args(int argc, char *argv[], cmd_args_t *cargs) {
               cargs->ip[sizeof(cargs->ip) - 1] = '\0';  // Ensure null termination
               break;
           case 'p':
-              if (cargs->mode == MODE_LCLI) {
+              if (cargs->mode == MODE_LCLI || cargs->mode == MODE_LSCR) {
                   fprintf(stderr, "Error: -p can only be used with -c or -s\n");
                   exit(EXIT_FAILURE);
               }
@@ -115,6 +141,7 @@ void parse_args(int argc, char *argv[], cmd_args_t *cargs) {
  *    1. run locally (no parameters)
  *    2. start the server with the -s option
  *    3. start the client with the -c option
+ *    4. run a script with the -f or -e option
 */
 int main(int argc, char *argv[]){
   signal(SIGPIPE, SIG_IGN);
@@ -133,6 +160,12 @@ int main(int argc, char *argv[]){
       printf("socket client mode:  addr:%s:%d\n", cargs.ip, cargs.port);
       rc = exec_remote_cmd_loop(cargs.ip, cargs.port);
       break;
+    case MODE_LSCR:
+      // a script prints only what its commands do and exits with the last one's status
+      if (cargs.script_cmds != NULL) {
+        return exec_script_string(cargs.script_cmds);
+      }
+      return exec_script_file(cargs.script_file);
     case MODE_SSVR:
       printf("socket server mode:  addr:%s:%d\n", cargs.ip, cargs.port);
       if (cargs.threaded_server){
@@ -148,4 +181,7 @@ int main(int argc, char *argv[]){
   }
 
   printf("cmd loop returned %d\n", rc);
+
+  // the local loop returns the status of a script piped to it
+  return (cargs.mode == MODE_LCLI) ? rc : 0;
 }
\ No newline at end of file
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -7,8 +8,36 @@
 #include <fcntl.h>
 #include <sys/wait.h>
 #include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <signal.h>
 #include "dshlib.h"
 
+extern char **environ;
+
+// what a stage started by spawn_stage() needs until it execs. It lives on
+// the launching thread's stack, which is shared with the child
+typedef struct spawn_args {
+    const char *path;
+    char **argv;
+    int inFd;
+    int outFd;
+    const sigset_t *mask; // the mask to exec with, all signals are blocked until then
+    int error;            // errno of a dup2() or exec that failed in the child
+} spawn_args_t;
+
+// the tokenizer's place in a command line, see cursor_peek()
+typedef struct line_cursor {
+    char *pos;
+    char held;
+} line_cursor_t;
+
+static char cursor_peek(const line_cursor_t *cursor);
+static void cursor_next(line_cursor_t *cursor);
+static int parse_stage(line_cursor_t *cursor, cmd_buff_t *cmd_buff, arena_t *arena);
+static int run_cmd_line(char *line, arena_t *arena, bool interactive);
+static char **script_argv(cmd_buff_t *cmd);
+
 /*
  * Implement your exec_local_cmd_loop function by building a loop that prompts the 
  * user for input.  Use the SH_PROMPT constant from dshlib.h and then
@@ -53,151 +82,429 @@
  *      fork(), execvp(), exit(), chdir()
  */
 int exec_local_cmd_loop() {
-    char *cmd_buff = malloc(SH_CMD_MAX);
-    if (!cmd_buff) {
+    arena_t arena;
+    int rc = 0;
+
+    // piped or redirected input is run as a script, without prompts, and
+    // its last command's status becomes the shell's
+    if (!isatty(STDIN_FILENO)) {
+        return exec_script_fd(STDIN_FILENO);
+    }
+
+    if (arena_init(&arena, ARENA_SZ) != OK) {
         perror("malloc failed");
         exit(EXIT_FAILURE);
     }
-    int rc = 0;
 
     while (1) {
-        command_list_t* clist = (command_list_t*) malloc(sizeof(command_list_t));
-        if (!clist) {
-            perror("malloc failed");
-            exit(EXIT_FAILURE);
-        }
-        memset(clist, 0, sizeof(command_list_t));
-        clist->num = 0;
+        // everything from the last line goes back at once
+        arena_reset(&arena);
 
         printf("%s", SH_PROMPT);
-        if (fgets(cmd_buff, ARG_MAX, stdin) == NULL) {
+        char *cmd_buff = read_line(stdin, &arena);
+        if (cmd_buff == NULL) {
             printf("\n");
             break;
         }
 
-        cmd_buff[strcspn(cmd_buff, "\n")] = '\0';
+        rc = run_cmd_line(cmd_buff, &arena, true);
+        if (rc == OK_EXIT) {
+            break;
+        }
+    }
+
+    arena_free(&arena);
+    return OK;
+}
+
+
+/*
+ * function: read_line
+ * purpose: reads a line of any length into the arena, doubling the buffer
+ *          while the line doesn't fit
+ * parameters:
+ *    in: the stream to read
+ *    arena: the line's arena
+ * returns: the line without its newline, or NULL at the end of the input
+ *          or if the line can't be allocated
+ */
+char *read_line(FILE *in, arena_t *arena) {
+    size_t cap = SH_CMD_MAX;
+    size_t len = 0;
+    char *line = arena_alloc(arena, cap);
+
+    while (line != NULL && fgets(line + len, cap - len, in) != NULL) {
+        len += strlen(line + len);
+        if (len > 0 && line[len - 1] == '\n') {
+            line[len - 1] = '\0';
+            return line;
+        }
+
+        // fgets() stopped short of a full buffer, so the input ended
+        if (len < cap - 1) {
+            return line;
+        }
+        line = arena_grow(arena, line, cap, cap * 2);
+        cap *= 2;
+    }
+    return (line != NULL && len > 0) ? line : NULL;
+}
+
+
+/*
+ * function: run_cmd_line
+ * purpose: parses a line into its pipelines and runs them. The arena is
+ *          left for the caller to reset
+ * parameters:
+ *    line: the line, overwritten by the parse
+ *    arena: the line's arena
+ *    interactive: whether a blank line gets a warning
+ * returns: the status of the last pipeline that ran (0 for success, 2 for
+ *          a syntax error), ok_exit for exit, or warn_no_cmds for a blank line
+ */
+static int run_cmd_line(char *line, arena_t *arena, bool interactive) {
+    cmd_seq_t seq;
 
-        if (strlen(cmd_buff) == 0) {
+    int rc = build_cmd_seq(line, &seq, arena);
+    if (rc == WARN_NO_CMDS) {
+        if (interactive) {
             printf(CMD_WARN_NO_CMD);
-            free(clist);
+        }
+        return WARN_NO_CMDS;
+    } else if (rc == ERR_MEMORY) {
+        printf(CMD_ERR_MEMORY);
+        return EXIT_FAILURE;
+    } else if (rc != OK) {
+        return 2;
+    }
+
+    return execute_seq(&seq);
+}
+
+
+/*
+ * function: run_script_lines
+ * purpose: runs every complete line in buf, ending each in place at its
+ *          newline
+ * parameters:
+ *    buf: the script text read so far
+ *    len: bytes in buf
+ *    arena: reset for each line
+ *    status: gets the status of each line that ran a command
+ * returns: the bytes used, up to just past the last newline, or -1 once a
+ *          line has run exit
+ */
+static ssize_t run_script_lines(char *buf, size_t len, arena_t *arena, int *status) {
+    size_t start = 0;
+    char *newline;
+
+    while ((newline = memchr(buf + start, '\n', len - start)) != NULL) {
+        *newline = '\0';
+        arena_reset(arena);
+        int rc = run_cmd_line(buf + start, arena, false);
+        start = (newline - buf) + 1;
+        if (rc == OK_EXIT) {
+            return -1;
+        }
+        if (rc != WARN_NO_CMDS) {
+            *status = rc;
+        }
+    }
+    return start;
+}
+
+
+/*
+ * function: exec_script_fd
+ * purpose: runs the script read from fd. There are no prompts, input is
+ *          read in SCRIPT_BLOCK_SZ blocks and split into lines in place,
+ *          and blank lines are skipped. The buffer doubles for a line
+ *          longer than it
+ * parameters:
+ *    fd: the script
+ * returns: the status of the last command run, as the shell's exit status
+ */
+int exec_script_fd(int fd) {
+    arena_t arena;
+    size_t cap = SCRIPT_BLOCK_SZ;
+    size_t len = 0;
+    int status = OK;
+    char *buf = malloc(cap);
+
+    if (buf == NULL || arena_init(&arena, ARENA_SZ) != OK) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+
+    while (1) {
+        ssize_t got = read(fd, buf + len, cap - len);
+        if (got < 0 && errno == EINTR) {
             continue;
         }
+        if (got <= 0) {
+            if (got < 0) {
+                perror("read");
+            }
 
-        rc = build_cmd_list(cmd_buff, clist);
-        if (rc != OK) {
-            if (rc == ERR_CMD_OR_ARGS_TOO_BIG) {
-                printf(CMD_ERR_PIPE_LIMIT, 8);
+            // the last line may not end in a newline, there is always room to end it here
+            if (len > 0) {
+                buf[len] = '\0';
+                arena_reset(&arena);
+                int rc = run_cmd_line(buf, &arena, false);
+                if (rc != OK_EXIT && rc != WARN_NO_CMDS) {
+                    status = rc;
+                }
             }
-            free(clist);
-            continue;
+            break;
         }
+        len += got;
 
-        rc = execute_pipeline(clist);
-        if (rc == OK_EXIT) {
-            free(clist);
+        ssize_t used = run_script_lines(buf, len, &arena, &status);
+        if (used < 0) {
             break;
         }
+        if (used > 0) {
+            memmove(buf, buf + used, len - used);
+            len -= used;
+        }
+        if (len == cap) {
+            char *grown = realloc(buf, cap * 2);
+            if (grown == NULL) {
+                printf(CMD_ERR_MEMORY);
+                status = EXIT_FAILURE;
+                break;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+    }
 
-        free(clist);
+    arena_free(&arena);
+    free(buf);
+    return status;
+}
+
+
+/*
+ * function: exec_script_file
+ * purpose: runs the script in a file, see exec_script_fd()
+ * parameters:
+ *    path: the file
+ * returns: the status of the last command run, or 127 if the file can't
+ *          be opened
+ */
+int exec_script_file(const char *path) {
+    // close-on-exec, the script's commands don't get to read it
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror(path);
+        return 127;
     }
 
-    free(cmd_buff);
-    return OK;
+    int status = exec_script_fd(fd);
+    close(fd);
+    return status;
 }
 
 
 /*
- * function: build_cmd_list
- * purpose: parses a command line into separate commands split by pipe symbols
+ * function: exec_script_string
+ * purpose: runs commands given as a string, which may hold several lines,
+ *          the same way as a script
  * parameters:
- *    cmd_line: the raw command line input
- *    clist: pointer to a command_list_t to populate
- * returns: ok on success, error code on failure
+ *    cmds: the commands
+ * returns: the status of the last command run
  */
-int build_cmd_list(char *cmd_line, command_list_t *clist) {
+int exec_script_string(const char *cmds) {
+    arena_t arena;
+    size_t len = strlen(cmds);
+    int status = OK;
+    char *buf = strdup(cmds);
 
-    // if (strlen(cmd_line) == 0) {
-    //     return ERR_CMD_ARGS_BAD;
-    // }
+    if (buf == NULL || arena_init(&arena, ARENA_SZ) != OK) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+
+    ssize_t used = run_script_lines(buf, len, &arena, &status);
+    if (used >= 0 && (size_t) used < len) {
+        arena_reset(&arena);
+        int rc = run_cmd_line(buf + used, &arena, false);
+        if (rc != OK_EXIT && rc != WARN_NO_CMDS) {
+            status = rc;
+        }
+    }
 
-    int commandCount = 0;
-    char tokenBuffer[SH_CMD_MAX]; // local token buffer
-    cmd_buff_t command_t;
-    alloc_cmd_buff(&command_t);
+    arena_free(&arena);
+    free(buf);
+    return status;
+}
 
-    stripLTWhiteSpace(cmd_line);
 
-    // Get and process the first token.
-    int tokenRC = getTruncToken(cmd_line, tokenBuffer, PIPE_STRING);
+/*
+ * function: syntax_error
+ * purpose: reports the operator the cursor is on as unexpected
+ * parameters:
+ *    cursor: position in the line
+ * returns: err_cmd_args_bad
+ */
+static int syntax_error(const line_cursor_t *cursor) {
+    char c = cursor_peek(cursor);
 
-    if (tokenRC == -1) {
-        return ERR_CMD_OR_ARGS_TOO_BIG;
+    if (c == '\0') {
+        fprintf(stderr, "syntax error: expected a command at the end of the line\n");
+    } else if ((c == '&' || c == PIPE_CHAR) && cursor->pos[1] == c) {
+        fprintf(stderr, "syntax error near unexpected token `%c%c'\n", c, c);
+    } else {
+        fprintf(stderr, "syntax error near unexpected token `%c'\n", c);
     }
+    return ERR_CMD_ARGS_BAD;
+}
 
-    int buildRC = build_cmd_buff(tokenBuffer, &command_t);
 
-    if (buildRC < 0) {
-        if (buildRC == ERR_CMD_ARGS_BAD) {
-            printf(CMD_ERR_PIPE_LIMIT, CMD_MAX);
-        }
-        return buildRC;
+/*
+ * function: parse_pipeline
+ * purpose: parses the commands of one pipeline, split by single pipe
+ *          symbols. The commands and their argv come from the arena and
+ *          double as they fill, so there is no limit on either and the
+ *          parse stays linear
+ * parameters:
+ *    cursor: position in the line, left on the ;, && or || that ends the
+ *            pipeline or on the end of the line
+ *    clist: pointer to a command_list_t to populate
+ *    arena: the line's arena
+ * returns: ok on success, error code on failure
+ */
+static int parse_pipeline(line_cursor_t *cursor, command_list_t *clist, arena_t *arena) {
+    int cap = CMD_MAX;
+
+    clist->num = 0;
+    clist->next_op = SEQ_END;
+    clist->commands = arena_alloc(arena, cap * sizeof(cmd_buff_t));
+    if (clist->commands == NULL) {
+        return ERR_MEMORY;
     }
 
-    clist->commands[clist->num] = command_t;
-    clist->num++;
-    commandCount++;
+    while (1) {
+        if (clist->num == cap) {
+            cmd_buff_t *grown = arena_grow(arena, clist->commands, cap * sizeof(cmd_buff_t),
+                                           2 * cap * sizeof(cmd_buff_t));
+            if (grown == NULL) {
+                return ERR_MEMORY;
+            }
+            clist->commands = grown;
+            cap *= 2;
+        }
 
-    // Loop while there is still remaining input in cmd_line.
-    while (strlen(cmd_line) != 0) {
+        // only a whole pipeline may be empty, a stage next to a pipe may not
+        int rc = parse_stage(cursor, &clist->commands[clist->num], arena);
+        if (rc == WARN_NO_CMDS && (clist->num > 0 || cursor_peek(cursor) == PIPE_CHAR)) {
+            return syntax_error(cursor);
+        }
+        if (rc != OK) {
+            return rc;
+        }
+        clist->num++;
 
-        stripLTWhiteSpace(cmd_line);
-        if (strlen(cmd_line) == 0) {
-            break;
+        // parse_stage() stops on an operator or the end of the line, a
+        // single pipe is the only one that carries on the pipeline
+        if (cursor_peek(cursor) != PIPE_CHAR || cursor->pos[1] == PIPE_CHAR) {
+            return OK;
         }
+        cursor_next(cursor);
+    }
+}
 
-        char* tokenBuffer = malloc(SH_CMD_MAX);
-        memset(tokenBuffer, 0, SH_CMD_MAX);
 
-        tokenRC = getTruncToken(cmd_line, tokenBuffer, PIPE_STRING);
+/*
+ * function: build_cmd_list
+ * purpose: parses a command line that is a single pipeline, in one pass
+ *          over the line. Words are left in place in cmd_line, which the
+ *          argv entries and redirection files point into
+ * parameters:
+ *    cmd_line: the raw command line input, overwritten by the parse
+ *    clist: pointer to a command_list_t to populate
+ *    arena: the line's arena
+ * returns: ok on success, error code on failure (err_cmd_args_bad for a
+ *          ;, && or ||, which need build_cmd_seq())
+ */
+int build_cmd_list(char *cmd_line, command_list_t *clist, arena_t *arena) {
+    line_cursor_t cursor = { cmd_line, '\0' };
 
-        if (strlen(tokenBuffer) == 0) {
-            free(tokenBuffer);
-            break;
-        }
+    int rc = parse_pipeline(&cursor, clist, arena);
+    if (rc == OK && cursor_peek(&cursor) != '\0') {
+        return syntax_error(&cursor);
+    }
+    return rc;
+}
 
-        commandCount++;
 
-        if (commandCount > CMD_MAX) {
-            free(tokenBuffer);
-            return ERR_CMD_OR_ARGS_TOO_BIG;
-        }
+/*
+ * function: build_cmd_seq
+ * purpose: parses a command line into pipelines joined by ;, && and ||.
+ *          An empty pipeline is a syntax error, except after a ; that
+ *          ends the line
+ * parameters:
+ *    cmd_line: the raw command line input, overwritten by the parse
+ *    seq: pointer to a cmd_seq_t to populate
+ *    arena: the line's arena
+ * returns: ok, warn_no_cmds for a blank line, or an error code
+ */
+int build_cmd_seq(char *cmd_line, cmd_seq_t *seq, arena_t *arena) {
+    line_cursor_t cursor = { cmd_line, '\0' };
+    int cap = SEQ_MAX;
 
-        alloc_cmd_buff(&command_t);
-        buildRC = build_cmd_buff(tokenBuffer, &command_t);
+    seq->num = 0;
+    seq->lists = arena_alloc(arena, cap * sizeof(command_list_t));
+    if (seq->lists == NULL) {
+        return ERR_MEMORY;
+    }
 
-        if (buildRC < 0) {
-            if (buildRC == ERR_CMD_ARGS_BAD) {
-                printf(CMD_ERR_PIPE_LIMIT, CMD_MAX);
+    while (1) {
+        if (seq->num == cap) {
+            command_list_t *grown = arena_grow(arena, seq->lists, cap * sizeof(command_list_t),
+                                               2 * cap * sizeof(command_list_t));
+            if (grown == NULL) {
+                return ERR_MEMORY;
             }
-            free(tokenBuffer);
-            return buildRC;
+            seq->lists = grown;
+            cap *= 2;
         }
 
-
-        clist->commands[clist->num] = command_t;
-        clear_cmd_buff(&command_t);
-
-        free(tokenBuffer);
-        clist->num++;
-        if (buildRC == ERR_CMD_OR_ARGS_TOO_BIG) {
-            return ERR_CMD_OR_ARGS_TOO_BIG;
+        command_list_t *clist = &seq->lists[seq->num];
+        int rc = parse_pipeline(&cursor, clist, arena);
+        char c = cursor_peek(&cursor);
+        if (rc == WARN_NO_CMDS) {
+            if (c == '\0' && (seq->num == 0 || seq->lists[seq->num - 1].next_op == SEQ_ALWAYS)) {
+                return (seq->num == 0) ? WARN_NO_CMDS : OK;
+            }
+            return syntax_error(&cursor);
         }
+        if (rc != OK) {
+            return rc;
+        }
+        seq->num++;
 
+        if (c == '\0') {
+            return OK;
+        } else if (c == ';') {
+            clist->next_op = SEQ_ALWAYS;
+            cursor_next(&cursor);
+        } else if (c == '&' && cursor.pos[1] == '&') {
+            clist->next_op = SEQ_AND;
+            cursor_next(&cursor);
+            cursor_next(&cursor);
+        } else if (c == PIPE_CHAR) {
+            clist->next_op = SEQ_OR;
+            cursor_next(&cursor);
+            cursor_next(&cursor);
+        } else {
+            return syntax_error(&cursor);
+        }
     }
-
-    return OK;
 }
 
+
 /*
  * function: match_command
  * purpose: determines if the input is a built-in command
@@ -215,6 +522,8 @@ Built_In_Cmds match_command(const char* input) {
         return BI_CMD_CD;
     } else if (strcmp(input, "rc") == 0) {
         return BI_CMD_RC;
+    } else if (strcmp(input, "hash") == 0) {
+        return BI_CMD_HASH;
     } else {
         return BI_NOT_BI;
     }
@@ -226,7 +535,7 @@ Built_In_Cmds match_command(const char* input) {
  * purpose: runs the specified built-in command (cd, exit, etc.)
  * parameters:
  *    cmd: a pointer to the cmd_buff_t containing arguments
- * returns: a Built_In_Cmds enum result indicating execution or exit
+ * returns: a Built_In_Cmds enum result indicating execution, failure or exit
  */
 Built_In_Cmds exec_built_in_cmd(cmd_buff_t* cmd) {
     Built_In_Cmds type = match_command(cmd->argv[0]);
@@ -241,12 +550,17 @@ Built_In_Cmds exec_built_in_cmd(cmd_buff_t* cmd) {
         if (cmd->argc == 1) {
             return BI_EXECUTED;
         }
-        chdir(cmd->argv[1]);
+        if (chdir(cmd->argv[1]) == -1) {
+            fprintf(stderr, "cd: %s: %s\n", cmd->argv[1], strerror(errno));
+            return BI_FAILED;
+        }
         return BI_EXECUTED;
     } else if (type == BI_CMD_RC) {
         int savedErrno = errno;
         printf("%d\n", savedErrno);
         return BI_EXECUTED;
+    } else if (type == BI_CMD_HASH) {
+        return (exec_hash_cmd(cmd) == OK) ? BI_EXECUTED : BI_FAILED;
     }
     return BI_EXECUTED;
 }
@@ -254,7 +568,8 @@ Built_In_Cmds exec_built_in_cmd(cmd_buff_t* cmd) {
 
 /*
  * function: exec_cmd
- * purpose: handles built-in vs external commands; external commands are executed via execvp
+ * purpose: handles built-in vs external commands in a forked stage; external commands are
+ *          executed via execvp, on the stdin and stdout start_pipeline() set up
  * parameters:
  *    cmd: a pointer to the cmd_buff_t with argv data
  * returns: ok_exit for exit, ok on success, otherwise error code
@@ -264,15 +579,28 @@ int exec_cmd(cmd_buff_t* cmd) {
 
     if (type == BI_NOT_BI) {
         // REMOVED second fork
-        handle_redirections(cmd);
-        // ADDED: directly exec here
-        execvp(cmd->argv[0], cmd->argv);
-        int exec_errno = errno;
-        exit(exec_errno);
+        // ADDED: directly exec here, on the path the launcher looked up
+        if (cmd->exe_path != NULL) {
+            execv(cmd->exe_path, cmd->argv);
+
+            // a file that isn't a binary is a script without a #! line,
+            // which execvp() would hand to the shell
+            char **shArgv = (errno == ENOEXEC) ? script_argv(cmd) : NULL;
+            if (shArgv != NULL) {
+                execv(SCRIPT_SHELL, shArgv);
+                errno = ENOEXEC;
+            }
+        } else {
+            execvp(cmd->argv[0], cmd->argv);
+        }
+        // the parent only has the status, as for a spawn that failed
+        exit((errno == ENOENT) ? NOT_FOUND_SC : NOT_EXEC_SC);
     } else {
         Built_In_Cmds rc = exec_built_in_cmd(cmd);
         if (rc == BI_CMD_EXIT) {
             return OK_EXIT;
+        } else if (rc == BI_FAILED) {
+            return ERR_EXEC_CMD;
         } else {
             return OK;
         }
@@ -295,10 +623,9 @@ int alloc_cmd_buff(cmd_buff_t* cmd_buff) {
         return ERR_MEMORY;
     }
 
-    // allocate memory for string pointers
-    for (int i = 0; i < CMD_ARGV_MAX; i++) {
-        cmd_buff->argv[i] = NULL;
-    }
+    // argv is allocated by the parse
+    cmd_buff->argc = 0;
+    cmd_buff->argv = NULL;
 
     return OK;
 }
@@ -316,12 +643,31 @@ int free_cmd_buff(cmd_buff_t* cmd_buff) {
     // free command buffer
     if (cmd_buff->_cmd_buffer != NULL) {
         free(cmd_buff->_cmd_buffer);
+        cmd_buff->_cmd_buffer = NULL;
     }
 
     return OK;
 }
 
 
+/*
+ * function: free_cmd_list
+ * purpose: releases what the commands of a list own. The list and the words
+ *          live in the line's arena, so that is only buffers a command was
+ *          given with alloc_cmd_buff()
+ * parameters:
+ *    cmd_lst: pointer to the command_list_t
+ * returns: ok
+ */
+int free_cmd_list(command_list_t *cmd_lst) {
+    for (int i = 0; i < cmd_lst->num; i++) {
+        free_cmd_buff(&cmd_lst->commands[i]);
+    }
+    cmd_lst->num = 0;
+    return OK;
+}
+
+
 /*
  * function: clear_cmd_buff
  * purpose: zeroes out the cmd_buff_t structure
@@ -337,155 +683,196 @@ int clear_cmd_buff(cmd_buff_t* cmd_buff) {
 
 
 /*
- * function: build_cmd_buff
- * purpose: tokenizes a line into argv entries and stores them in cmd_buff
+ * function: cursor_peek
+ * purpose: the character the cursor is on. A word's '\0' can be written over
+ *          the delimiter right after it, which is then held in the cursor
  * parameters:
- *    cmd_line: the raw command line
- *    cmd_buff: pointer to a cmd_buff_t to fill
- * returns: ok on success, or an error code if arguments exceed capacity
+ *    cursor: position in the line
+ * returns: the character, '\0' at the end of the line
  */
-int build_cmd_buff(char* cmd_line, cmd_buff_t* cmd_buff) {
-    int argc = 0;
-    stripLTWhiteSpace(cmd_line);
+static char cursor_peek(const line_cursor_t *cursor) {
+    return (cursor->held != '\0') ? cursor->held : *cursor->pos;
+}
 
-    // populate the _cmd_buffer
-    strcpy(cmd_buff->_cmd_buffer, cmd_line);
 
-    char* charPtr = cmd_buff->_cmd_buffer; 
-    int length = 0;
-    int quoteMode = 0;
-    
-    while (*charPtr != '\0') {
-        if (*charPtr == '"' && !quoteMode) {
-            *charPtr = '\0';
-            quoteMode = 1;
-        } else if (*charPtr == '"' && quoteMode){
-            quoteMode = 0;
-            *charPtr = '\0';
-        } else if (*charPtr == ' ' && !quoteMode) {
-            *charPtr = '\0';
-        }
-        charPtr++;
-        length++;
-    }
+/*
+ * function: cursor_next
+ * purpose: moves the cursor on by one character
+ * parameters:
+ *    cursor: position in the line
+ * returns: none
+ */
+static void cursor_next(line_cursor_t *cursor) {
+    cursor->held = '\0';
+    cursor->pos++;
+}
+
 
-    for (int i = 0; i < length; i++) {
-        if (argc > CMD_MAX) {
-            return ERR_CMD_ARGS_BAD;
+/*
+ * function: is_word_end
+ * purpose: tells whether a character outside quotes ends a word
+ * parameters:
+ *    c: the character
+ * returns: true for blanks, operators and the end of the line
+ */
+static bool is_word_end(char c) {
+    return c == '\0' || c == SPACE_CHAR || c == '\t' || c == PIPE_CHAR || c == '<' || c == '>'
+           || c == ';' || c == '&';
+}
+
+
+/*
+ * function: parse_word
+ * purpose: reads the word at the cursor in place. Parts in single or double
+ *          quotes keep their blanks and operators and lose the quotes, so
+ *          the word is written back over the line behind the cursor and
+ *          then terminated
+ * parameters:
+ *    cursor: position in the line, on the first character of the word
+ * returns: the word
+ */
+static char *parse_word(line_cursor_t *cursor) {
+    char *word = cursor->pos;
+    char *out = word;
+    char c;
+
+    while (!is_word_end(c = cursor_peek(cursor))) {
+        cursor_next(cursor);
+        if (c != '"' && c != '\'') {
+            *out++ = c;
+            continue;
         }
 
-        if (i == 0 || (cmd_buff->_cmd_buffer[i-1] == '\0' && cmd_buff->_cmd_buffer[i] != '\0')) {
-            cmd_buff->argv[argc] = &cmd_buff->_cmd_buffer[i];
-            argc++;
+        // a quote ends at the same kind of quote, an unterminated one runs
+        // to the end of the line
+        char quote = c;
+        while ((c = cursor_peek(cursor)) != '\0' && c != quote) {
+            *out++ = c;
+            cursor_next(cursor);
+        }
+        if (c == quote) {
+            cursor_next(cursor);
         }
-    }
-    
-    if (length > ARG_MAX) {
-        return ERR_CMD_OR_ARGS_TOO_BIG;
     }
 
-    if (strlen(cmd_buff->argv[0]) > 64) {
-        return ERR_CMD_OR_ARGS_TOO_BIG;
+    if (out == cursor->pos) {
+        cursor->held = c;
     }
-
-    // set number of args and free memory
-    cmd_buff->argc = argc;
-    cmd_buff->argv[cmd_buff->argc] = NULL;
-    return OK;
+    *out = '\0';
+    return word;
 }
 
 
 /*
- * function: stripLTWhiteSpace
- * purpose: removes leading/trailing whitespace from the given string in-place
+ * function: parse_stage
+ * purpose: fills cmd_buff with the words of one pipeline stage, taking the
+ *          redirections out as it goes. argv is allocated from the arena
+ *          and doubled when it fills
  * parameters:
- *    string: a c-string to modify
- * returns: none
+ *    cursor: position in the line, left on the pipe or the end of the line
+ *    cmd_buff: pointer to a cmd_buff_t to fill
+ *    arena: the line's arena
+ * returns: ok, warn_no_cmds for a stage without a command, or an error code
+ *          if argv can't be allocated or a redirection has no file
  */
-void stripLTWhiteSpace(char* string) {
-    if (*string == '\0') {
-        return;
-    }
+static int parse_stage(line_cursor_t *cursor, cmd_buff_t *cmd_buff, arena_t *arena) {
+    int cap = CMD_ARGV_MAX;
+    char c;
 
-    // Find the first non-whitespace character
-    char *start = string;
-    while (*start && (isspace((unsigned char) *start) || *start == '\t')) {
-        start++;
+    cmd_buff->argv = arena_alloc(arena, cap * sizeof(char *));
+    if (cmd_buff->argv == NULL) {
+        return ERR_MEMORY;
     }
+    cmd_buff->argc = 0;
+    cmd_buff->input_file = NULL;
+    cmd_buff->output_file = NULL;
+    cmd_buff->append_mode = false;
+    cmd_buff->_cmd_buffer = NULL;
+    cmd_buff->exe_path = NULL;
 
-    // Find the last non-whitespace character
-    char *end = string + strlen(string) - 1;
-    while (end > start && (isspace((unsigned char) *end) || *end == '\t')) {
-        end--;
-    }
+    while (1) {
+        while ((c = cursor_peek(cursor)) == SPACE_CHAR || c == '\t') {
+            cursor_next(cursor);
+        }
+        if (c == '\0' || c == PIPE_CHAR || c == ';' || c == '&') {
+            break;
+        }
+
+        if (c == '<' || c == '>') {
+            const char *op = REDIR_STDIN;
+            cursor_next(cursor);
+            if (c == '>') {
+                cmd_buff->append_mode = (cursor_peek(cursor) == '>');
+                op = cmd_buff->append_mode ? STDOUT_APPEND : REDIR_STDOUT;
+                if (cmd_buff->append_mode) {
+                    cursor_next(cursor);
+                }
+            }
+
+            while (cursor_peek(cursor) == SPACE_CHAR || cursor_peek(cursor) == '\t') {
+                cursor_next(cursor);
+            }
+            if (is_word_end(cursor_peek(cursor))) {
+                fprintf(stderr, "syntax error: expected filename after %s\n", op);
+                return ERR_CMD_ARGS_BAD;
+            }
 
-    if (start != string) {
-        char* overwritePtr = string;
-        while (start <= end) {
-            *overwritePtr = *start;
-            overwritePtr++;
-            start++;
+            char *file = parse_word(cursor);
+            if (c == '<') {
+                cmd_buff->input_file = file;
+            } else {
+                cmd_buff->output_file = file;
+            }
+            continue;
         }
-        *overwritePtr = '\0'; 
-    } else {
-        *(end + 1) = '\0'; 
+
+        // one slot is kept for the NULL that ends argv
+        if (cmd_buff->argc == cap - 1) {
+            char **grown = arena_grow(arena, cmd_buff->argv, cap * sizeof(char *),
+                                      2 * cap * sizeof(char *));
+            if (grown == NULL) {
+                return ERR_MEMORY;
+            }
+            cmd_buff->argv = grown;
+            cap *= 2;
+        }
+        cmd_buff->argv[cmd_buff->argc++] = parse_word(cursor);
+    }
+
+    cmd_buff->argv[cmd_buff->argc] = NULL;
+    if (cmd_buff->argc == 0) {
+        return WARN_NO_CMDS;
     }
+    return OK;
 }
 
 
 /*
- * function: getTruncToken
- * purpose: extracts a token from inputString up to the delimiter, then modifies inputString
+ * function: build_cmd_buff
+ * purpose: tokenizes a single command into argv entries in place and stores
+ *          them in cmd_buff, stopping at a pipe if there is one
  * parameters:
- *    inputString: the original line, advanced past the delimiter on return
- *    tokenBuffer: the token read from inputString
- *    delimiter: the delimiter (usually a pipe character)
- * returns: 0 on success, -1 if there's an error
+ *    cmd_line: the raw command line, overwritten by the parse
+ *    cmd_buff: pointer to a cmd_buff_t to fill
+ *    arena: where argv is allocated
+ * returns: ok on success, or an error code if argv can't be allocated
  */
-int getTruncToken(char* inputString, char* tokenBuffer, char* delimiter) {
-    size_t delimiterIndex = strcspn(inputString, delimiter);
-    size_t cpyIndex = 0;
-    
-    if (delimiterIndex == strlen(inputString)) {
-        while (inputString[cpyIndex] != '\0') {  
-            tokenBuffer[cpyIndex] = inputString[cpyIndex];  
-            cpyIndex++;
-        }
-        tokenBuffer[cpyIndex] = '\0'; 
-        inputString[0] = '\0';  
-    
-        inputString[0] = '\0';  // Empty the inputString for the next token
-        return 0;
-    }
+int build_cmd_buff(char* cmd_line, cmd_buff_t* cmd_buff, arena_t *arena) {
+    line_cursor_t cursor = { cmd_line, '\0' };
 
-    // Copy the first command into tokenBuffer
-    while (cpyIndex < delimiterIndex) {
-        tokenBuffer[cpyIndex] = inputString[cpyIndex];
-        cpyIndex++;
-    }
-    tokenBuffer[cpyIndex] = '\0';
-
-    // Shift cmdLine forward past the delimiter
-    size_t newInputStringIndex = 0;
-    delimiterIndex++;
-    
-    while (inputString[delimiterIndex] != '\0') {
-        inputString[newInputStringIndex] = inputString[delimiterIndex];
-        newInputStringIndex++;
-        delimiterIndex++;
-    }
-    inputString[newInputStringIndex] = '\0'; 
-
-    return 0; 
+    return parse_stage(&cursor, cmd_buff, arena);
 }
 
 
 /*
  * function: execute_pipeline
- * purpose: if there's only one command and it's built-in, run in parent; else fork for each stage
+ * purpose: if there's only one command and it's built-in, run in parent; else start every stage
+ *          with start_pipeline() and wait for them
  * parameters:
  *    clist: a pointer to command_list_t holding the pipeline commands
- * returns: ok_exit for an exit request, or the final child's error code, or 0 on success
+ * returns: ok_exit for an exit request, the exit status of the first stage that failed
+ *          (not_found_sc or not_exec_sc for one that couldn't be started), exit_failure
+ *          for a built-in that failed, or 0 on success
  */
 int execute_pipeline(command_list_t *clist) {
     // ADDED: handle built-ins in parent if there's only one command
@@ -497,153 +884,432 @@ int execute_pipeline(command_list_t *clist) {
             if (rc == BI_CMD_EXIT) {
                 return OK_EXIT;
             }
-            return OK;
+            return (rc == BI_FAILED) ? EXIT_FAILURE : OK;
         }
     }
 
-    int pipes[clist->num - 1][2];
-    pid_t pids[clist->num];
+    // what the shell printed goes out before anything the stages print
+    fflush(stdout);
+    start_pipeline(clist, true);
 
-    for (int i = 0; i < clist->num -1; i++) {
-        if (pipe(pipes[i]) == -1) {
-            perror("Error making pipe.");
-            exit(EXIT_FAILURE);
+    // every stage is waited for, so the next pipeline of a sequence starts
+    // after this one has finished. The first failure is the one reported,
+    // rc shows the errno of a stage that couldn't be started
+    int pipelineStatus = EXIT_SUCCESS;
+    int failedStatus = 0;
+    int failedErrno = 0;
+    for (int i = 0; i < clist->num; i++) {
+        cmd_buff_t *cmd = &clist->commands[i];
+        int exitStatus = wait_stage(cmd);
+        const char *message = launch_message(cmd);
+        if (message != NULL) {
+            printf("%s", message);
+        }
+        if (exitStatus == EXIT_SC) {
+            pipelineStatus = OK_EXIT;
+        }
+        if (exitStatus && !failedStatus) {
+            failedStatus = exitStatus;
+            failedErrno = (cmd->pid < 0) ? cmd->launch_error : exitStatus;
         }
     }
 
-    for (int i = 0; i < clist->num; i++) {
-        pids[i] = fork();
-        if (pids[i] == -1) {
-            perror("Error making child processes.");
-            exit(EXIT_FAILURE);
-        }
-        if (pids[i] == 0) {
-            if (i > 0) {
-                dup2(pipes[i-1][0], STDIN_FILENO);
-            }
-            if (i < clist->num - 1) {
-                dup2(pipes[i][1], STDOUT_FILENO);
-            }
-            for (int j = 0; j < clist->num - 1; j++) {
-                close(pipes[j][0]);
-                close(pipes[j][1]);
-            }
-            int rc = exec_cmd(&clist->commands[i]);
-            if (rc == OK_EXIT) {
-                exit(EXIT_SC);
-            } else if (rc == OK) {
-                exit(EXIT_SUCCESS);
-            } else {
-                exit(EXIT_FAILURE);
+    if (failedStatus) {
+        errno = failedErrno;
+        return failedStatus;
+    }
+
+    // rc reports this pipeline, not whatever the shell's own calls left in errno
+    errno = 0;
+    return pipelineStatus;
+}
+
+
+/*
+ * function: execute_seq
+ * purpose: runs the pipelines of a sequence in order. A pipeline after &&
+ *          runs only if the last one that ran succeeded, one after || only
+ *          if it failed, and one after ; always does
+ * parameters:
+ *    seq: the sequence
+ * returns: ok_exit for an exit request, else the status of the last
+ *          pipeline that ran
+ */
+int execute_seq(cmd_seq_t *seq) {
+    int status = OK;
+
+    for (int i = 0; i < seq->num; i++) {
+        if (i > 0) {
+            seq_op_t op = seq->lists[i - 1].next_op;
+            if ((op == SEQ_AND && status != OK) || (op == SEQ_OR && status == OK)) {
+                continue;
             }
         }
+
+        status = execute_pipeline(&seq->lists[i]);
+        free_cmd_list(&seq->lists[i]);
+        if (status == OK_EXIT) {
+            return OK_EXIT;
+        }
     }
+    return status;
+}
+
 
-    for (int i = 0; i < clist->num - 1; i++) {
-        close(pipes[i][0]);
-        close(pipes[i][1]);
+/*
+ * function: open_redirection
+ * purpose: opens a file named after <, > or >> for a stage, close-on-exec so
+ *          only the copy put on the stage's stdin or stdout outlives the exec
+ * parameters:
+ *    cmd: the stage
+ *    output: true for the output file, false for the input file
+ * returns: the descriptor, or -1 after printing why it couldn't be opened
+ */
+static int open_redirection(cmd_buff_t *cmd, bool output) {
+    int fd;
+
+    if (!output) {
+        fd = open(cmd->input_file, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            perror("open for input");
+        }
+        return fd;
     }
 
-    int pipelineStatus = EXIT_SUCCESS;
-    int childStatus;
-    for (int i = 0; i < clist->num; i++) {
-        waitpid(pids[i], &childStatus, 0);
-        if (WIFEXITED(childStatus) && WEXITSTATUS(childStatus) == EXIT_SC) {
-            pipelineStatus = OK_EXIT;
+    // truncate for >, keep what is there for >>
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (cmd->append_mode ? O_APPEND : O_TRUNC);
+    fd = open(cmd->output_file, flags, 0644);
+    if (fd < 0) {
+        perror(cmd->append_mode ? "open for output append" : "open for output");
+    }
+    return fd;
+}
+
+
+/*
+ * function: fork_stage
+ * purpose: runs a stage in a forked copy of the shell, which built-ins need
+ * parameters:
+ *    cmd: the stage
+ *    inFd: descriptor for its stdin, or -1 to keep the shell's
+ *    outFd: descriptor for its stdout, or -1 to keep the shell's
+ * returns: none, cmd->pid is the child
+ */
+static void fork_stage(cmd_buff_t *cmd, int inFd, int outFd) {
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("Error making child processes.");
+        exit(EXIT_FAILURE);
+    }
+
+    if (pid == 0) {
+        if (inFd >= 0) {
+            dup2(inFd, STDIN_FILENO);
+        }
+        if (outFd >= 0) {
+            dup2(outFd, STDOUT_FILENO);
+        }
+        int rc = exec_cmd(cmd);
+        if (rc == OK_EXIT) {
+            exit(EXIT_SC);
+        } else if (rc == OK) {
+            exit(EXIT_SUCCESS);
+        } else {
+            exit(EXIT_FAILURE);
         }
+    }
+    cmd->pid = pid;
+}
 
-        if (WIFEXITED(childStatus) && WEXITSTATUS(childStatus)) {
-            switch (WEXITSTATUS(childStatus)) {
-                case ENOENT:
-                    printf("Command not found in PATH\n");
-                    errno = WEXITSTATUS(childStatus);
-                    return errno;
-                case EACCES:
-                    printf("Permission denied to execute command\n");
-                    errno = WEXITSTATUS(childStatus);
-                    return errno;
-                default:
-                    printf("Error executing external command\n");
-                    errno = WEXITSTATUS(childStatus);
-                    return errno;
-            }
+
+/*
+ * function: script_argv
+ * purpose: the argv that runs a command's file as a shell script, the way
+ *          execvp() does for a file the kernel can't exec
+ * parameters:
+ *    cmd: the stage, with exe_path set
+ * returns: malloc'd SCRIPT_SHELL, the file and cmd's arguments, or NULL
+ */
+static char **script_argv(cmd_buff_t *cmd) {
+    char **shArgv = malloc((cmd->argc + 2) * sizeof(char *));
+
+    if (shArgv != NULL) {
+        shArgv[0] = SCRIPT_SHELL;
+        shArgv[1] = cmd->exe_path;
+        memcpy(shArgv + 2, cmd->argv + 1, cmd->argc * sizeof(char *));
+    }
+    return shArgv;
+}
+
+
+/*
+ * function: stage_dup
+ * purpose: puts a descriptor on stdin or stdout in a spawned stage. A pipe
+ *          that is already there only loses its close-on-exec flag
+ * parameters:
+ *    fd: the descriptor, or -1 to leave target alone
+ *    target: stdin_fileno or stdout_fileno
+ * returns: 0, or -1 with errno set
+ */
+static int stage_dup(int fd, int target) {
+    if (fd < 0) {
+        return 0;
+    } else if (fd == target) {
+        return fcntl(fd, F_SETFD, 0);
+    }
+    return (dup2(fd, target) == -1) ? -1 : 0;
+}
+
+
+/*
+ * function: spawn_child
+ * purpose: the start of a spawned stage. It runs in the shell's memory on
+ *          the launcher's stack, so it only makes system calls and leaves
+ *          why it failed in args->error before exiting
+ * parameters:
+ *    arg: the stage's spawn_args_t
+ * returns: doesn't, the stage execs or exits
+ */
+static int spawn_child(void *arg) {
+    spawn_args_t *args = arg;
+
+    if (stage_dup(args->inFd, STDIN_FILENO) == 0 && stage_dup(args->outFd, STDOUT_FILENO) == 0) {
+        pthread_sigmask(SIG_SETMASK, args->mask, NULL);
+        execve(args->path, args->argv, environ);
+    }
+    args->error = errno;
+    _exit(127);
+}
+
+
+/*
+ * function: spawn_run
+ * purpose: starts a process that runs argv from path on clone(CLONE_VM |
+ *          CLONE_VFORK). It shares the shell's memory instead of copying
+ *          its page tables the way fork() does, and the launcher waits
+ *          until it has exec'd, so the stack it runs on can be a local
+ * parameters:
+ *    path: the file to exec
+ *    argv: its arguments
+ *    inFd: descriptor for its stdin, or -1 to keep the shell's
+ *    outFd: descriptor for its stdout, or -1 to keep the shell's
+ *    pid: gets the child
+ * returns: 0, or the errno of a clone, dup2() or exec that failed, with
+ *          the child already reaped
+ */
+static int spawn_run(const char *path, char **argv, int inFd, int outFd, pid_t *pid) {
+    _Alignas(16) char stack[SPAWN_STACK_SZ];
+    sigset_t all;
+    sigset_t saved;
+    spawn_args_t args = { path, argv, inFd, outFd, &saved, 0 };
+
+    // a signal handler must not run in the child, on the shell's memory
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+    *pid = clone(spawn_child, stack + sizeof(stack), CLONE_VM | CLONE_VFORK | SIGCHLD, &args);
+    if (*pid == -1) {
+        args.error = errno;
+    }
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+
+    if (*pid != -1 && args.error != 0) {
+        while (waitpid(*pid, NULL, 0) == -1 && errno == EINTR) {
         }
     }
+    return args.error;
+}
 
-    return pipelineStatus;
+
+/*
+ * function: spawn_stage
+ * purpose: launches an external command through spawn_run(), so the launch
+ *          costs the same however big the shell (or the threaded server)
+ *          has grown, and it makes no heap allocations
+ * parameters:
+ *    cmd: the stage
+ *    inFd: descriptor for its stdin, or -1 to keep the shell's
+ *    outFd: descriptor for its stdout, or -1 to keep the shell's
+ * returns: none, cmd->pid is the child, or -1 with the exec error in
+ *          cmd->launch_error
+ */
+static void spawn_stage(cmd_buff_t *cmd, int inFd, int outFd) {
+    int rc = spawn_run(cmd->exe_path, cmd->argv, inFd, outFd, &cmd->pid);
+
+    // execve() doesn't fall back to the shell for a script without a #!
+    // line the way execvp() does
+    if (rc == ENOEXEC) {
+        char **shArgv = script_argv(cmd);
+        if (shArgv != NULL) {
+            rc = spawn_run(SCRIPT_SHELL, shArgv, inFd, outFd, &cmd->pid);
+            free(shArgv);
+        }
+    }
+    if (rc != 0) {
+        cmd->pid = -1;
+        cmd->launch_error = rc;
+    }
 }
 
+
 /*
- * function: handle_redirections
- * purpose: scans cmd->argv for redirection operators and opens/closes file descriptors
+ * function: launch_external
+ * purpose: starts an external command on the pipe ends it was given, or on
+ *          its redirection files where it has them. The command is found
+ *          through the path cache, and a cached path that has gone away is
+ *          dropped and looked up again
  * parameters:
- *    cmd: pointer to a cmd_buff_t to adjust
- * returns: none (exits on error)
+ *    cmd: the stage
+ *    inFd: the pipe to read, or -1 to keep the shell's stdin
+ *    outFd: the pipe to write, or -1 to keep the shell's stdout
+ *    useSpawn: true for spawn_stage(), false for fork()
+ * returns: none, cmd->pid is the child, or -1 with the error in
+ *          cmd->launch_error (1 for a file that couldn't be opened, as the
+ *          child used to exit with)
  */
-void handle_redirections(cmd_buff_t *cmd) {
-    int new_argc = 0;
-    char *new_argv[CMD_ARGV_MAX];
+static void launch_external(cmd_buff_t *cmd, int inFd, int outFd, bool useSpawn) {
+    char exePath[PATH_MAX];
+    int inFile = -1;
+    int outFile = -1;
 
-    for (int i = 0; i < cmd->argc; i++) {
-        if (strcmp(cmd->argv[i], REDIR_STDIN) == 0) {
-            // if we want to redirect stdin, open file for reading
-            if (i + 1 < cmd->argc) {
-                int fd = open(cmd->argv[i+1], O_RDONLY);
-                if (fd < 0) {
-                    perror("open for input");
-                    exit(1);
-                }
-                dup2(fd, STDIN_FILENO);
-                close(fd);
-                i++;
-                continue;
-            } else {
-                fprintf(stderr, "syntax error: expected filename after %s\n", REDIR_STDIN);
-                exit(1);
-            }
-        } else if (strcmp(cmd->argv[i], REDIR_STDOUT) == 0) {
-            // if we want to redirect stdout, open file for writing
-            if (i + 1 < cmd->argc) {
-                int fd = open(cmd->argv[i+1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
-                if (fd < 0) {
-                    perror("open for output");
-                    exit(1);
-                }
-                dup2(fd, STDOUT_FILENO);
-                close(fd);
-                i++; 
-                continue;
-            } else {
-                fprintf(stderr, "syntax error: expected filename after %s\n", REDIR_STDOUT);
-                exit(1);
-            }
-        } else if (strcmp(cmd->argv[i], STDOUT_APPEND) == 0) {
-            // if we want to redirect stdout appending, open file for writing with no trunc
-            if (i + 1 < cmd->argc) {
-                int fd = open(cmd->argv[i+1], O_WRONLY | O_CREAT | O_APPEND, 0644);
-                if (fd < 0) {
-                    perror("open for output append");
-                    exit(1);
+    if (cmd->input_file != NULL && (inFile = open_redirection(cmd, false)) < 0) {
+        cmd->launch_error = EXIT_FAILURE;
+        return;
+    }
+    if (cmd->output_file != NULL && (outFile = open_redirection(cmd, true)) < 0) {
+        cmd->launch_error = EXIT_FAILURE;
+    }
+
+    inFd = (inFile >= 0) ? inFile : inFd;
+    outFd = (outFile >= 0) ? outFile : outFd;
+    if (cmd->launch_error == 0) {
+        cmd->launch_error = path_lookup(cmd->argv[0], exePath, sizeof(exePath));
+    }
+    if (cmd->launch_error == 0) {
+        cmd->exe_path = exePath;
+        if (useSpawn) {
+            spawn_stage(cmd, inFd, outFd);
+        } else {
+            fork_stage(cmd, inFd, outFd);
+        }
+
+        // a forked stage reports a failed exec only through its exit
+        // status, so only a spawn can find out here that the path is stale
+        if (cmd->launch_error == ENOENT && strchr(cmd->argv[0], '/') == NULL) {
+            path_forget(cmd->argv[0]);
+            cmd->launch_error = path_lookup(cmd->argv[0], exePath, sizeof(exePath));
+            if (cmd->launch_error == 0) {
+                if (useSpawn) {
+                    spawn_stage(cmd, inFd, outFd);
+                } else {
+                    fork_stage(cmd, inFd, outFd);
                 }
-                dup2(fd, STDOUT_FILENO);
-                close(fd);
-                i++; 
-                continue;
-            } else {
-                fprintf(stderr, "syntax error: expected filename after %s\n", STDOUT_APPEND);
-                exit(1);
             }
+        }
+        cmd->exe_path = NULL;
+    }
+
+    if (inFile >= 0) {
+        close(inFile);
+    }
+    if (outFile >= 0) {
+        close(outFile);
+    }
+}
+
+
+/*
+ * function: start_pipeline
+ * purpose: starts every stage of a pipeline, each reading the pipe from the
+ *          stage before it and writing the one to the stage after. External
+ *          commands are spawned and built-ins forked. Redirection files are
+ *          opened here rather than in the child, so a stage that can't have
+ *          its files isn't started at all
+ * parameters:
+ *    clist: the pipeline
+ *    useSpawn: false forks external commands too, for comparing the two
+ * returns: none, every stage has a pid or a launch_error for wait_stage()
+ */
+void start_pipeline(command_list_t *clist, bool useSpawn) {
+    // each pipe is made just before the stage that writes it, and the shell
+    // lets go of both ends once the stages on either side have them, so a
+    // pipeline of any length holds no more than two pipes open at a time.
+    // they are close-on-exec, a stage keeps only what is on its stdin and stdout
+    int prevRead = -1;
+    for (int i = 0; i < clist->num; i++) {
+        cmd_buff_t *cmd = &clist->commands[i];
+        int pipefd[2] = { -1, -1 };
+        if (i < clist->num - 1 && pipe2(pipefd, O_CLOEXEC) == -1) {
+            perror("Error making pipe.");
+            exit(EXIT_FAILURE);
+        }
+
+        cmd->pid = -1;
+        cmd->launch_error = 0;
+        if (match_command(cmd->argv[0]) != BI_NOT_BI) {
+            fork_stage(cmd, prevRead, pipefd[1]);
         } else {
+            launch_external(cmd, prevRead, pipefd[1], useSpawn);
+        }
 
-            new_argv[new_argc++] = cmd->argv[i];
+        if (prevRead >= 0) {
+            close(prevRead);
         }
+        if (pipefd[1] >= 0) {
+            close(pipefd[1]);
+        }
+        prevRead = pipefd[0];
+    }
+}
+
+
+/*
+ * function: wait_stage
+ * purpose: waits for a stage started by start_pipeline()
+ * parameters:
+ *    cmd: the stage
+ * returns: its exit status, or 0 for a stage killed by a signal. A stage
+ *          that couldn't be started has not_found_sc, not_exec_sc, or 1 if
+ *          a redirection file couldn't be opened
+ */
+int wait_stage(cmd_buff_t *cmd) {
+    int childStatus;
+
+    if (cmd->pid < 0) {
+        if (cmd->launch_error == EXIT_FAILURE) {
+            return EXIT_FAILURE;
+        }
+        return (cmd->launch_error == ENOENT) ? NOT_FOUND_SC : NOT_EXEC_SC;
     }
-    new_argv[new_argc] = NULL;
-    
-    // update the new argument now that we got rid of and parsed the redirection
-    cmd->argc = new_argc;
-    for (int i = 0; i < new_argc; i++) {
-        cmd->argv[i] = new_argv[i];
+    while (waitpid(cmd->pid, &childStatus, 0) == -1) {
+        if (errno != EINTR) {
+            return 0;
+        }
     }
-    cmd->argv[new_argc] = NULL;
-}
\ No newline at end of file
+    return WIFEXITED(childStatus) ? WEXITSTATUS(childStatus) : 0;
+}
+
+
+/*
+ * function: launch_message
+ * purpose: what the shell prints for a stage that couldn't be started.
+ *          Only those get a message, a command that ran and failed has
+ *          said why itself
+ * parameters:
+ *    cmd: a stage that has been waited for
+ * returns: the message, or NULL for a stage that ran or one whose
+ *          redirection file open_redirection() has already complained about
+ */
+const char *launch_message(const cmd_buff_t *cmd) {
+    if (cmd->pid >= 0 || cmd->launch_error == EXIT_FAILURE) {
+        return NULL;
+    }
+
+    switch (cmd->launch_error) {
+        case ENOENT:
+            return CMD_ERR_NOT_FOUND;
+        case EACCES:
+            return CMD_ERR_PERMISSION;
+        default:
+            return CMD_ERR_EXECUTE;
+    }
+}
@@ -5,10 +5,16 @@
 //Constants for command structure sizes
 #define EXE_MAX 64
 #define ARG_MAX 256
+//Room set aside for a pipeline's commands and a command's argv, both grow
+//past it as a line needs
 #define CMD_MAX 8
 #define CMD_ARGV_MAX (CMD_MAX + 1)
-// Longest command that can be read from the shell
+//Room set aside for a line read from the shell, longer lines grow it
 #define SH_CMD_MAX EXE_MAX + ARG_MAX
+//Room set aside for the pipelines of a line joined by ; && ||
+#define SEQ_MAX 4
+//Scripts are read this much at a time
+#define SCRIPT_BLOCK_SZ (64 * 1024)
 
 typedef struct command {
     char exe[EXE_MAX];
@@ -16,21 +22,62 @@ typedef struct command {
 } command_t;
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/types.h>
 
 typedef struct cmd_buff {
     int  argc;
-    char *argv[CMD_ARGV_MAX];
+    char **argv;       // argc words and a NULL, allocated from the line's arena
     char *_cmd_buffer;
     char *input_file;  // extra credit, stores input redirection file (for `<`)
     char *output_file; // extra credit, stores output redirection file (for `>`)
     bool append_mode; // extra credit, sets append mode fomr output_file
+    pid_t pid;         // the stage's child once the pipeline is running
+    int launch_error;  // why the stage couldn't be started when pid is -1
+    char *exe_path;    // argv[0] as found by path_lookup(), for a forked stage to exec
 } cmd_buff_t;
 
+//how the pipeline after a command_list_t runs: always (;), if it
+//succeeded (&&) or if it failed (||)
+typedef enum {
+    SEQ_END,
+    SEQ_ALWAYS,
+    SEQ_AND,
+    SEQ_OR,
+} seq_op_t;
+
 typedef struct command_list {
     int num;
-    cmd_buff_t commands[CMD_MAX];
+    cmd_buff_t *commands; // num of them, allocated from the line's arena
+    seq_op_t next_op;
 } command_list_t;
 
+//a line's pipelines, in the line's arena
+typedef struct cmd_seq {
+    int num;
+    command_list_t *lists;
+} cmd_seq_t;
+
+//per-line arena, see arena.c. The line and its parse are allocated from it
+//and all given back by arena_reset() once the line has run. ARENA_SZ is the
+//first block, more is chained on for lines that need it
+#define ARENA_SZ (16 * 1024)
+
+typedef struct arena_chunk {
+    struct arena_chunk *prev;
+    size_t cap;
+} arena_chunk_t;
+
+typedef struct arena {
+    arena_chunk_t *chunk; // the one being allocated from, older ones hang off prev
+    char *base;           // its data
+    size_t used;
+    size_t cap;
+    size_t total;         // data bytes in all chunks
+    void *last;           // newest allocation, which arena_grow() can extend in place
+} arena_t;
+
 // typedef struct thread_args_t {
 //     char* ifaces;
 //     int port;
@@ -50,6 +97,10 @@ typedef struct command_list {
 #define EXIT_CMD        "exit"
 #define RC_SC           99
 #define EXIT_SC         100
+#define NOT_FOUND_SC    127         //status of a command that isn't in PATH, as other shells have it
+#define NOT_EXEC_SC     126         //status of a command that was found but couldn't be run
+#define SCRIPT_SHELL    "/bin/sh"   //runs executables without a #! line, as execvp() does
+#define SPAWN_STACK_SZ  (32 * 1024) //stack a spawned stage runs on until it execs
 
 //Standard Return Codes
 #define OK                       0
@@ -67,16 +118,23 @@ typedef struct command_list {
 int alloc_cmd_buff(cmd_buff_t *cmd_buff);
 int free_cmd_buff(cmd_buff_t *cmd_buff);
 int clear_cmd_buff(cmd_buff_t *cmd_buff);
-int build_cmd_buff(char *cmd_line, cmd_buff_t *cmd_buff);
+int build_cmd_buff(char *cmd_line, cmd_buff_t *cmd_buff, arena_t *arena);
 int close_cmd_buff(cmd_buff_t *cmd_buff);
-int build_cmd_list(char *cmd_line, command_list_t *clist);
+int build_cmd_list(char *cmd_line, command_list_t *clist, arena_t *arena);
+int build_cmd_seq(char *cmd_line, cmd_seq_t *seq, arena_t *arena);
 int free_cmd_list(command_list_t *cmd_lst);
 
 //custom functions
-void stripLTWhiteSpace(char* string);
-int getTruncToken(char* inputString, char* tokenBuffer, char* delimiter);
+int arena_init(arena_t *arena, size_t cap);
+void *arena_alloc(arena_t *arena, size_t size);
+void *arena_grow(arena_t *arena, void *ptr, size_t oldSize, size_t newSize);
+void arena_reset(arena_t *arena);
+void arena_free(arena_t *arena);
+char *read_line(FILE *in, arena_t *arena);
+int path_lookup(const char *name, char *out, size_t outSize);
+void path_forget(const char *name);
+int exec_hash_cmd(cmd_buff_t *cmd);
 extern void print_dragon();
-void handle_redirections(cmd_buff_t *cmd);
 
 // for multi-threading
 void* handle_threaded_client(void* arg);
@@ -88,8 +146,10 @@ typedef enum {
     BI_CMD_CD,
     BI_CMD_RC,              //extra credit command
     BI_CMD_STOP_SVR,        //new command "stop-server"
+    BI_CMD_HASH,            //command path cache, see pathcache.c
     BI_NOT_BI,
     BI_EXECUTED,
+    BI_FAILED,              //ran but failed, e.g. cd to a missing directory
     BI_NOT_IMPLEMENTED,
 } Built_In_Cmds;
 Built_In_Cmds match_command(const char *input); 
@@ -99,12 +159,23 @@ Built_In_Cmds exec_built_in_cmd(cmd_buff_t *cmd);
 int exec_local_cmd_loop();
 int exec_cmd(cmd_buff_t *cmd);
 int execute_pipeline(command_list_t *clist);
+int execute_seq(cmd_seq_t *seq);
+int exec_script_fd(int fd);
+int exec_script_file(const char *path);
+int exec_script_string(const char *cmds);
+void start_pipeline(command_list_t *clist, bool useSpawn);
+int wait_stage(cmd_buff_t *cmd);
+const char *launch_message(const cmd_buff_t *cmd);
 
 
 //output constants
 #define CMD_OK_HEADER       "PARSED COMMAND LINE - TOTAL COMMANDS %d\n"
 #define CMD_WARN_NO_CMD     "warning: no commands provided\n"
 #define CMD_ERR_PIPE_LIMIT  "error: piping limited to %d commands\n"
+#define CMD_ERR_MEMORY      "error: out of memory\n"
+#define CMD_ERR_NOT_FOUND   "Command not found in PATH\n"
+#define CMD_ERR_PERMISSION  "Permission denied to execute command\n"
+#define CMD_ERR_EXECUTE     "Error executing external command\n"
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,53 @@
+"""Turns an RLE token table into a C header holding the decoded bytes.
+
+The table is the list compress.py (week-5/assignment-3-part-1) prints: each
+token is a run like " 72" (72 spaces) or "%4", and "n" ends a line.  The
+header defines NAME as one static const char array and NAME_LEN as its
+length, so printing the asset is a single write().
+
+    python3 gen_asset.py dragon.rle DRAGON > dragon_asset.h
+"""
+
+import ast
+import sys
+
+
+def decode(tokens):
+    """Expands the tokens the same way compress.py's print_dragon() does"""
+    out = []
+    for token in tokens:
+        if token == "n":
+            out.append("\n")
+            continue
+
+        pattern = "".join(c for c in token if not c.isdigit())
+        repeat = "".join(c for c in token if c.isdigit())
+        out.append(pattern * (int(repeat) if repeat else 1))
+    return "".join(out)
+
+
+def c_string(line):
+    """line as the body of a C string literal"""
+    return line.replace("\\", "\\\\").replace('"', '\\"').replace("\n", "\\n")
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("usage: gen_asset.py table.rle NAME")
+
+    path, name = sys.argv[1], sys.argv[2]
+    with open(path) as f:
+        text = decode(ast.literal_eval(f.read()))
+    data = text.encode()
+
+    print(f"//generated by gen_asset.py from {path}, do not edit")
+    print(f"#define {name}_LEN {len(data)}")
+    print(f"static const char {name}[] =")
+    lines = text.splitlines(keepends=True)
+    for i, line in enumerate(lines):
+        end = ";" if i == len(lines) - 1 else ""
+        print(f'    "{c_string(line)}"{end}')
+
+
+if __name__ == "__main__":
+    main()
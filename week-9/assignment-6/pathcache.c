@@ -0,0 +1,336 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "dshlib.h"
+
+/*
+ * The command path cache, the shell's version of bash's `hash`. A command
+ * name without a slash is looked up in PATH once, with one stat() per
+ * directory until an executable turns up, and the absolute path is kept
+ * here so later launches go straight to it instead of trying an exec in
+ * every PATH directory the way execvp() does.
+ *
+ * The table uses open addressing with linear probing and is kept at most
+ * half full. It is emptied when PATH is no longer what it was filled
+ * under and by `hash -r`. The threads of the server share it, so it is
+ * guarded by a mutex and lookups hand back a copy of the path.
+ */
+
+// used by execvp() too when PATH isn't set
+#define DEFAULT_PATH "/bin:/usr/bin"
+#define PATH_CACHE_MIN_CAP 64
+
+typedef struct path_entry {
+    char *name;      // NULL for an empty slot, the path follows its '\0'
+    char *path;
+    unsigned hits;
+} path_entry_t;
+
+static path_entry_t *cacheSlots = NULL;
+static size_t cacheCap = 0;
+static size_t cacheUsed = 0;
+static char *cachePathVar = NULL;  // the PATH the entries were found under
+static pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/*
+ * function: hash_name
+ * purpose: FNV-1a hash of a command name
+ * parameters:
+ *    name: the name
+ * returns: the hash
+ */
+static size_t hash_name(const char *name) {
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (const unsigned char *c = (const unsigned char *) name; *c != '\0'; c++) {
+        hash = (hash ^ *c) * 1099511628211ULL;
+    }
+    return (size_t) hash;
+}
+
+
+/*
+ * function: find_slot
+ * purpose: finds the slot holding name, or the empty slot it would go in
+ * parameters:
+ *    name: the command name
+ * returns: the slot's index
+ */
+static size_t find_slot(const char *name) {
+    size_t i = hash_name(name) & (cacheCap - 1);
+
+    while (cacheSlots[i].name != NULL && strcmp(cacheSlots[i].name, name) != 0) {
+        i = (i + 1) & (cacheCap - 1);
+    }
+    return i;
+}
+
+
+/*
+ * function: clear_locked
+ * purpose: empties the table, keeping its slots. The caller holds the lock
+ * parameters: none
+ * returns: none
+ */
+static void clear_locked(void) {
+    for (size_t i = 0; i < cacheCap; i++) {
+        free(cacheSlots[i].name);
+        cacheSlots[i].name = NULL;
+    }
+    cacheUsed = 0;
+}
+
+
+/*
+ * function: grow_locked
+ * purpose: doubles the table and rehashes what is in it. The caller holds
+ *          the lock
+ * parameters: none
+ * returns: ok, or err_memory with the table left as it was
+ */
+static int grow_locked(void) {
+    size_t newCap = (cacheCap == 0) ? PATH_CACHE_MIN_CAP : cacheCap * 2;
+    path_entry_t *newSlots = calloc(newCap, sizeof(path_entry_t));
+    path_entry_t *oldSlots = cacheSlots;
+    size_t oldCap = cacheCap;
+
+    if (newSlots == NULL) {
+        return ERR_MEMORY;
+    }
+
+    cacheSlots = newSlots;
+    cacheCap = newCap;
+    for (size_t i = 0; i < oldCap; i++) {
+        if (oldSlots[i].name != NULL) {
+            cacheSlots[find_slot(oldSlots[i].name)] = oldSlots[i];
+        }
+    }
+    free(oldSlots);
+    return OK;
+}
+
+
+/*
+ * function: remove_locked
+ * purpose: takes name out of the table, moving later entries of its probe
+ *          run back so lookups still find them. The caller holds the lock
+ * parameters:
+ *    name: the command name
+ * returns: none
+ */
+static void remove_locked(const char *name) {
+    if (cacheCap == 0) {
+        return;
+    }
+
+    size_t hole = find_slot(name);
+    if (cacheSlots[hole].name == NULL) {
+        return;
+    }
+    free(cacheSlots[hole].name);
+    cacheSlots[hole].name = NULL;
+    cacheUsed--;
+
+    // an entry can fill the hole unless its home slot lies between the two
+    for (size_t i = (hole + 1) & (cacheCap - 1); cacheSlots[i].name != NULL; i = (i + 1) & (cacheCap - 1)) {
+        size_t home = hash_name(cacheSlots[i].name) & (cacheCap - 1);
+        if (((i - home) & (cacheCap - 1)) >= ((i - hole) & (cacheCap - 1))) {
+            cacheSlots[hole] = cacheSlots[i];
+            cacheSlots[i].name = NULL;
+            hole = i;
+        }
+    }
+}
+
+
+/*
+ * function: resolve_in_path
+ * purpose: finds name in the directories of pathVar with one stat() each,
+ *          taking the first executable regular file as execvp() would
+ * parameters:
+ *    name: the command name, without a slash
+ *    pathVar: the PATH to search
+ *    out: gets the file's path
+ *    outSize: size of out
+ * returns: ok, or eacces if only files without execute permission were
+ *          found, or enoent
+ */
+static int resolve_in_path(const char *name, const char *pathVar, char *out, size_t outSize) {
+    size_t nameLen = strlen(name);
+    int rc = ENOENT;
+
+    for (const char *dir = pathVar; ; dir++) {
+        const char *end = strchrnul(dir, ':');
+        size_t dirLen = end - dir;
+
+        // an empty entry is the current directory
+        if (dirLen == 0) {
+            dir = ".";
+            dirLen = 1;
+        }
+        if (dirLen + 1 + nameLen < outSize) {
+            struct stat st;
+            memcpy(out, dir, dirLen);
+            out[dirLen] = '/';
+            memcpy(out + dirLen + 1, name, nameLen + 1);
+
+            if (stat(out, &st) == 0 && S_ISREG(st.st_mode)) {
+                if (st.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH)) {
+                    return OK;
+                }
+                rc = EACCES;
+            }
+        }
+
+        if (*end == '\0') {
+            return rc;
+        }
+        dir = end;
+    }
+}
+
+
+/*
+ * function: lookup
+ * purpose: path_lookup(), with the choice of counting the lookup as a hit
+ * parameters:
+ *    name: the command name
+ *    out: gets the path to exec
+ *    outSize: size of out
+ *    countHit: whether the entry's hits go up
+ * returns: ok, or the errno a failed exec would have given
+ */
+static int lookup(const char *name, char *out, size_t outSize, bool countHit) {
+    if (strchr(name, '/') != NULL) {
+        if (strlen(name) >= outSize) {
+            return ENAMETOOLONG;
+        }
+        strcpy(out, name);
+        return OK;
+    }
+    if (name[0] == '\0') {
+        return ENOENT;
+    }
+
+    pthread_mutex_lock(&cacheLock);
+
+    const char *pathVar = getenv("PATH");
+    if (pathVar == NULL) {
+        pathVar = DEFAULT_PATH;
+    }
+    if (cachePathVar == NULL || strcmp(cachePathVar, pathVar) != 0) {
+        clear_locked();
+        free(cachePathVar);
+        cachePathVar = strdup(pathVar);
+    }
+
+    if (cacheCap > 0) {
+        path_entry_t *entry = &cacheSlots[find_slot(name)];
+        if (entry->name != NULL && strlen(entry->path) < outSize) {
+            strcpy(out, entry->path);
+            entry->hits += countHit;
+            pthread_mutex_unlock(&cacheLock);
+            return OK;
+        }
+    }
+
+    int rc = resolve_in_path(name, pathVar, out, outSize);
+
+    // relative finds depend on the working directory, so only absolute ones are kept
+    if (rc == OK && out[0] == '/' && ((cacheUsed + 1) * 2 <= cacheCap || grow_locked() == OK)) {
+        size_t nameLen = strlen(name);
+        path_entry_t *entry = &cacheSlots[find_slot(name)];
+        char *names = (entry->name == NULL) ? malloc(nameLen + 1 + strlen(out) + 1) : NULL;
+        if (names != NULL) {
+            entry->name = names;
+            entry->path = names + nameLen + 1;
+            entry->hits = countHit;
+            strcpy(entry->name, name);
+            strcpy(entry->path, out);
+            cacheUsed++;
+        }
+    }
+
+    pthread_mutex_unlock(&cacheLock);
+    return rc;
+}
+
+
+/*
+ * function: path_lookup
+ * purpose: the path to exec for a command. Names with a slash are used as
+ *          they are, others come from the cache or are found in PATH and
+ *          added to it
+ * parameters:
+ *    name: the command name, argv[0]
+ *    out: gets the path
+ *    outSize: size of out
+ * returns: ok, or the errno a failed exec would have given (enoent, eacces)
+ */
+int path_lookup(const char *name, char *out, size_t outSize) {
+    return lookup(name, out, outSize, true);
+}
+
+
+/*
+ * function: path_forget
+ * purpose: drops a command from the cache, for a cached path that turned
+ *          out to be gone
+ * parameters:
+ *    name: the command name
+ * returns: none
+ */
+void path_forget(const char *name) {
+    pthread_mutex_lock(&cacheLock);
+    remove_locked(name);
+    pthread_mutex_unlock(&cacheLock);
+}
+
+
+/*
+ * function: exec_hash_cmd
+ * purpose: the hash built-in. With no arguments it lists the cache, -r
+ *          empties it, and names are looked up and added to it
+ * parameters:
+ *    cmd: the command, argv[0] is "hash"
+ * returns: ok, or err_exec_cmd if a name wasn't found
+ */
+int exec_hash_cmd(cmd_buff_t *cmd) {
+    int rc = OK;
+
+    if (cmd->argc == 1) {
+        pthread_mutex_lock(&cacheLock);
+        if (cacheUsed == 0) {
+            printf("hash: hash table empty\n");
+        } else {
+            printf("hits\tcommand\n");
+            for (size_t i = 0; i < cacheCap; i++) {
+                if (cacheSlots[i].name != NULL) {
+                    printf("%4u\t%s\n", cacheSlots[i].hits, cacheSlots[i].path);
+                }
+            }
+        }
+        pthread_mutex_unlock(&cacheLock);
+        return OK;
+    }
+
+    for (int i = 1; i < cmd->argc; i++) {
+        char path[PATH_MAX];
+        if (strcmp(cmd->argv[i], "-r") == 0) {
+            pthread_mutex_lock(&cacheLock);
+            clear_locked();
+            pthread_mutex_unlock(&cacheLock);
+        } else if (lookup(cmd->argv[i], path, sizeof(path), false) != OK) {
+            fprintf(stderr, "hash: %s: not found\n", cmd->argv[i]);
+            rc = ERR_EXEC_CMD;
+        }
+    }
+    return rc;
+}
@@ -116,6 +116,7 @@ int exec_remote_cmd_loop(char *address, int port) {
     char* sendBuff;
     char* receiveBuff;
 
+    size_t sendCap = RDSH_COMM_BUFF_SZ;
     size_t bytesSent;
 
     int recv_size;
@@ -143,8 +144,9 @@ int exec_remote_cmd_loop(char *address, int port) {
             return client_cleanup(socket, sendBuff, receiveBuff, ERR_RDSH_COMMUNICATION);
         }
 
+        // getline() grows sendBuff to fit lines of any length
         printf("%s", SH_PROMPT);
-        if (fgets(sendBuff, ARG_MAX, stdin) == NULL) {
+        if (getline(&sendBuff, &sendCap, stdin) < 0) {
             printf("\n");
             break;
         }
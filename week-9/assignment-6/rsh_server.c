@@ -1,4 +1,4 @@
-
+#define _GNU_SOURCE
 #include <sys/socket.h>
 #include <sys/wait.h>
 #include <arpa/inet.h>
@@ -117,7 +117,7 @@ int stop_server(int svr_socket) {
 int boot_server(char *ifaces, int port) {
     
     // set up new socket and check for error
-    int socketFd = socket(AF_INET, SOCK_STREAM, 0);
+    int socketFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
     if (socketFd < 0) {
         return ERR_RDSH_COMMUNICATION;
     }
@@ -205,8 +205,9 @@ int process_cli_requests(int svr_socket) {
     fcntl(LISTEN_SOCKET, F_SETFL, flags | O_NONBLOCK);
 
     while (1) {
-        // try to connect and handle errors
-        connectedSocketFd = accept(svr_socket, NULL, NULL);
+        // try to connect and handle errors. Sockets are close-on-exec so
+        // commands the server runs don't hold them open
+        connectedSocketFd = accept4(svr_socket, NULL, NULL, SOCK_CLOEXEC);
         if (connectedSocketFd >= 0) {
             printf("Server connected to new client.\n");
         }
@@ -311,48 +312,69 @@ void* handle_threaded_client(void* arg) {
  */
 int exec_client_requests(int cli_socket) {
     char* buff;
+    size_t buffLen;
+    size_t buffCap;
     int recv_size;
     int is_last_chunk;
     char eof_char = '\0';
     int rc;
-
-    buff = malloc(RDSH_COMM_BUFF_SZ);
+    int result = OK;
+    arena_t arena;
+
+    // each request and its command list come from the arena, which is reset
+    // once the request has run
+    if (arena_init(&arena, ARENA_SZ) != OK) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
 
     // while we haven't chosen to exit, keep looping
     while (1) {
 
         if (SERVER_STOP) {
             // send_message_string(cli_socket, "exit");
-            return OK_EXIT;
-        }
-
-        command_list_t* clist = (command_list_t*) malloc(sizeof(command_list_t));
-        if (!clist) {
-            perror("malloc failed");
-            exit(EXIT_FAILURE);
+            result = OK_EXIT;
+            break;
         }
-        memset(clist, 0, sizeof(command_list_t));
-        clist->num = 0;
 
-        // while we haven't reached the end of our stream, keep looping and collecting chunks
-        while ((recv_size = recv(cli_socket, buff, RDSH_COMM_BUFF_SZ, 0)) > 0) {
-
-            // if we get an error, return error code for communication fault
-            if (recv_size < 0) {
-                return ERR_RDSH_COMMUNICATION;
-            }
+        arena_reset(&arena);
+        command_list_t* clist = arena_alloc(&arena, sizeof(command_list_t));
+        buffCap = RDSH_COMM_BUFF_SZ;
+        buffLen = 0;
+        buff = arena_alloc(&arena, buffCap);
+        is_last_chunk = 0;
+        recv_size = 0;
 
-            // if we received zero bytes [even though this can happen while waiting], exit
-            if (recv_size == 0) {
-                return OK;
-            }
+        // while we haven't reached the end of our stream, keep looping and collecting
+        // chunks, doubling the buffer when a long request fills it
+        while (buff != NULL && (recv_size = recv(cli_socket, buff + buffLen, buffCap - buffLen, 0)) > 0) {
+            buffLen += recv_size;
 
-            is_last_chunk = ((char) buff[recv_size-1] == eof_char) ? 1 : 0;
+            is_last_chunk = ((char) buff[buffLen-1] == eof_char) ? 1 : 0;
 
             if (is_last_chunk) {
-                buff[recv_size-1] = '\0';
                 break;
             }
+            if (buffLen == buffCap) {
+                buff = arena_grow(&arena, buff, buffCap, 2 * buffCap);
+                buffCap *= 2;
+            }
+        }
+
+        if (buff == NULL) {
+            result = ERR_MEMORY;
+            break;
+        }
+
+        // if we get an error, return error code for communication fault
+        if (recv_size < 0) {
+            result = ERR_RDSH_COMMUNICATION;
+            break;
+        }
+
+        // a client that hangs up reads as an empty request
+        if (!is_last_chunk) {
+            buff[buffLen] = '\0';
         }
 
         if (strlen(buff) == 0) {
@@ -368,34 +390,32 @@ int exec_client_requests(int cli_socket) {
 
             rc = send_message_string(cli_socket, buff);
             if (rc < 0) {
-                return ERR_RDSH_COMMUNICATION;
+                result = ERR_RDSH_COMMUNICATION;
+                break;
             }
 
             printf(RCMD_MSG_CLIENT_EXITED);
-
-            free(buff);
-            return OK;  
+            break;
         }
 
         if (strcmp(buff, "stop-server") == 0) {
 
             rc = send_message_string(cli_socket, "exit");
             if (rc < 0) {
-                return ERR_RDSH_COMMUNICATION;
+                result = ERR_RDSH_COMMUNICATION;
+                break;
             }
 
             printf(RCMD_MSG_SVR_STOP_REQ);
-
-            free(buff);
-            return OK_EXIT;
+            result = OK_EXIT;
+            break;
         }
 
-        rc = build_cmd_list(buff, clist);
+        rc = build_cmd_list(buff, clist, &arena);
         if (rc != OK) {
-            if (rc == ERR_CMD_OR_ARGS_TOO_BIG) {
-                printf(CMD_ERR_PIPE_LIMIT, 8);
+            if (rc == ERR_MEMORY) {
+                printf(CMD_ERR_MEMORY);
             }
-            free(clist);
             continue;
         }
 
@@ -406,9 +426,7 @@ int exec_client_requests(int cli_socket) {
         int saved_stderr = dup(STDERR_FILENO);
 
         rc = rsh_execute_pipeline(cli_socket, clist);
-        if (rc < 0) {
-            break;
-        }
+        free_cmd_list(clist);
 
         // set the old descriptors back
         dup2(saved_stdin, STDIN_FILENO);
@@ -420,13 +438,16 @@ int exec_client_requests(int cli_socket) {
         close(saved_stdout);
         close(saved_stderr);
 
-        // printf(RCMD_MSG_SVR_RC_CMD, rc);
-        free(clist);
+        if (rc < 0) {
+            break;
+        }
 
+        // printf(RCMD_MSG_SVR_RC_CMD, rc);
         continue;
     }
 
-    return OK;
+    arena_free(&arena);
+    return result;
 }
 
 /*
@@ -555,94 +576,33 @@ int rsh_execute_pipeline(int cli_sock, command_list_t *clist) {
         }
     }
 
-    int pipes[clist->num - 1][2];
-    pid_t pids[clist->num];
-
-    for (int i = 0; i < clist->num -1; i++) {
-        if (pipe(pipes[i]) == -1) {
-            perror("Error making pipe.");
-            exit(EXIT_FAILURE);
-        }
-    }
-
-    for (int i = 0; i < clist->num; i++) {
-        pids[i] = fork();
-        if (pids[i] == -1) {
-            perror("Error making child processes.");
-            exit(EXIT_FAILURE);
-        }
-        if (pids[i] == 0) {
-            // if (i == 0) {
-            //     dup2(cli_sock, STDIN_FILENO);
-            // }
-
-            if (i > 0) {
-                dup2(pipes[i-1][0], STDIN_FILENO);
-            }
-            if (i < clist->num - 1) {
-                dup2(pipes[i][1], STDOUT_FILENO);
-            }
-
-            // if (i == clist->num - 1) {
-            //     dup2(cli_sock, STDOUT_FILENO);
-            //     dup2(cli_sock, STDERR_FILENO);
-            // }
-
-            for (int j = 0; j < clist->num - 1; j++) {
-                close(pipes[j][0]);
-                close(pipes[j][1]);
-            }
-
-            close(cli_sock);
-
-            int rc = exec_cmd(&clist->commands[i]);
-            if (rc == OK_EXIT) {
-                exit(EXIT_SC);
-            } else if (rc == OK) {
-                exit(EXIT_SUCCESS);
-            } else {
-                exit(EXIT_FAILURE);
-            }
-        }
-    }
-
-    for (int i = 0; i < clist->num - 1; i++) {
-        close(pipes[i][0]);
-        close(pipes[i][1]);
-    }
+    // stages are launched as in execute_pipeline(). The client socket is
+    // close-on-exec, so the commands only have the copies on 0, 1 and 2
+    start_pipeline(clist, true);
 
+    // as in execute_pipeline(), every stage is waited for and the first
+    // failure is reported. Only a stage that couldn't start gets a message
     int pipelineStatus = EXIT_SUCCESS;
-    int childStatus;
+    int failedStatus = 0;
     for (int i = 0; i < clist->num; i++) {
-        waitpid(pids[i], &childStatus, 0);
-        if (WIFEXITED(childStatus) && WEXITSTATUS(childStatus) == EXIT_SC) {
+        cmd_buff_t *cmd = &clist->commands[i];
+        int exitStatus = wait_stage(cmd);
+        const char *message = launch_message(cmd);
+        if (message != NULL) {
+            send_message_string(cli_sock, (char *) message);
+        }
+        if (exitStatus == EXIT_SC) {
             pipelineStatus = OK_EXIT;
         }
-
-        if (WIFEXITED(childStatus) && WEXITSTATUS(childStatus)) {
-            switch (WEXITSTATUS(childStatus)) {
-                case ENOENT:
-                    send_message_string(cli_sock, "Command not found in PATH\n");
-                    errno = WEXITSTATUS(childStatus);
-                    // send_message_eof(cli_sock);
-                    return errno;
-                case EACCES:
-                    send_message_string(cli_sock, "Permission denied to execute command\n");
-                    errno = WEXITSTATUS(childStatus);
-                    // send_message_eof(cli_sock);
-                    return errno;
-                default:
-                    send_message_string(cli_sock, "Error executing external command\n");
-                    errno = WEXITSTATUS(childStatus);
-                    // send_message_eof(cli_sock);
-                    return errno;
-            }
+        if (exitStatus && !failedStatus) {
+            failedStatus = exitStatus;
+            errno = (cmd->pid < 0) ? cmd->launch_error : exitStatus;
         }
     }
 
     send_message_eof(cli_sock);
 
-    return pipelineStatus;
+    return failedStatus ? failedStatus : pipelineStatus;
 }
 
 Built_In_Cmds rsh_built_in_cmd(cmd_buff_t *cmd, int cli_socket) {
@@ -669,6 +629,12 @@ Built_In_Cmds rsh_built_in_cmd(cmd_buff_t *cmd, int cli_socket) {
         printf("%d\n", savedErrno);
         send_message_eof(cli_socket);
         return BI_EXECUTED;
+    } else if (type == BI_CMD_HASH) {
+        // the cache is the server's, shared by all of its clients
+        exec_hash_cmd(cmd);
+        fflush(stdout);
+        send_message_eof(cli_socket);
+        return BI_EXECUTED;
     }
     send_message_eof(cli_socket);
     return BI_EXECUTED;